@@ -48,6 +48,7 @@
 #include "wyMoveBy.h"
 #include "wyMoveByAngle.h"
 #include "wyMoveByPath.h"
+#include "wyMoveAlongPath.h"
 #include "wyMoveTo.h"
 #include "wyOrbitCamera.h"
 #include "wyPlace.h"
@@ -139,8 +140,24 @@
 #include "wyDirector.h"
 #include "wyActionManager.h"
 #include "wyTextureManager.h"
+#include "wyAsyncTextureLoader.h"
+#include "wyTextureCaps.h"
+#include "wyKTXTexture.h"
+#include "wyTextureDedup.h"
+#include "wyTextureBudget.h"
+#include "wyPixelCache.h"
+#include "wyAtlasPacker.h"
+#include "wyGLState.h"
+#include "wyShaderCache.h"
+#include "wyAtlasVBO.h"
+#include "wyTintStage.h"
+#include "wyStreamBuffer.h"
 #include "wyScheduler.h"
+#include "wyFixedStepTimer.h"
+#include "wyRenderSnapshot.h"
 #include "wyEventDispatcher.h"
+#include "wyEventRing.h"
+#include "wyInputRecorder.h"
 
 // animations
 #include "wyAnimation.h"
@@ -177,6 +194,8 @@
 #include "wyTiledSprite.h"
 #include "wySpriteEx.h"
 #include "wySpriteBatchNode.h"
+#include "wyMultiSpriteBatchNode.h"
+#include "wyTintNode.h"
 #include "wyPageControl.h"
 #include "wyCoverFlow.h"
 #include "wyAngelCodeTXTFontLoader.h"
@@ -213,6 +232,7 @@
 
 // opengl base
 #include "wyPrimitives.h"
+#include "wyPrimitiveBatch.h"
 
 // particle
 #include "wyPointParticleSystem.h"
@@ -260,12 +280,18 @@
 // utils
 #include "wyLog.h"
 #include "wyPerformance.h"
+#include "wyLatencyTracker.h"
+#include "wyGLTaskQueue.h"
+#include "wyPixelConvert.h"
+#include "wyImageScaler.h"
 #include "wyUtils.h"
 #include "wyMD5.h"
+#include "wyMurmurHash.h"
 #include "wyLayoutUtil.h"
 #include "wyScroller.h"
 #include "wyVerletRope.h"
 #include "wyZwoptexManager.h"
+#include "wyPathCache.h"
 #include "wyBitmapFont.h"
 #include "wyRunnable.h"
 #include "wyDescription.h"
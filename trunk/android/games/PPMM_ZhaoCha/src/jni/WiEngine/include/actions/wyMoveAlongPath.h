@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2010 WiYun Inc.
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __wyMoveAlongPath_h__
+#define __wyMoveAlongPath_h__
+
+#include "wyIntervalAction.h"
+#include "wyNode.h"
+#include "wyPathCache.h"
+
+/**
+ * @class wyMoveAlongPath
+ *
+ * \if English
+ * Move a node along a \link wyPathCache wyPathCache\endlink at constant speed. Unlike
+ * \link wyBezier wyBezier\endlink, \link wyLagrange wyLagrange\endlink and
+ * \link wyHypotrochoid wyHypotrochoid\endlink, it doesn't evaluate curve in every step,
+ * and the path cache can be shared by many actions.
+ * \else
+ * 节点沿\link wyPathCache wyPathCache\endlink匀速运动的动作封装. 和\link wyBezier wyBezier\endlink,
+ * \link wyLagrange wyLagrange\endlink, \link wyHypotrochoid wyHypotrochoid\endlink不同,
+ * 它不需要每一步都计算曲线, 并且路径缓存可以被多个动作共享.
+ * \endif
+ */
+class wyMoveAlongPath : public wyIntervalAction {
+protected:
+	/**
+	 * \if English
+	 * arc-length table of path
+	 * \else
+	 * 路径的弧长表
+	 * \endif
+	 */
+	wyPathCache* m_cache;
+
+	/**
+	 * \if English
+	 * true means move from end to start
+	 * \else
+	 * true表示从终点向起点移动
+	 * \endif
+	 */
+	bool m_reverse;
+
+	/**
+	 * \if English
+	 * true means enable auto rotate
+	 * \else
+	 * true表示打开自动旋转
+	 * \endif
+	 */
+	bool m_autoRotate;
+
+	/**
+	 * \if English
+	 * the delta to be added to path direction
+	 * \else
+	 * 自动旋转时附加的角度
+	 * \endif
+	 */
+	float m_angleDelta;
+
+public:
+	/**
+	 * \if English
+	 * Static factory method
+	 *
+	 * @param duration duration time in second
+	 * @param cache \link wyPathCache wyPathCache\endlink of path
+	 * \else
+	 * 静态构造方法
+	 *
+	 * @param duration 动作持续的时间
+	 * @param cache 路径的\link wyPathCache wyPathCache\endlink
+	 * \endif
+	 */
+	static wyMoveAlongPath* make(float duration, wyPathCache* cache) {
+		wyMoveAlongPath* a = new wyMoveAlongPath(duration, cache);
+		return (wyMoveAlongPath*)a->autoRelease();
+	}
+
+	/**
+	 * \if English
+	 * @param duration duration time in second
+	 * @param cache \link wyPathCache wyPathCache\endlink of path
+	 * @param reverse true means move from end to start
+	 * \else
+	 * @param duration 动作持续的时间
+	 * @param cache 路径的\link wyPathCache wyPathCache\endlink
+	 * @param reverse true表示从终点向起点移动
+	 * \endif
+	 */
+	wyMoveAlongPath(float duration, wyPathCache* cache, bool reverse = false) :
+			wyIntervalAction(duration),
+			m_cache(cache),
+			m_reverse(reverse),
+			m_autoRotate(false),
+			m_angleDelta(0) {
+		wyObjectRetain(m_cache);
+	}
+
+	virtual ~wyMoveAlongPath() {
+		wyObjectRelease(m_cache);
+	}
+
+	/// @see wyAction::copy
+	virtual wyAction* copy() {
+		wyMoveAlongPath* a = new wyMoveAlongPath(m_duration, m_cache, m_reverse);
+		a->setAutoRotate(m_autoRotate, m_angleDelta);
+		return a;
+	}
+
+	/// @see wyAction::reverse
+	virtual wyAction* reverse() {
+		wyMoveAlongPath* a = new wyMoveAlongPath(m_duration, m_cache, !m_reverse);
+		a->setAutoRotate(m_autoRotate, m_angleDelta + 180);
+		return a;
+	}
+
+	/// @see wyAction::update
+	virtual void update(float t) {
+		float d = (m_reverse ? 1 - t : t) * m_cache->getLength();
+		wyPoint p = m_cache->pointAtDistance(d);
+		m_target->setPosition(p.x, p.y);
+		if(m_autoRotate)
+			m_target->setRotation(m_angleDelta - wyUtils::r2d(m_cache->angleAtDistance(d)));
+
+		wyIntervalAction::update(t);
+	}
+
+	/**
+	 * \if English
+	 * Enable auto rotate, it means the node will be aligned with path direction.
+	 *
+	 * @param flag true means enable auto rotate
+	 * @param angleDelta the delta to be added to path direction. Position value means
+	 * 		clockwise, negative value means counter-clockwise
+	 * \else
+	 * 是否打开自动旋转，打开自动旋转表示移动的节点会自动保持和路径方向一致.
+	 *
+	 * @param flag true表示打开自动旋转
+	 * @param angleDelta 预设的角度, 正值表示顺时针旋转，负值表示逆时针旋转
+	 * \endif
+	 */
+	void setAutoRotate(bool flag, float angleDelta) {
+		m_autoRotate = flag;
+		m_angleDelta = angleDelta;
+	}
+
+	/**
+	 * \if English
+	 * Get path cache
+	 *
+	 * @return \link wyPathCache wyPathCache\endlink
+	 * \else
+	 * 得到路径缓存
+	 *
+	 * @return \link wyPathCache wyPathCache\endlink
+	 * \endif
+	 */
+	wyPathCache* getPathCache() { return m_cache; }
+};
+
+#endif // __wyMoveAlongPath_h__
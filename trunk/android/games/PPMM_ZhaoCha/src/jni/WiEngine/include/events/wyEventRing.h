@@ -0,0 +1,557 @@
+/*
+ * Copyright (c) 2010 WiYun Inc.
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __wyEventRing_h__
+#define __wyEventRing_h__
+
+#include <stdlib.h>
+#include <string.h>
+#include "wyObject.h"
+#include "wyNode.h"
+#include "wyRunnable.h"
+#include "wyEventDispatcher.h"
+#include "wyScheduler.h"
+#include "wyTargetSelector.h"
+#include "wyLatencyTracker.h"
+
+/// 缺省的事件环容量, 必须是2的整数次方
+#define WY_EVENT_RING_DEFAULT_CAPACITY 256
+
+class wyInputRecorder;
+class wyInputPlayer;
+
+/**
+ * @struct wyQueuedEvent
+ *
+ * \if English
+ * Event stored in \link wyEventRing wyEventRing\endlink. It is plain data so it can be
+ * copied into a preallocated slot without allocation.
+ * \else
+ * 保存在\link wyEventRing wyEventRing\endlink中的事件. 它是纯数据结构, 可以不分配内存
+ * 直接复制到预分配的槽中.
+ * \endif
+ */
+typedef struct wyQueuedEvent {
+	/// 事件类型
+	wyEventType type;
+
+	/// 放入队列的时间, 单位微秒, 用于\link wyLatencyTracker wyLatencyTracker\endlink
+	int64_t queueTime;
+
+	/// 事件数据, 根据类型使用不同的成员
+	union {
+		/// 触摸事件, 用于ET_TOUCH_*
+		wyMotionEvent motion;
+
+		/// 按键事件, 用于ET_KEY_*
+		wyKeyEvent key;
+
+		/// 加速器事件, 用于ET_ACCELEROMETER
+		struct {
+			float x, y, z;
+		} accel;
+
+		/// runnable, 用于ET_RUNNABLE, 入队时retain, 执行后release
+		wyRunnable* runnable;
+	};
+} wyQueuedEvent;
+
+/**
+ * @struct wyEventRingCallback
+ *
+ * \if English
+ * Callback of \link wyEventRing wyEventRing\endlink
+ * \else
+ * \link wyEventRing wyEventRing\endlink的回调函数结构定义
+ * \endif
+ */
+typedef struct wyEventRingCallback {
+	/**
+	 * \if English
+	 * Invoked on consumer thread for every event except ET_RUNNABLE, which is run directly
+	 *
+	 * @param e event, it is only valid during callback
+	 * @param data user data pointer
+	 * \else
+	 * 在消费者线程中对每个事件调用, ET_RUNNABLE除外, runnable会被直接执行
+	 *
+	 * @param e 事件, 只在回调期间有效
+	 * @param data 附加数据指针
+	 * \endif
+	 */
+	void (*onEvent)(wyQueuedEvent* e, void* data);
+} wyEventRingCallback;
+
+/**
+ * @class wyEventRing
+ *
+ * \if English
+ * Preallocated single-producer/single-consumer ring buffer of input events. Producer
+ * (usually UI thread) and consumer (GL thread) never take a lock, they only publish their
+ * own index after a memory barrier, so UI thread is never blocked by a long frame.
+ * When the ring is full new events are dropped and counted. Consecutive ET_TOUCH_MOVED
+ * events of same pointers can be coalesced when draining, only the latest one is dispatched.
+ * \else
+ * 预分配的单生产者单消费者输入事件环形缓冲区. 生产者(通常是UI线程)和消费者(OpenGL线程)
+ * 都不加锁, 只在内存屏障之后发布各自的索引, 因此UI线程不会被一个很长的帧阻塞. 缓冲区满时
+ * 新事件会被丢弃并计数. 处理时可以合并同一组触摸点的连续ET_TOUCH_MOVED事件, 只派发最新的一个.
+ * \endif
+ */
+class wyEventRing : public wyObject {
+protected:
+	/// 事件槽
+	wyQueuedEvent* m_slots;
+
+	/// 容量减1, 用于取模
+	int m_mask;
+
+	/// 消费者索引, 只由消费者写
+	volatile int m_head;
+
+	/// 生产者索引, 只由生产者写
+	volatile int m_tail;
+
+	/// true表示合并连续的移动事件
+	bool m_coalesceMoves;
+
+	/// 因为缓冲区满而丢弃的事件数
+	volatile int m_dropped;
+
+	/// 被合并掉的移动事件数
+	int m_coalesced;
+
+	/// 回调
+	wyEventRingCallback m_callback;
+
+	/// 回调附加数据
+	void* m_data;
+
+	/// 用于每帧自动处理事件的定时器
+	wyTimer* m_timer;
+
+	/// 输入记录器, 派发的事件会被记录
+	wyInputRecorder* m_recorder;
+
+	/// 输入回放器, 回放期间实时输入被丢弃
+	wyInputPlayer* m_player;
+
+protected:
+	static bool isSamePointers(wyMotionEvent& e1, wyMotionEvent& e2) {
+		if(e1.pointerCount != e2.pointerCount)
+			return false;
+		for(int i = 0; i < e1.pointerCount && i < 5; i++) {
+			if(e1.pid[i] != e2.pid[i])
+				return false;
+		}
+		return true;
+	}
+
+	void recordEvent(wyQueuedEvent* e);
+
+	void onFrame();
+
+	int playEvents();
+
+	/// 派发一个输入事件
+	void dispatch(wyQueuedEvent* e) {
+		trackLatency(e);
+		if(m_recorder)
+			recordEvent(e);
+		if(m_callback.onEvent)
+			m_callback.onEvent(e, m_data);
+	}
+
+	static void trackLatency(wyQueuedEvent* e) {
+		wyLatencyTracker* tracker = wyLatencyTracker::getInstance();
+		if(!tracker->isEnabled())
+			return;
+
+		if(e->type >= ET_TOUCH_BEGAN && e->type <= ET_TOUCH_POINTER_END)
+			tracker->onDispatched(e->motion.eventTime * 1000, e->queueTime);
+		else if(e->type >= ET_KEY_DOWN && e->type <= ET_KEY_MULTIPLE)
+			tracker->onDispatched(e->key.eventTime * 1000, e->queueTime);
+	}
+
+public:
+	/**
+	 * \if English
+	 * Static factory method
+	 *
+	 * @param callback \link wyEventRingCallback wyEventRingCallback\endlink, it will be copied
+	 * @param data user data pointer
+	 * @param capacity slot count, it will be rounded up to power of 2
+	 * \else
+	 * 静态构造方法
+	 *
+	 * @param callback \link wyEventRingCallback wyEventRingCallback\endlink, 内容会被复制
+	 * @param data 附加数据指针
+	 * @param capacity 槽的数量, 会被向上取整为2的整数次方
+	 * \endif
+	 */
+	static wyEventRing* make(wyEventRingCallback* callback, void* data, int capacity = WY_EVENT_RING_DEFAULT_CAPACITY) {
+		wyEventRing* r = new wyEventRing(callback, data, capacity);
+		return (wyEventRing*)r->autoRelease();
+	}
+
+	wyEventRing(wyEventRingCallback* callback, void* data, int capacity) :
+			m_head(0),
+			m_tail(0),
+			m_coalesceMoves(true),
+			m_dropped(0),
+			m_coalesced(0),
+			m_data(data),
+			m_timer(NULL),
+			m_recorder(NULL),
+			m_player(NULL) {
+		int size = 2;
+		while(size < capacity)
+			size <<= 1;
+		m_mask = size - 1;
+		m_slots = (wyQueuedEvent*)calloc(size, sizeof(wyQueuedEvent));
+		if(callback)
+			m_callback = *callback;
+		else
+			memset(&m_callback, 0, sizeof(wyEventRingCallback));
+	}
+
+	virtual ~wyEventRing() {
+		stop();
+		setRecorder(NULL);
+		setPlayer(NULL);
+
+		// release runnables never executed
+		for(int i = m_head; i != m_tail; i = (i + 1) & m_mask) {
+			if(m_slots[i].type == ET_RUNNABLE)
+				m_slots[i].runnable->release();
+		}
+		free(m_slots);
+	}
+
+	/// @see wyObject::onTargetSelectorInvoked
+	virtual void onTargetSelectorInvoked(wyTargetSelector* ts) {
+		// a new frame begins, frame counters advance in one place before events of the frame
+		onFrame();
+		drain();
+	}
+
+	/**
+	 * \if English
+	 * Put an event into ring, only for producer thread
+	 *
+	 * @param e event, it is copied
+	 * @return false if ring is full and event is dropped
+	 * \else
+	 * 把一个事件放入环中, 只能在生产者线程中调用
+	 *
+	 * @param e 事件, 会被复制
+	 * @return 如果环已满事件被丢弃, 返回false
+	 * \endif
+	 */
+	bool offer(const wyQueuedEvent& e) {
+		int tail = m_tail;
+		int next = (tail + 1) & m_mask;
+		if(next == m_head) {
+			__sync_fetch_and_add(&m_dropped, 1);
+			return false;
+		}
+
+		m_slots[tail] = e;
+		m_slots[tail].queueTime = wyLatencyTracker::currentTimeMicros();
+
+		// slot must be visible before tail is published
+		__sync_synchronize();
+		m_tail = next;
+		return true;
+	}
+
+	/**
+	 * \if English
+	 * Put a touch event into ring, only for producer thread
+	 *
+	 * @param type one of ET_TOUCH_* types
+	 * @param me converted motion event
+	 * @return false if event is dropped
+	 * \else
+	 * 把一个触摸事件放入环中, 只能在生产者线程中调用
+	 *
+	 * @param type ET_TOUCH_*类型之一
+	 * @param me 已转换的触摸事件
+	 * @return 如果事件被丢弃返回false
+	 * \endif
+	 */
+	bool offerMotion(wyEventType type, wyMotionEvent& me) {
+		wyQueuedEvent e;
+		e.type = type;
+		e.motion = me;
+		return offer(e);
+	}
+
+	/**
+	 * \if English
+	 * Put a key event into ring, only for producer thread
+	 *
+	 * @param type one of ET_KEY_* types
+	 * @param ke key event
+	 * @return false if event is dropped
+	 * \else
+	 * 把一个按键事件放入环中, 只能在生产者线程中调用
+	 *
+	 * @param type ET_KEY_*类型之一
+	 * @param ke 按键事件
+	 * @return 如果事件被丢弃返回false
+	 * \endif
+	 */
+	bool offerKey(wyEventType type, wyKeyEvent& ke) {
+		wyQueuedEvent e;
+		e.type = type;
+		e.key = ke;
+		return offer(e);
+	}
+
+	/**
+	 * \if English
+	 * Put an accelerometer event into ring, only for producer thread
+	 * \else
+	 * 把一个加速器事件放入环中, 只能在生产者线程中调用
+	 * \endif
+	 */
+	bool offerAccel(float x, float y, float z) {
+		wyQueuedEvent e;
+		e.type = ET_ACCELEROMETER;
+		e.accel.x = x;
+		e.accel.y = y;
+		e.accel.z = z;
+		return offer(e);
+	}
+
+	/**
+	 * \if English
+	 * Put a runnable into ring, it will be run on consumer thread. Only for producer thread.
+	 *
+	 * @param runnable \link wyRunnable wyRunnable\endlink, it is retained until executed
+	 * @return false if runnable is dropped
+	 * \else
+	 * 把一个runnable放入环中, 它会在消费者线程中执行. 只能在生产者线程中调用.
+	 *
+	 * @param runnable \link wyRunnable wyRunnable\endlink, 执行前会被retain
+	 * @return 如果runnable被丢弃返回false
+	 * \endif
+	 */
+	bool offerRunnable(wyRunnable* runnable) {
+		wyQueuedEvent e;
+		e.type = ET_RUNNABLE;
+		e.runnable = runnable;
+		runnable->retain();
+		if(!offer(e)) {
+			runnable->release();
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	 * \if English
+	 * Dispatch all queued events, only for consumer thread
+	 *
+	 * @return count of dispatched events
+	 * \else
+	 * 派发所有排队的事件, 只能在消费者线程中调用
+	 *
+	 * @return 派发的事件数
+	 * \endif
+	 */
+	int drain() {
+		int head = m_head;
+		int tail = m_tail;
+
+		// slots must be read after tail is read
+		__sync_synchronize();
+
+		int count = 0;
+		while(head != tail) {
+			wyQueuedEvent* e = &m_slots[head];
+			int next = (head + 1) & m_mask;
+			if(e->type == ET_RUNNABLE) {
+				e->runnable->run();
+				e->runnable->release();
+				count++;
+			} else if(m_coalesceMoves && e->type == ET_TOUCH_MOVED && next != tail &&
+					m_slots[next].type == ET_TOUCH_MOVED && isSamePointers(e->motion, m_slots[next].motion)) {
+				m_coalesced++;
+			} else if(m_player == NULL) {
+				dispatch(e);
+				count++;
+			}
+			head = next;
+		}
+
+		// slots must be consumed before they are released to producer
+		__sync_synchronize();
+		m_head = head;
+
+		// replayed events are injected on consumer side, producer keeps being the only writer of ring
+		if(m_player)
+			count += playEvents();
+		return count;
+	}
+
+	/**
+	 * \if English
+	 * Helper to deliver an event to a node's event methods
+	 *
+	 * @param node node to receive event
+	 * @param e event
+	 * @return true if node consumed event
+	 * \else
+	 * 把一个事件派发给节点的事件方法的辅助方法
+	 *
+	 * @param node 接收事件的节点
+	 * @param e 事件
+	 * @return true表示节点处理了事件
+	 * \endif
+	 */
+	static bool dispatchToNode(wyNode* node, wyQueuedEvent* e) {
+		switch(e->type) {
+			case ET_TOUCH_BEGAN:
+				return node->touchesBegan(e->motion);
+			case ET_TOUCH_MOVED:
+				return node->touchesMoved(e->motion);
+			case ET_TOUCH_ENDED:
+				return node->touchesEnded(e->motion);
+			case ET_TOUCH_CANCELLED:
+				return node->touchesCancelled(e->motion);
+			case ET_TOUCH_POINTER_BEGAN:
+				return node->touchesPointerBegan(e->motion);
+			case ET_TOUCH_POINTER_END:
+				return node->touchesPointerEnded(e->motion);
+			case ET_KEY_DOWN:
+				return node->keyDown(e->key);
+			case ET_KEY_UP:
+				return node->keyUp(e->key);
+			case ET_KEY_MULTIPLE:
+				return node->keyMultiple(e->key);
+			case ET_ACCELEROMETER:
+				node->accelerometerChanged(e->accel.x, e->accel.y, e->accel.z);
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	/**
+	 * \if English
+	 * Drain events automatically in every frame of scheduler
+	 * \else
+	 * 在调度器的每一帧自动处理事件
+	 * \endif
+	 */
+	void start() {
+		if(m_timer)
+			return;
+
+		m_timer = wyTimer::make(wyTargetSelector::make(this, 0, NULL));
+		m_timer->retain();
+		wyScheduler::getInstance()->scheduleLocked(m_timer);
+	}
+
+	/**
+	 * \if English
+	 * Stop draining events automatically
+	 * \else
+	 * 停止自动处理事件
+	 * \endif
+	 */
+	void stop() {
+		if(!m_timer)
+			return;
+
+		wyScheduler::getInstance()->unscheduleLocked(m_timer);
+		m_timer->release();
+		m_timer = NULL;
+	}
+
+	/**
+	 * \if English
+	 * Set whether to coalesce consecutive ET_TOUCH_MOVED of same pointers
+	 *
+	 * @param flag true means coalescing, default is true
+	 * \else
+	 * 设置是否合并同一组触摸点的连续ET_TOUCH_MOVED事件
+	 *
+	 * @param flag true表示合并, 缺省是true
+	 * \endif
+	 */
+	void setCoalesceMoves(bool flag) { m_coalesceMoves = flag; }
+
+	/**
+	 * \if English
+	 * Set recorder, every dispatched event will be recorded
+	 *
+	 * @param recorder \link wyInputRecorder wyInputRecorder\endlink, NULL means stop recording
+	 * \else
+	 * 设置输入记录器, 每个被派发的事件都会被记录
+	 *
+	 * @param recorder \link wyInputRecorder wyInputRecorder\endlink, NULL表示停止记录
+	 * \endif
+	 */
+	void setRecorder(wyInputRecorder* recorder);
+
+	/// 得到输入记录器
+	wyInputRecorder* getRecorder() { return m_recorder; }
+
+	/**
+	 * \if English
+	 * Set player, its events are dispatched when ring drains. Live input events are dropped while
+	 * playing, runnables still run. Player is removed when it is done.
+	 *
+	 * @param player \link wyInputPlayer wyInputPlayer\endlink, NULL means stop playing
+	 * \else
+	 * 设置输入回放器, 它的事件在环处理事件时被派发. 回放期间实时输入事件被丢弃, runnable仍然会执行.
+	 * 回放完毕后回放器被移除.
+	 *
+	 * @param player \link wyInputPlayer wyInputPlayer\endlink, NULL表示停止回放
+	 * \endif
+	 */
+	void setPlayer(wyInputPlayer* player);
+
+	/// 得到输入回放器
+	wyInputPlayer* getPlayer() { return m_player; }
+
+	/// 是否合并连续的移动事件
+	bool isCoalesceMoves() { return m_coalesceMoves; }
+
+	/// 得到容量
+	int getCapacity() { return m_mask; }
+
+	/// 得到当前排队的事件数, 仅为近似值
+	int getSize() { return (m_tail - m_head) & m_mask; }
+
+	/// 得到因为缓冲区满而丢弃的事件数
+	int getDroppedCount() { return m_dropped; }
+
+	/// 得到被合并掉的移动事件数
+	int getCoalescedCount() { return m_coalesced; }
+};
+
+// recorder needs complete wyEventRing, so it is included after
+#include "wyInputRecorder.h"
+
+#endif // __wyEventRing_h__
@@ -0,0 +1,411 @@
+/*
+ * Copyright (c) 2010 WiYun Inc.
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __wyInputRecorder_h__
+#define __wyInputRecorder_h__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "wyObject.h"
+#include "wyLog.h"
+#include "wyEventRing.h"
+
+/// 输入记录文件的魔数
+#define WY_INPUT_RECORD_MAGIC 0x52494957
+
+/// 输入记录文件的版本
+#define WY_INPUT_RECORD_VERSION 1
+
+/**
+ * @class wyInputRecorder
+ *
+ * \if English
+ * Record input events consumed from a \link wyEventRing wyEventRing\endlink into a compact
+ * binary file, together with frame number in which they are dispatched. The file can be
+ * played back by \link wyInputPlayer wyInputPlayer\endlink. Combined with lockstep mode of
+ * \link wyFixedStepTimer wyFixedStepTimer\endlink, a replayed session is deterministic and
+ * can be used as a benchmark of real gameplay.
+ *
+ * Record layout: frame (uint32), type (uint8), then payload depending on type. Touch
+ * payload is pointer count (uint8), index (uint8), then pid (int16), x (float), y (float)
+ * for every pointer. Key payload is key code (uint16) and repeat count (uint16).
+ * Accelerometer payload is x, y, z (float). Runnables are not recorded.
+ *
+ * Frame number is advanced by the ring in its per frame callback right before it drains, so it
+ * doesn't depend on the order in which scheduler runs timers.
+ * \else
+ * 把从\link wyEventRing wyEventRing\endlink中派发的输入事件, 连同派发时的帧号, 记录到一个
+ * 紧凑的二进制文件中. 文件可以由\link wyInputPlayer wyInputPlayer\endlink回放. 配合
+ * \link wyFixedStepTimer wyFixedStepTimer\endlink的锁步模式, 回放的过程是确定的, 可以作为真实
+ * 游戏过程的性能测试.
+ *
+ * 记录格式: 帧号(uint32), 类型(uint8), 之后是和类型相关的数据. 触摸数据是触摸点数(uint8),
+ * 索引(uint8), 然后每个触摸点是pid(int16), x(float), y(float). 按键数据是按键代码(uint16)和
+ * 重复次数(uint16). 加速器数据是x, y, z(float). runnable不会被记录.
+ *
+ * 帧号由事件环在每帧的回调中处理事件之前增加, 因此不依赖于调度器执行定时器的顺序.
+ * \endif
+ */
+class wyInputRecorder : public wyObject {
+protected:
+	/// 输出文件
+	FILE* m_file;
+
+	/// 当前帧号
+	uint32_t m_frame;
+
+	/// 已记录的事件数
+	int m_count;
+
+public:
+	/**
+	 * \if English
+	 * Static factory method
+	 *
+	 * @param path path of output file
+	 * @return recorder, or NULL if file can't be created
+	 * \else
+	 * 静态构造方法
+	 *
+	 * @param path 输出文件的路径
+	 * @return 记录器, 如果文件无法创建返回NULL
+	 * \endif
+	 */
+	static wyInputRecorder* make(const char* path) {
+		wyInputRecorder* r = new wyInputRecorder(path);
+		if(r->m_file == NULL) {
+			r->release();
+			return NULL;
+		}
+		return (wyInputRecorder*)r->autoRelease();
+	}
+
+	wyInputRecorder(const char* path) :
+			m_frame(0),
+			m_count(0) {
+		m_file = fopen(path, "wb");
+		if(m_file == NULL) {
+			LOGW("wyInputRecorder: can't create %s", path);
+			return;
+		}
+
+		uint32_t header[2] = { WY_INPUT_RECORD_MAGIC, WY_INPUT_RECORD_VERSION };
+		fwrite(header, sizeof(header), 1, m_file);
+	}
+
+	virtual ~wyInputRecorder() {
+		close();
+	}
+
+	/// 进入新的一帧, 由事件环调用
+	void onFrame() {
+		m_frame++;
+	}
+
+	/**
+	 * \if English
+	 * Write an event at current frame
+	 *
+	 * @param e event
+	 * \else
+	 * 在当前帧写入一个事件
+	 *
+	 * @param e 事件
+	 * \endif
+	 */
+	void record(wyQueuedEvent* e) {
+		if(m_file == NULL || e->type == ET_RUNNABLE)
+			return;
+
+		uint8_t type = (uint8_t)e->type;
+		fwrite(&m_frame, sizeof(uint32_t), 1, m_file);
+		fwrite(&type, sizeof(uint8_t), 1, m_file);
+		if(e->type >= ET_TOUCH_BEGAN && e->type <= ET_TOUCH_POINTER_END) {
+			uint8_t head[2] = { (uint8_t)MIN(e->motion.pointerCount, 5), (uint8_t)e->motion.index };
+			fwrite(head, sizeof(head), 1, m_file);
+			for(int i = 0; i < head[0]; i++) {
+				int16_t pid = (int16_t)e->motion.pid[i];
+				fwrite(&pid, sizeof(int16_t), 1, m_file);
+				fwrite(&e->motion.x[i], sizeof(float), 1, m_file);
+				fwrite(&e->motion.y[i], sizeof(float), 1, m_file);
+			}
+		} else if(e->type >= ET_KEY_DOWN && e->type <= ET_KEY_MULTIPLE) {
+			uint16_t key[2] = { (uint16_t)e->key.keyCode, (uint16_t)e->key.repeatCount };
+			fwrite(key, sizeof(key), 1, m_file);
+		} else if(e->type == ET_ACCELEROMETER) {
+			float accel[3] = { e->accel.x, e->accel.y, e->accel.z };
+			fwrite(accel, sizeof(accel), 1, m_file);
+		}
+		m_count++;
+	}
+
+	/**
+	 * \if English
+	 * Stop recording and close file
+	 * \else
+	 * 停止记录并关闭文件
+	 * \endif
+	 */
+	void close() {
+		if(m_file) {
+			fclose(m_file);
+			m_file = NULL;
+		}
+	}
+
+	/// 得到当前帧号
+	uint32_t getFrame() { return m_frame; }
+
+	/// 得到已记录的事件数
+	int getCount() { return m_count; }
+};
+
+/**
+ * @class wyInputPlayer
+ *
+ * \if English
+ * Play back a file written by \link wyInputRecorder wyInputRecorder\endlink. Player is attached
+ * to a \link wyEventRing wyEventRing\endlink, which dispatches its events when it drains at the
+ * same frame number they were recorded, so they go through the same dispatch path as live input.
+ * Events are injected on consumer side, so live input thread stays the only producer of ring,
+ * and live input events are dropped until playing is done.
+ * \else
+ * 回放\link wyInputRecorder wyInputRecorder\endlink写入的文件. 回放器被附加到\link wyEventRing wyEventRing\endlink,
+ * 环在与记录时相同的帧号处理事件时派发它的事件, 因此和实时输入经过相同的派发路径. 事件在消费者一侧注入,
+ * 因此实时输入线程仍然是环唯一的生产者, 回放完毕之前实时输入事件被丢弃.
+ * \endif
+ */
+class wyInputPlayer : public wyObject {
+protected:
+	/// 输入文件
+	FILE* m_file;
+
+	/// 当前帧号
+	uint32_t m_frame;
+
+	/// 已读出但还未到注入帧的事件
+	wyQueuedEvent m_next;
+
+	/// 已读出事件的帧号
+	uint32_t m_nextFrame;
+
+	/// true表示m_next有效
+	bool m_hasNext;
+
+	/// 已注入的事件数
+	int m_count;
+
+protected:
+	bool readNext() {
+		uint8_t type;
+		if(fread(&m_nextFrame, sizeof(uint32_t), 1, m_file) != 1 || fread(&type, sizeof(uint8_t), 1, m_file) != 1)
+			return false;
+
+		memset(&m_next, 0, sizeof(wyQueuedEvent));
+		m_next.type = (wyEventType)type;
+		if(m_next.type >= ET_TOUCH_BEGAN && m_next.type <= ET_TOUCH_POINTER_END) {
+			uint8_t head[2];
+			if(fread(head, sizeof(head), 1, m_file) != 1 || head[0] > 5)
+				return false;
+			m_next.motion.pointerCount = head[0];
+			m_next.motion.index = head[1];
+			for(int i = 0; i < head[0]; i++) {
+				int16_t pid;
+				if(fread(&pid, sizeof(int16_t), 1, m_file) != 1 ||
+						fread(&m_next.motion.x[i], sizeof(float), 1, m_file) != 1 ||
+						fread(&m_next.motion.y[i], sizeof(float), 1, m_file) != 1)
+					return false;
+				m_next.motion.pid[i] = pid;
+			}
+			m_next.motion.eventTime = wyLatencyTracker::currentTimeMicros() / 1000;
+		} else if(m_next.type >= ET_KEY_DOWN && m_next.type <= ET_KEY_MULTIPLE) {
+			uint16_t key[2];
+			if(fread(key, sizeof(key), 1, m_file) != 1)
+				return false;
+			m_next.key.keyCode = (wyKeyCode)key[0];
+			m_next.key.repeatCount = key[1];
+		} else if(m_next.type == ET_ACCELEROMETER) {
+			float accel[3];
+			if(fread(accel, sizeof(accel), 1, m_file) != 1)
+				return false;
+			m_next.accel.x = accel[0];
+			m_next.accel.y = accel[1];
+			m_next.accel.z = accel[2];
+		} else {
+			return false;
+		}
+		return true;
+	}
+
+public:
+	/**
+	 * \if English
+	 * Static factory method
+	 *
+	 * @param path path of record file
+	 * @param ring \link wyEventRing wyEventRing\endlink to inject events into, it holds player until
+	 * 		playing is done
+	 * @return player, or NULL if file is not a valid record
+	 * \else
+	 * 静态构造方法
+	 *
+	 * @param path 记录文件的路径
+	 * @param ring 注入事件的\link wyEventRing wyEventRing\endlink, 回放完毕之前它持有回放器
+	 * @return 回放器, 如果文件不是有效的记录返回NULL
+	 * \endif
+	 */
+	static wyInputPlayer* make(const char* path, wyEventRing* ring) {
+		wyInputPlayer* p = new wyInputPlayer(path, ring);
+		if(p->m_file == NULL) {
+			p->release();
+			return NULL;
+		}
+		return (wyInputPlayer*)p->autoRelease();
+	}
+
+	wyInputPlayer(const char* path, wyEventRing* ring) :
+			m_frame(0),
+			m_nextFrame(0),
+			m_hasNext(false),
+			m_count(0) {
+		m_file = fopen(path, "rb");
+		if(m_file == NULL) {
+			LOGW("wyInputPlayer: can't open %s", path);
+			return;
+		}
+
+		uint32_t header[2];
+		if(fread(header, sizeof(header), 1, m_file) != 1 ||
+				header[0] != WY_INPUT_RECORD_MAGIC || header[1] != WY_INPUT_RECORD_VERSION) {
+			LOGW("wyInputPlayer: %s is not a valid input record", path);
+			fclose(m_file);
+			m_file = NULL;
+			return;
+		}
+
+		m_hasNext = readNext();
+		ring->setPlayer(this);
+	}
+
+	virtual ~wyInputPlayer() {
+		stop();
+	}
+
+	/// 进入新的一帧, 由事件环调用
+	void onFrame() {
+		m_frame++;
+	}
+
+	/**
+	 * \if English
+	 * Get next event due in current frame, called by ring when it drains
+	 *
+	 * @param e receives event
+	 * @return false if no more event is due in current frame
+	 * \else
+	 * 得到当前帧应该派发的下一个事件, 由事件环在处理事件时调用
+	 *
+	 * @param e 接收事件
+	 * @return 当前帧没有更多事件时返回false
+	 * \endif
+	 */
+	bool nextEvent(wyQueuedEvent* e) {
+		if(!m_hasNext || m_nextFrame > m_frame)
+			return false;
+		*e = m_next;
+		e->queueTime = wyLatencyTracker::currentTimeMicros();
+		m_count++;
+		m_hasNext = readNext();
+		if(!m_hasNext)
+			stop();
+		return true;
+	}
+
+	/**
+	 * \if English
+	 * Stop playing and close file, ring removes player when it drains next time
+	 * \else
+	 * 停止回放并关闭文件, 事件环下一次处理事件时移除回放器
+	 * \endif
+	 */
+	void stop() {
+		if(m_file) {
+			fclose(m_file);
+			m_file = NULL;
+		}
+		m_hasNext = false;
+	}
+
+	/// 是否已经回放完毕
+	bool isDone() { return m_file == NULL; }
+
+	/// 得到当前帧号
+	uint32_t getFrame() { return m_frame; }
+
+	/// 得到已注入的事件数
+	int getCount() { return m_count; }
+};
+
+inline void wyEventRing::setRecorder(wyInputRecorder* recorder) {
+	wyObjectRetain(recorder);
+	wyObjectRelease(m_recorder);
+	m_recorder = recorder;
+}
+
+inline void wyEventRing::recordEvent(wyQueuedEvent* e) {
+	m_recorder->record(e);
+}
+
+inline void wyEventRing::setPlayer(wyInputPlayer* player) {
+	wyObjectRetain(player);
+	wyObjectRelease(m_player);
+	m_player = player;
+}
+
+inline void wyEventRing::onFrame() {
+	wyLatencyTracker::getInstance()->onFrame();
+	if(m_recorder)
+		m_recorder->onFrame();
+	if(m_player)
+		m_player->onFrame();
+}
+
+inline int wyEventRing::playEvents() {
+	// a dispatched handler may replace or clear player, keep this one alive and stop if it is gone
+	wyInputPlayer* player = m_player;
+	if(player == NULL)
+		return 0;
+	wyObjectRetain(player);
+
+	int count = 0;
+	wyQueuedEvent e;
+	while(m_player == player && player->nextEvent(&e)) {
+		dispatch(&e);
+		count++;
+	}
+	if(m_player == player && player->isDone())
+		setPlayer(NULL);
+	wyObjectRelease(player);
+	return count;
+}
+
+#endif // __wyInputRecorder_h__
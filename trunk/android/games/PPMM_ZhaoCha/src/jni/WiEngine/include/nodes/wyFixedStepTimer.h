@@ -0,0 +1,451 @@
+/*
+ * Copyright (c) 2010 WiYun Inc.
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __wyFixedStepTimer_h__
+#define __wyFixedStepTimer_h__
+
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "wyObject.h"
+#include "wyArray.h"
+#include "wyNode.h"
+#include "wyScheduler.h"
+#include "wyTargetSelector.h"
+
+/// 缺省的固定步长, 60分之一秒
+#define WY_FIXED_STEP_DEFAULT (1.f / 60.f)
+
+/// 缺省的每帧最多追赶步数
+#define WY_FIXED_STEP_DEFAULT_MAX_STEPS 5
+
+/**
+ * @struct wyFixedStepCallback
+ *
+ * \if English
+ * Callback of \link wyFixedStepTimer wyFixedStepTimer\endlink
+ * \else
+ * \link wyFixedStepTimer wyFixedStepTimer\endlink的回调函数结构定义
+ * \endif
+ */
+typedef struct wyFixedStepCallback {
+	/**
+	 * \if English
+	 * Invoked for every fixed step, game logic and physics world should be stepped here
+	 *
+	 * @param step fixed step time in second
+	 * @param data user data pointer
+	 * \else
+	 * 每一个固定步长调用一次, 游戏逻辑和物理世界应该在这里步进
+	 *
+	 * @param step 固定步长, 单位秒
+	 * @param data 附加数据指针
+	 * \endif
+	 */
+	void (*onStep)(float step, void* data);
+
+	/**
+	 * \if English
+	 * Invoked once per frame after all steps, before rendering
+	 *
+	 * @param alpha interpolation factor between previous and current step, from 0 to 1
+	 * @param data user data pointer
+	 * \else
+	 * 每帧所有步长执行完毕后, 渲染之前调用一次
+	 *
+	 * @param alpha 上一步和当前步之间的插值系数, 从0到1
+	 * @param data 附加数据指针
+	 * \endif
+	 */
+	void (*onInterpolate)(float alpha, void* data);
+} wyFixedStepCallback;
+
+/**
+ * @struct wyInterpolatedNode
+ *
+ * \if English
+ * Transform record of a node rendered by interpolation
+ * \else
+ * 以插值方式渲染的节点的变换记录
+ * \endif
+ */
+typedef struct wyInterpolatedNode {
+	/// 节点
+	wyNode* node;
+
+	/// 上一步的x位置
+	float prevX;
+
+	/// 上一步的y位置
+	float prevY;
+
+	/// 上一步的旋转角度
+	float prevRotation;
+
+	/// 当前步的x位置
+	float x;
+
+	/// 当前步的y位置
+	float y;
+
+	/// 当前步的旋转角度
+	float rotation;
+} wyInterpolatedNode;
+
+/**
+ * @class wyFixedStepTimer
+ *
+ * \if English
+ * Drive simulation with a fixed time step. Frame delta is accumulated and consumed in
+ * fixed steps, so a frame hitch doesn't make a large step, and simulation result doesn't
+ * depend on frame rate. To avoid spiral of death, steps of one frame is limited and the
+ * backlog is dropped. Registered nodes are rendered at position interpolated between
+ * last two steps, and restored to simulated position before next step.
+ * In lockstep mode, every frame runs exactly one step regardless of frame delta, it is
+ * useful to replay a session deterministically.
+ * \else
+ * 以固定步长驱动模拟. 帧间隔时间被累积起来, 再按照固定步长消耗, 因此一次卡顿不会导致一个
+ * 很大的步长, 模拟结果也不再依赖于帧率. 为了避免越追越慢, 每帧的步数有上限, 超出的部分会被
+ * 丢弃. 注册的节点在渲染时使用最后两步之间的插值位置, 在下一次步进前恢复为模拟位置.
+ * 锁步模式下, 不论帧间隔是多少, 每帧都只执行一步, 可以用来确定性的重放一段游戏过程.
+ * \endif
+ */
+class wyFixedStepTimer : public wyObject {
+protected:
+	/// 固定步长
+	float m_step;
+
+	/// 每帧最多执行的步数
+	int m_maxSteps;
+
+	/// 累积的尚未消耗的时间
+	float m_accumulator;
+
+	/// 当前的插值系数
+	float m_alpha;
+
+	/// 已经执行的总步数
+	int m_stepCount;
+
+	/// 被丢弃的步数, 超过\c m_maxSteps的部分会被丢弃
+	int m_droppedSteps;
+
+	/// true表示锁步模式, 每帧只执行一步
+	bool m_lockstep;
+
+	/// true表示节点当前处于插值位置
+	bool m_interpolated;
+
+	/// 回调
+	wyFixedStepCallback m_callback;
+
+	/// 回调附加数据
+	void* m_data;
+
+	/// 驱动自己的定时器
+	wyTimer* m_timer;
+
+	/// 以插值方式渲染的节点, 元素是\link wyInterpolatedNode wyInterpolatedNode\endlink指针
+	wyArray* m_nodes;
+
+protected:
+	static float lerpAngle(float from, float to, float alpha) {
+		float diff = fmodf(to - from, 360.f);
+		if(diff > 180.f)
+			diff -= 360.f;
+		else if(diff < -180.f)
+			diff += 360.f;
+		return from + diff * alpha;
+	}
+
+	/**
+	 * \if English
+	 * Restore nodes to simulated transform
+	 * \else
+	 * 恢复节点的模拟位置
+	 * \endif
+	 */
+	void restoreNodes() {
+		if(!m_interpolated)
+			return;
+
+		for(int i = 0; i < m_nodes->num; i++) {
+			wyInterpolatedNode* in = (wyInterpolatedNode*)wyArrayGet(m_nodes, i);
+			in->node->setPosition(in->x, in->y);
+			in->node->setRotation(in->rotation);
+		}
+		m_interpolated = false;
+	}
+
+	/**
+	 * \if English
+	 * Record transform of nodes before a step
+	 * \else
+	 * 步进前记录节点的变换
+	 * \endif
+	 */
+	void recordNodes() {
+		for(int i = 0; i < m_nodes->num; i++) {
+			wyInterpolatedNode* in = (wyInterpolatedNode*)wyArrayGet(m_nodes, i);
+			in->prevX = in->node->getPositionX();
+			in->prevY = in->node->getPositionY();
+			in->prevRotation = in->node->getRotation();
+		}
+	}
+
+	/**
+	 * \if English
+	 * Save simulated transform and set interpolated transform to nodes
+	 * \else
+	 * 保存模拟后的变换, 并把插值后的变换设置给节点
+	 * \endif
+	 */
+	void interpolateNodes() {
+		for(int i = 0; i < m_nodes->num; i++) {
+			wyInterpolatedNode* in = (wyInterpolatedNode*)wyArrayGet(m_nodes, i);
+			in->x = in->node->getPositionX();
+			in->y = in->node->getPositionY();
+			in->rotation = in->node->getRotation();
+			in->node->setPosition(in->prevX + (in->x - in->prevX) * m_alpha,
+					in->prevY + (in->y - in->prevY) * m_alpha);
+			in->node->setRotation(lerpAngle(in->prevRotation, in->rotation, m_alpha));
+		}
+		m_interpolated = m_nodes->num > 0;
+	}
+
+public:
+	/**
+	 * \if English
+	 * Static factory method
+	 *
+	 * @param callback \link wyFixedStepCallback wyFixedStepCallback\endlink, it will be copied
+	 * @param data user data pointer
+	 * @param step fixed step time in second
+	 * \else
+	 * 静态构造方法
+	 *
+	 * @param callback \link wyFixedStepCallback wyFixedStepCallback\endlink, 内容会被复制
+	 * @param data 附加数据指针
+	 * @param step 固定步长, 单位秒
+	 * \endif
+	 */
+	static wyFixedStepTimer* make(wyFixedStepCallback* callback, void* data, float step = WY_FIXED_STEP_DEFAULT) {
+		wyFixedStepTimer* t = new wyFixedStepTimer(callback, data, step);
+		return (wyFixedStepTimer*)t->autoRelease();
+	}
+
+	wyFixedStepTimer(wyFixedStepCallback* callback, void* data, float step) :
+			m_step(step > 0 ? step : WY_FIXED_STEP_DEFAULT),
+			m_maxSteps(WY_FIXED_STEP_DEFAULT_MAX_STEPS),
+			m_accumulator(0),
+			m_alpha(1),
+			m_stepCount(0),
+			m_droppedSteps(0),
+			m_lockstep(false),
+			m_interpolated(false),
+			m_data(data),
+			m_timer(NULL),
+			m_nodes(wyArrayNew(4)) {
+		if(callback)
+			m_callback = *callback;
+		else
+			memset(&m_callback, 0, sizeof(wyFixedStepCallback));
+	}
+
+	virtual ~wyFixedStepTimer() {
+		stop();
+		while(m_nodes->num > 0)
+			removeInterpolatedNode(((wyInterpolatedNode*)wyArrayGet(m_nodes, 0))->node);
+		wyArrayDestroy(m_nodes);
+	}
+
+	/// @see wyObject::onTargetSelectorInvoked
+	virtual void onTargetSelectorInvoked(wyTargetSelector* ts) {
+		tick(ts->getDelta());
+	}
+
+	/**
+	 * \if English
+	 * Start stepping with every frame of scheduler
+	 * \else
+	 * 开始随调度器的每一帧步进
+	 * \endif
+	 */
+	void start() {
+		if(m_timer)
+			return;
+
+		m_timer = wyTimer::make(wyTargetSelector::make(this, 0, NULL));
+		m_timer->retain();
+		wyScheduler::getInstance()->scheduleLocked(m_timer);
+	}
+
+	/**
+	 * \if English
+	 * Stop stepping, interpolated nodes are restored to simulated transform
+	 * \else
+	 * 停止步进, 插值节点会被恢复为模拟位置
+	 * \endif
+	 */
+	void stop() {
+		if(!m_timer)
+			return;
+
+		wyScheduler::getInstance()->unscheduleLocked(m_timer);
+		m_timer->release();
+		m_timer = NULL;
+		restoreNodes();
+	}
+
+	/**
+	 * \if English
+	 * Advance by a frame delta. It is called automatically after \c start, or can be
+	 * called manually with a custom delta.
+	 *
+	 * @param delta frame delta in second
+	 * \else
+	 * 按一个帧间隔推进. \c start之后会被自动调用, 也可以用自定义的间隔手动调用
+	 *
+	 * @param delta 帧间隔, 单位秒
+	 * \endif
+	 */
+	void tick(float delta) {
+		restoreNodes();
+
+		int steps;
+		if(m_lockstep) {
+			steps = 1;
+			m_accumulator = 0;
+		} else {
+			m_accumulator += MAX(0, delta);
+			steps = (int)(m_accumulator / m_step);
+			m_accumulator -= steps * m_step;
+			if(steps > m_maxSteps) {
+				m_droppedSteps += steps - m_maxSteps;
+				steps = m_maxSteps;
+			}
+		}
+
+		for(int i = 0; i < steps; i++) {
+			recordNodes();
+			if(m_callback.onStep)
+				m_callback.onStep(m_step, m_data);
+			m_stepCount++;
+		}
+
+		m_alpha = m_lockstep ? 1 : m_accumulator / m_step;
+		interpolateNodes();
+		if(m_callback.onInterpolate)
+			m_callback.onInterpolate(m_alpha, m_data);
+	}
+
+	/**
+	 * \if English
+	 * Render a node at interpolated transform. The node must be moved only in step callback.
+	 *
+	 * @param node node to be interpolated, it will be retained
+	 * \else
+	 * 以插值变换渲染一个节点. 该节点只应在步进回调中被移动.
+	 *
+	 * @param node 需要插值的节点, 会被retain
+	 * \endif
+	 */
+	void addInterpolatedNode(wyNode* node) {
+		restoreNodes();
+		wyInterpolatedNode* in = (wyInterpolatedNode*)malloc(sizeof(wyInterpolatedNode));
+		in->node = node;
+		in->prevX = in->x = node->getPositionX();
+		in->prevY = in->y = node->getPositionY();
+		in->prevRotation = in->rotation = node->getRotation();
+		node->retain();
+		wyArrayPush(m_nodes, in);
+	}
+
+	/**
+	 * \if English
+	 * Stop interpolating a node, it will be restored to simulated transform
+	 *
+	 * @param node node to be removed
+	 * \else
+	 * 停止对一个节点插值, 节点会被恢复为模拟位置
+	 *
+	 * @param node 需要删除的节点
+	 * \endif
+	 */
+	void removeInterpolatedNode(wyNode* node) {
+		restoreNodes();
+		for(int i = 0; i < m_nodes->num; i++) {
+			wyInterpolatedNode* in = (wyInterpolatedNode*)wyArrayGet(m_nodes, i);
+			if(in->node == node) {
+				wyArrayDeleteIndex(m_nodes, i);
+				node->release();
+				free(in);
+				break;
+			}
+		}
+	}
+
+	/**
+	 * \if English
+	 * Set max steps in one frame, the steps exceeding it will be dropped
+	 *
+	 * @param max max steps in one frame
+	 * \else
+	 * 设置每帧最多执行的步数, 超出的步数会被丢弃
+	 *
+	 * @param max 每帧最多执行的步数
+	 * \endif
+	 */
+	void setMaxSteps(int max) { m_maxSteps = MAX(1, max); }
+
+	/// 得到每帧最多执行的步数
+	int getMaxSteps() { return m_maxSteps; }
+
+	/**
+	 * \if English
+	 * Set lockstep mode, in which every frame runs exactly one step
+	 *
+	 * @param flag true means lockstep mode
+	 * \else
+	 * 设置锁步模式, 锁步模式下每帧只执行一步
+	 *
+	 * @param flag true表示锁步模式
+	 * \endif
+	 */
+	void setLockstep(bool flag) { m_lockstep = flag; }
+
+	/// 是否是锁步模式
+	bool isLockstep() { return m_lockstep; }
+
+	/// 得到固定步长
+	float getStep() { return m_step; }
+
+	/// 得到当前插值系数
+	float getAlpha() { return m_alpha; }
+
+	/// 得到已经执行的总步数
+	int getStepCount() { return m_stepCount; }
+
+	/// 得到被丢弃的步数
+	int getDroppedSteps() { return m_droppedSteps; }
+};
+
+#endif // __wyFixedStepTimer_h__
@@ -0,0 +1,551 @@
+/*
+ * Copyright (c) 2010 WiYun Inc.
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __wyMultiSpriteBatchNode_h__
+#define __wyMultiSpriteBatchNode_h__
+
+#if ANDROID
+	#include <GLES/gl.h>
+#elif IOS
+	#import <OpenGLES/ES1/gl.h>
+	#import <OpenGLES/ES1/glext.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include "wyNode.h"
+#include "wySpriteEx.h"
+#include "wyTextureAtlas.h"
+#include "wyAtlasVBO.h"
+#include "wyGLState.h"
+#include "wyTintStage.h"
+#include "wyAffineTransform.h"
+#include "wyBlendFunc.h"
+#include "wyLog.h"
+
+/// 一个\link wyMultiSpriteBatchNode wyMultiSpriteBatchNode\endlink最多能引用的贴图数
+#define WY_MULTI_BATCH_MAX_TEXTURES 8
+
+/**
+ * @class wyMultiSpriteBatchNode
+ *
+ * \if English
+ * Batch node whose \link wySpriteEx wySpriteEx\endlink children may come from up to
+ * \c WY_MULTI_BATCH_MAX_TEXTURES different textures. \link wySpriteBatchNode wySpriteBatchNode\endlink
+ * requires all children to share the texture of its atlas, so a scene mixing sheets needs several batch
+ * nodes and loses z order between them. This node keeps children in z order in one VBO and records
+ * texture slot of every quad.
+ *
+ * Fixed pipeline can't choose a texture per vertex, so drawing depends on how sheets are used:
+ * - one texture: one draw call
+ * - two textures, all children are white and opaque and no tint is active: one draw call, both
+ *   textures are bound to unit 0 and 1 and the alpha of vertex color selects between them by texture
+ *   combiner
+ * - otherwise: one draw call for each run of consecutive children using same texture, all quads are
+ *   uploaded once per frame
+ *
+ * Children are drawn by this node and their own children are ignored. Children are supposed to be
+ * \link wySpriteEx wySpriteEx\endlink, offset of trimmed zwoptex frames is not applied.
+ * \else
+ * 子节点\link wySpriteEx wySpriteEx\endlink可以来自最多\c WY_MULTI_BATCH_MAX_TEXTURES张不同贴图的批处理
+ * 节点. \link wySpriteBatchNode wySpriteBatchNode\endlink要求所有子节点共享atlas的贴图, 因此混合多张图片集的
+ * 场景需要多个batch节点, 并且它们之间失去了z顺序. 这个节点把子节点按z顺序放在一个VBO中, 并记录每个矩形的
+ * 贴图槽.
+ *
+ * 固定管线不能为每个顶点选择贴图, 因此绘制方式取决于贴图的使用情况:
+ * - 只有一张贴图: 一次绘制
+ * - 两张贴图, 所有子节点都是白色不透明并且没有激活的tint: 一次绘制, 两张贴图分别绑定到单元0和1, 由顶点颜色的alpha通过贴图
+ *   组合器在两者之间选择
+ * - 其它情况: 连续使用同一张贴图的子节点绘制一次, 所有矩形每帧只上传一次
+ *
+ * 子节点由这个节点绘制, 子节点自己的子节点被忽略. 子节点必须是\link wySpriteEx wySpriteEx\endlink, 不支持
+ * 裁剪过的zwoptex帧的偏移.
+ * \endif
+ */
+class wyMultiSpriteBatchNode : public wyNode {
+private:
+	/// 存放所有子节点矩形的atlas, 它的贴图是第一张贴图
+	wyTextureAtlas* m_atlas;
+
+	/// atlas的VBO镜像
+	wyAtlasVBO* m_vbo;
+
+	/// 引用的贴图, 下标是贴图槽
+	wyTexture2D* m_textures[WY_MULTI_BATCH_MAX_TEXTURES];
+
+	/// 引用的贴图数
+	int m_textureCount;
+
+	/// 每个矩形的贴图槽
+	unsigned char* m_slots;
+
+	/// \c m_slots能容纳的矩形数
+	int m_slotCapacity;
+
+	/// 渲染模式
+	wyBlendFunc m_blendFunc;
+
+	/// 整个节点的tint, 通过\link wyTintStage wyTintStage\endlink实现, 不改写顶点颜色
+	wyColor4B m_color;
+
+	/// 是否打开alpha blending, 缺省是打开的
+	bool m_blend;
+
+	/// 是否允许两张贴图时使用贴图组合器一次绘制, 缺省是允许的
+	bool m_interpolate;
+
+	/// 上一帧的绘制次数
+	int m_drawCalls;
+
+private:
+	/**
+	 * 释放前\c count个矩形都没有使用的贴图槽, 槽0是atlas的贴图, 不会被释放
+	 *
+	 * @param count 已经写入的矩形数, 之后的矩形会重新获得槽
+	 */
+	void releaseUnusedSlots(int count) {
+		bool used[WY_MULTI_BATCH_MAX_TEXTURES] = { false };
+		for(int i = 0; i < count; i++)
+			used[m_slots[i]] = true;
+		for(int i = 1; i < m_textureCount; i++) {
+			if(m_textures[i] != NULL && !used[i]) {
+				wyObjectRelease(m_textures[i]);
+				m_textures[i] = NULL;
+			}
+		}
+		while(m_textureCount > 1 && m_textures[m_textureCount - 1] == NULL)
+			m_textureCount--;
+	}
+
+	/**
+	 * 获得贴图槽, 新贴图会被retain并分配一个空闲槽. 槽已满时先释放前\c count个矩形没有使用的槽,
+	 * 仍然没有空闲槽则返回-1
+	 */
+	int slotOf(wyTexture2D* tex, int count) {
+		for(int i = 0; i < m_textureCount; i++) {
+			if(m_textures[i] == tex)
+				return i;
+		}
+		if(m_textureCount >= WY_MULTI_BATCH_MAX_TEXTURES)
+			releaseUnusedSlots(count);
+
+		int slot = -1;
+		for(int i = 0; i < m_textureCount; i++) {
+			if(m_textures[i] == NULL) {
+				slot = i;
+				break;
+			}
+		}
+		if(slot == -1) {
+			if(m_textureCount >= WY_MULTI_BATCH_MAX_TEXTURES) {
+				LOGW("wyMultiSpriteBatchNode: too many textures, sprite is skipped");
+				return -1;
+			}
+			slot = m_textureCount++;
+		}
+		wyObjectRetain(tex);
+		m_textures[slot] = tex;
+		return slot;
+	}
+
+	/// 确保atlas和槽数组能容纳指定数目的矩形
+	void ensureCapacity(int count) {
+		if(m_atlas->getCapacity() < count)
+			m_atlas->resizeCapacity(count);
+		if(m_slotCapacity < count) {
+			m_slots = (unsigned char*)realloc(m_slots, count * sizeof(unsigned char));
+			m_slotCapacity = count;
+		}
+	}
+
+	/// 把一个sprite写入atlas的指定矩形, 只有改变时才标记给VBO
+	void writeQuad(wySpriteEx* sprite, wyTexture2D* tex, int index) {
+		// vertices, node space to batch space
+		wyAffineTransform t = sprite->getTransformMatrix();
+		float w = sprite->getWidth();
+		float h = sprite->getHeight();
+		GLfloat v[12];
+		v[0] = t.tx;
+		v[1] = t.ty;
+		v[3] = w * t.a + t.tx;
+		v[4] = w * t.b + t.ty;
+		v[6] = h * t.c + t.tx;
+		v[7] = h * t.d + t.ty;
+		v[9] = w * t.a + h * t.c + t.tx;
+		v[10] = w * t.b + h * t.d + t.ty;
+		v[2] = v[5] = v[8] = v[11] = sprite->getVertexZ();
+
+		// texture coordinates, rect origin is left top
+		wyRect r = sprite->getTextureRect();
+		float texW = tex->getWidth();
+		float texH = tex->getHeight();
+		float left, right, top, bottom;
+		GLfloat c[8];
+		if(sprite->isRotatedZwoptex()) {
+			left = r.x / texW * tex->getWidthScale();
+			right = (r.x + r.height) / texW * tex->getWidthScale();
+			top = r.y / texH * tex->getHeightScale();
+			bottom = (r.y + r.width) / texH * tex->getHeightScale();
+			if(sprite->isFlipX()) {
+				float tmp = top;
+				top = bottom;
+				bottom = tmp;
+			}
+			if(sprite->isFlipY()) {
+				float tmp = left;
+				left = right;
+				right = tmp;
+			}
+			c[0] = left;
+			c[1] = top;
+			c[2] = left;
+			c[3] = bottom;
+			c[4] = right;
+			c[5] = top;
+			c[6] = right;
+			c[7] = bottom;
+		} else {
+			left = r.x / texW * tex->getWidthScale();
+			right = (r.x + r.width) / texW * tex->getWidthScale();
+			top = r.y / texH * tex->getHeightScale();
+			bottom = (r.y + r.height) / texH * tex->getHeightScale();
+			if(sprite->isFlipX()) {
+				float tmp = left;
+				left = right;
+				right = tmp;
+			}
+			if(sprite->isFlipY()) {
+				float tmp = top;
+				top = bottom;
+				bottom = tmp;
+			}
+			c[0] = left;
+			c[1] = bottom;
+			c[2] = right;
+			c[3] = bottom;
+			c[4] = left;
+			c[5] = top;
+			c[6] = right;
+			c[7] = top;
+		}
+
+		GLfloat* dv = wyTextureAtlasAccessor::vertices(m_atlas) + index * 12;
+		GLfloat* dc = wyTextureAtlasAccessor::texCoords(m_atlas) + index * 8;
+		if(memcmp(dv, v, sizeof(v)) != 0 || memcmp(dc, c, sizeof(c)) != 0) {
+			memcpy(dv, v, sizeof(v));
+			memcpy(dc, c, sizeof(c));
+			m_vbo->markDirty(index, 1);
+		}
+	}
+
+	/// 写入矩形颜色, 只有改变时才标记给VBO
+	void writeColor(int index, GLubyte r, GLubyte g, GLubyte b, GLubyte a) {
+		GLubyte color[16];
+		for(int i = 0; i < 4; i++) {
+			color[i * 4] = r;
+			color[i * 4 + 1] = g;
+			color[i * 4 + 2] = b;
+			color[i * 4 + 3] = a;
+		}
+		GLubyte* dst = wyTextureAtlasAccessor::colors(m_atlas) + index * 16;
+		if(memcmp(dst, color, sizeof(color)) != 0) {
+			memcpy(dst, color, sizeof(color));
+			m_vbo->markDirty(index, 1);
+		}
+	}
+
+	/// 两张贴图一次绘制, 单元1用顶点alpha在单元0和单元1的贴图之间插值
+	void drawInterpolated(int count) {
+		wyGLState* gl = wyGLState::getInstance();
+		gl->activeTexture(GL_TEXTURE0);
+		gl->bindTexture(m_textures[0]->getTexture());
+		glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+
+		gl->activeTexture(GL_TEXTURE1);
+		gl->enable(GL_TEXTURE_2D);
+		gl->bindTexture(m_textures[1]->getTexture());
+		glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE);
+		glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_RGB, GL_INTERPOLATE);
+		glTexEnvi(GL_TEXTURE_ENV, GL_SRC0_RGB, GL_TEXTURE);
+		glTexEnvi(GL_TEXTURE_ENV, GL_OPERAND0_RGB, GL_SRC_COLOR);
+		glTexEnvi(GL_TEXTURE_ENV, GL_SRC1_RGB, GL_PREVIOUS);
+		glTexEnvi(GL_TEXTURE_ENV, GL_OPERAND1_RGB, GL_SRC_COLOR);
+		glTexEnvi(GL_TEXTURE_ENV, GL_SRC2_RGB, GL_PRIMARY_COLOR);
+		glTexEnvi(GL_TEXTURE_ENV, GL_OPERAND2_RGB, GL_SRC_ALPHA);
+		glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_ALPHA, GL_INTERPOLATE);
+		glTexEnvi(GL_TEXTURE_ENV, GL_SRC0_ALPHA, GL_TEXTURE);
+		glTexEnvi(GL_TEXTURE_ENV, GL_OPERAND0_ALPHA, GL_SRC_ALPHA);
+		glTexEnvi(GL_TEXTURE_ENV, GL_SRC1_ALPHA, GL_PREVIOUS);
+		glTexEnvi(GL_TEXTURE_ENV, GL_OPERAND1_ALPHA, GL_SRC_ALPHA);
+		glTexEnvi(GL_TEXTURE_ENV, GL_SRC2_ALPHA, GL_PRIMARY_COLOR);
+		glTexEnvi(GL_TEXTURE_ENV, GL_OPERAND2_ALPHA, GL_SRC_ALPHA);
+
+		m_vbo->drawUploaded(0, count, false, 2);
+		m_drawCalls++;
+
+		// restore default texture environment of both units, other states are restored by cache
+		gl->activeTexture(GL_TEXTURE1);
+		glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+		gl->activeTexture(GL_TEXTURE0);
+		glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+	}
+
+	/// 每段连续使用同一贴图的矩形绘制一次
+	void drawRuns(int count) {
+		wyGLState* gl = wyGLState::getInstance();
+		int start = 0;
+		while(start < count) {
+			int slot = m_slots[start];
+			int end = start + 1;
+			while(end < count && m_slots[end] == slot)
+				end++;
+			gl->bindTexture(m_textures[slot]->getTexture());
+			m_vbo->drawUploaded(start, end - start, false);
+			m_drawCalls++;
+			start = end;
+		}
+	}
+
+protected:
+	/**
+	 * 构造函数
+	 *
+	 * @param tex 第一张贴图, 占用贴图槽0
+	 * @param capacity 初始能容纳的矩形数
+	 */
+	wyMultiSpriteBatchNode(wyTexture2D* tex, int capacity) :
+			m_textureCount(0),
+			m_slots(NULL),
+			m_slotCapacity(0),
+			m_blendFunc(wybfDefault),
+			m_color(wyc4bWhite),
+			m_blend(true),
+			m_interpolate(true),
+			m_drawCalls(0) {
+		memset(m_textures, 0, sizeof(m_textures));
+		m_atlas = new wyTextureAtlas(tex, capacity);
+		m_atlas->setColor(wyc4bWhite);
+		m_vbo = wyAtlasVBO::make(m_atlas, ATLAS_VBO_ORPHAN, ATLAS_VERTEX_COMPACT_2D);
+		wyObjectRetain(m_vbo);
+		slotOf(tex, 0);
+		ensureCapacity(capacity);
+	}
+
+public:
+	/**
+	 * \if English
+	 * Create a multi texture batch node
+	 *
+	 * @param tex first texture, it takes slot 0. Other textures take slots when sprites using them
+	 * 		are drawn first time, or when \c addTexture is called
+	 * @param capacity initial quad capacity, it grows when needed
+	 * \else
+	 * 创建一个多贴图批处理节点
+	 *
+	 * @param tex 第一张贴图, 占用槽0. 其它贴图在使用它们的sprite第一次被绘制时, 或者调用\c addTexture时
+	 * 		占用一个槽
+	 * @param capacity 初始能容纳的矩形数, 需要时会自动增长
+	 * \endif
+	 */
+	static wyMultiSpriteBatchNode* make(wyTexture2D* tex, int capacity = ATLAS_DEFAULT_CAPACITY) {
+		wyMultiSpriteBatchNode* n = new wyMultiSpriteBatchNode(tex, capacity);
+		return (wyMultiSpriteBatchNode*)n->autoRelease();
+	}
+
+	virtual ~wyMultiSpriteBatchNode() {
+		for(int i = 0; i < m_textureCount; i++) {
+			if(m_textures[i] != NULL)
+				wyObjectRelease(m_textures[i]);
+		}
+		if(m_slots)
+			free(m_slots);
+		wyObjectRelease(m_vbo);
+		wyObjectRelease(m_atlas);
+	}
+
+	/**
+	 * \if English
+	 * Reserve a slot for a texture, slot 1 is the second texture of single draw path. Slots which no
+	 * child uses at end of a frame are freed
+	 *
+	 * @param tex texture
+	 * @return slot of texture, or -1 if all slots are taken
+	 * \else
+	 * 为贴图预留一个槽, 槽1是一次绘制方式的第二张贴图. 一帧结束时没有子节点使用的槽会被释放
+	 *
+	 * @param tex 贴图
+	 * @return 贴图的槽, 如果槽已满返回-1
+	 * \endif
+	 */
+	int addTexture(wyTexture2D* tex) { return slotOf(tex, m_atlas->getTotalQuads()); }
+
+	/// 得到引用的贴图数
+	int getTextureCount() {
+		int n = 0;
+		for(int i = 0; i < m_textureCount; i++) {
+			if(m_textures[i] != NULL)
+				n++;
+		}
+		return n;
+	}
+
+	/// @see wyNode::getTexture
+	virtual wyTexture2D* getTexture() { return m_textures[0]; }
+
+	/// @see wyNode::getBlendFunc
+	virtual wyBlendFunc getBlendFunc() { return m_blendFunc; }
+
+	/// @see wyNode::setBlendFunc
+	virtual void setBlendFunc(wyBlendFunc func) { m_blendFunc = func; }
+
+	/// @see wyNode::getAlpha
+	virtual int getAlpha() { return m_color.a; }
+
+	/// @see wyNode::setAlpha
+	virtual void setAlpha(int alpha) { m_color.a = alpha; }
+
+	/// @see wyNode::getColor
+	virtual wyColor3B getColor() {
+		wyColor3B c = { m_color.r, m_color.g, m_color.b };
+		return c;
+	}
+
+	/// @see wyNode::setColor
+	virtual void setColor(wyColor3B color) {
+		m_color.r = color.r;
+		m_color.g = color.g;
+		m_color.b = color.b;
+	}
+
+	/// @see wyNode::setColor
+	virtual void setColor(wyColor4B color) { m_color = color; }
+
+	/// 是否进行alpha渲染
+	bool isBlend() { return m_blend; }
+
+	/// 设置是否打开alpha渲染, 对于不透明的图片, 可以考虑关闭blend以提升性能
+	void setBlend(bool flag) { m_blend = flag; }
+
+	/// 设置是否允许两张贴图时通过贴图组合器一次绘制
+	void setInterpolate(bool flag) { m_interpolate = flag; }
+
+	/// 得到上一帧的绘制次数
+	int getLastDrawCalls() { return m_drawCalls; }
+
+	/// 得到atlas的VBO镜像
+	wyAtlasVBO* getVBO() { return m_vbo; }
+
+	/// @see wyNode::visit
+	virtual void visit() {
+		if(!m_visible)
+			return;
+
+		glPushMatrix();
+		transform();
+		draw();
+		glPopMatrix();
+	}
+
+	/// @see wyNode::draw
+	virtual void draw() {
+		m_drawCalls = 0;
+		int childCount = m_children->num;
+		if(childCount > WY_ATLAS_VBO_MAX_QUADS)
+			childCount = WY_ATLAS_VBO_MAX_QUADS;
+		ensureCapacity(childCount);
+
+		// write visible children in z order, remember whether single draw is possible
+		int count = 0;
+		bool plain = true;
+		for(int i = 0; i < childCount; i++) {
+			wySpriteEx* sprite = (wySpriteEx*)m_children->arr[i];
+			if(!sprite->isVisible())
+				continue;
+			wyTexture2D* tex = sprite->getTexture();
+			if(tex == NULL)
+				continue;
+			int slot = slotOf(tex, count);
+			if(slot < 0)
+				continue;
+
+			writeQuad(sprite, tex, count);
+			wyColor3B c = sprite->getColor();
+			GLubyte a = sprite->getAlpha();
+			writeColor(count, c.r, c.g, c.b, a);
+			if(c.r != 255 || c.g != 255 || c.b != 255 || a != 255)
+				plain = false;
+			m_slots[count++] = slot;
+		}
+		wyTextureAtlasAccessor::totalQuads(m_atlas) = count;
+		releaseUnusedSlots(count);
+		if(count == 0)
+			return;
+
+		// find used slots
+		int firstSlot = m_slots[0];
+		int otherSlot = -1;
+		bool single = true;
+		for(int i = 1; i < count; i++) {
+			if(m_slots[i] != firstSlot) {
+				if(otherSlot == -1)
+					otherSlot = m_slots[i];
+				else if(m_slots[i] != otherSlot)
+					single = false;
+			}
+		}
+		// tint of node or of an outer wyTintNode takes texture unit 1, so it can't be combined with single draw path
+		bool tinted = m_color.r != 255 || m_color.g != 255 || m_color.b != 255 || m_color.a != 255;
+		bool interpolate = !tinted && !wyTintStage::getInstance()->isActive() && m_interpolate && single && plain
+				&& otherSlot != -1 && firstSlot + otherSlot == 1;
+		if(interpolate) {
+			// vertex alpha becomes texture selector
+			for(int i = 0; i < count; i++)
+				writeColor(i, 255, 255, 255, m_slots[i] ? 255 : 0);
+		}
+
+		// all draws share one cached range, blend and arrays are set once and restored at end
+		wyGLState* gl = wyGLState::getInstance();
+		gl->begin();
+		if(m_blend) {
+			gl->enable(GL_BLEND);
+			gl->blendFunc(m_blendFunc.src, m_blendFunc.dst);
+		} else {
+			gl->disable(GL_BLEND);
+		}
+
+		// engine turns texturing off between draws
+		gl->activeTexture(GL_TEXTURE0);
+		gl->enable(GL_TEXTURE_2D);
+		m_vbo->sync();
+		if(interpolate) {
+			drawInterpolated(count);
+		} else {
+			wyTintStage* stage = wyTintStage::getInstance();
+			if(tinted)
+				stage->begin(m_color);
+			drawRuns(count);
+			if(tinted)
+				stage->end();
+		}
+		gl->end();
+	}
+};
+
+#endif // __wyMultiSpriteBatchNode_h__
@@ -0,0 +1,532 @@
+/*
+ * Copyright (c) 2010 WiYun Inc.
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __wyRenderSnapshot_h__
+#define __wyRenderSnapshot_h__
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "wyObject.h"
+#include "wyNode.h"
+#include "wyTexture2D.h"
+#include "wyScheduler.h"
+#include "wyTargetSelector.h"
+#include "wyThread.h"
+#include "wyUtils.h"
+#include "wyRunnable.h"
+#include "wyGLTaskQueue.h"
+
+/**
+ * @struct wyNodeRenderState
+ *
+ * \if English
+ * Render state of a node, written by update thread and applied to node by GL thread
+ * \else
+ * 节点的渲染状态, 由更新线程写入, 由OpenGL线程设置给节点
+ * \endif
+ */
+typedef struct wyNodeRenderState {
+	/// 节点
+	wyNode* node;
+
+	/// x位置
+	float x;
+
+	/// y位置
+	float y;
+
+	/// 旋转角度
+	float rotation;
+
+	/// x方向缩放
+	float scaleX;
+
+	/// y方向缩放
+	float scaleY;
+
+	/// 颜色
+	wyColor3B color;
+
+	/// 透明度
+	int alpha;
+
+	/// 是否可见
+	bool visible;
+
+	/// 贴图, 为NULL表示不修改节点的贴图. 快照不持有贴图的引用, 调用者要保证贴图在应用前有效
+	wyTexture2D* texture;
+} wyNodeRenderState;
+
+/**
+ * @class wyRenderSnapshot
+ *
+ * \if English
+ * Buffered render state of a set of nodes, so game update can run on its own thread
+ * while GL thread renders. Update thread only writes states returned by \c edit and
+ * calls \c publish at the end of an update; GL thread calls \c apply before drawing,
+ * which copies the latest published states to nodes. States are triple buffered and
+ * the lock is held only while swapping buffer pointers, so neither side waits for the
+ * other to finish a frame.
+ * \else
+ * 一组节点的缓冲渲染状态, 使游戏更新可以在单独的线程中运行, 同时OpenGL线程进行渲染.
+ * 更新线程只修改\c edit返回的状态, 并在一次更新结束时调用\c publish; OpenGL线程在绘制
+ * 之前调用\c apply, 把最新发布的状态设置给节点. 状态使用三重缓冲, 锁只在交换缓冲区指针时
+ * 持有, 因此双方都不需要等待对方完成一帧.
+ * \endif
+ */
+class wyRenderSnapshot : public wyObject {
+protected:
+	/// 更新线程写入的缓冲区
+	wyNodeRenderState* m_back;
+
+	/// 已发布但尚未被应用的缓冲区
+	wyNodeRenderState* m_pending;
+
+	/// OpenGL线程正在使用的缓冲区
+	wyNodeRenderState* m_front;
+
+	/// 节点数
+	int m_count;
+
+	/// 缓冲区容量
+	int m_capacity;
+
+	/// true表示有新发布的状态
+	bool m_dirty;
+
+	/// 发布序号, 每次publish加1
+	int m_publishCount;
+
+	/// 应用序号, 每次apply新状态加1
+	int m_applyCount;
+
+	/// 保护缓冲区交换的锁
+	pthread_mutex_t m_mutex;
+
+	/// 用于每帧自动apply的定时器
+	wyTimer* m_timer;
+
+protected:
+	void ensureCapacity(int capacity) {
+		if(capacity <= m_capacity)
+			return;
+
+		m_capacity = MAX(capacity, m_capacity * 2);
+		m_back = (wyNodeRenderState*)realloc(m_back, m_capacity * sizeof(wyNodeRenderState));
+		m_pending = (wyNodeRenderState*)realloc(m_pending, m_capacity * sizeof(wyNodeRenderState));
+		m_front = (wyNodeRenderState*)realloc(m_front, m_capacity * sizeof(wyNodeRenderState));
+	}
+
+	static void capture(wyNodeRenderState* s, wyNode* node) {
+		s->node = node;
+		s->x = node->getPositionX();
+		s->y = node->getPositionY();
+		s->rotation = node->getRotation();
+		s->scaleX = node->getScaleX();
+		s->scaleY = node->getScaleY();
+		s->color = node->getColor();
+		s->alpha = node->getAlpha();
+		s->visible = node->isVisible();
+		s->texture = NULL;
+	}
+
+public:
+	static wyRenderSnapshot* make() {
+		wyRenderSnapshot* s = new wyRenderSnapshot();
+		return (wyRenderSnapshot*)s->autoRelease();
+	}
+
+	wyRenderSnapshot() :
+			m_back(NULL),
+			m_pending(NULL),
+			m_front(NULL),
+			m_count(0),
+			m_capacity(0),
+			m_dirty(false),
+			m_publishCount(0),
+			m_applyCount(0),
+			m_timer(NULL) {
+		pthread_mutex_init(&m_mutex, NULL);
+		ensureCapacity(16);
+	}
+
+	virtual ~wyRenderSnapshot() {
+		stop();
+		for(int i = 0; i < m_count; i++)
+			m_front[i].node->release();
+		free(m_back);
+		free(m_pending);
+		free(m_front);
+		pthread_mutex_destroy(&m_mutex);
+	}
+
+	/// @see wyObject::onTargetSelectorInvoked
+	virtual void onTargetSelectorInvoked(wyTargetSelector* ts) {
+		apply();
+	}
+
+	/**
+	 * \if English
+	 * Add a node whose render state is managed by snapshot, must be called on GL thread
+	 * and before update thread starts. Node is retained.
+	 *
+	 * @param node node
+	 * @return index of node, can be passed to \c edit
+	 * \else
+	 * 添加一个由快照管理渲染状态的节点, 必须在OpenGL线程中并且在更新线程启动前调用. 节点
+	 * 会被retain.
+	 *
+	 * @param node 节点
+	 * @return 节点的索引, 可以传给\c edit
+	 * \endif
+	 */
+	int addNode(wyNode* node) {
+		pthread_mutex_lock(&m_mutex);
+		ensureCapacity(m_count + 1);
+		capture(&m_back[m_count], node);
+		m_pending[m_count] = m_back[m_count];
+		m_front[m_count] = m_back[m_count];
+		node->retain();
+		int index = m_count++;
+		pthread_mutex_unlock(&m_mutex);
+		return index;
+	}
+
+	/**
+	 * \if English
+	 * Get writable render state of a node, only for update thread
+	 *
+	 * @param index index returned by \c addNode
+	 * @return render state in back buffer
+	 * \else
+	 * 得到节点可写的渲染状态, 只能在更新线程中调用
+	 *
+	 * @param index \c addNode返回的索引
+	 * @return 后台缓冲区中的渲染状态
+	 * \endif
+	 */
+	wyNodeRenderState* edit(int index) { return &m_back[index]; }
+
+	/**
+	 * \if English
+	 * Publish back buffer at the end of an update, called by update thread
+	 * \else
+	 * 在一次更新结束时发布后台缓冲区, 由更新线程调用
+	 * \endif
+	 */
+	void publish() {
+		wyNodeRenderState* published = m_back;
+		pthread_mutex_lock(&m_mutex);
+		m_back = m_pending;
+		m_pending = published;
+		m_dirty = true;
+		m_publishCount++;
+		pthread_mutex_unlock(&m_mutex);
+
+		// new back buffer continues from latest published states, only update thread writes them
+		memcpy(m_back, published, m_count * sizeof(wyNodeRenderState));
+	}
+
+	/**
+	 * \if English
+	 * Apply latest published states to nodes, called by GL thread before drawing.
+	 * Nothing happens if no new state is published since last apply.
+	 * \else
+	 * 把最新发布的状态设置给节点, 由OpenGL线程在绘制前调用. 如果上次apply之后没有
+	 * 新发布的状态, 则什么也不做.
+	 * \endif
+	 */
+	void apply() {
+		pthread_mutex_lock(&m_mutex);
+		if(!m_dirty) {
+			pthread_mutex_unlock(&m_mutex);
+			return;
+		}
+		wyNodeRenderState* tmp = m_front;
+		m_front = m_pending;
+		m_pending = tmp;
+		m_dirty = false;
+		m_applyCount++;
+		pthread_mutex_unlock(&m_mutex);
+
+		for(int i = 0; i < m_count; i++) {
+			wyNodeRenderState* s = &m_front[i];
+			wyNode* node = s->node;
+			node->setPosition(s->x, s->y);
+			node->setRotation(s->rotation);
+			node->setScaleX(s->scaleX);
+			node->setScaleY(s->scaleY);
+			node->setColor(s->color);
+			node->setAlpha(s->alpha);
+			node->setVisible(s->visible);
+			if(s->texture != NULL && s->texture != node->getTexture())
+				node->setTexture(s->texture);
+		}
+	}
+
+	/**
+	 * \if English
+	 * Apply states automatically in every frame of scheduler
+	 * \else
+	 * 在调度器的每一帧自动apply
+	 * \endif
+	 */
+	void start() {
+		if(m_timer)
+			return;
+
+		m_timer = wyTimer::make(wyTargetSelector::make(this, 0, NULL));
+		m_timer->retain();
+		wyScheduler::getInstance()->scheduleLocked(m_timer);
+	}
+
+	/**
+	 * \if English
+	 * Stop applying states automatically
+	 * \else
+	 * 停止自动apply
+	 * \endif
+	 */
+	void stop() {
+		if(!m_timer)
+			return;
+
+		wyScheduler::getInstance()->unscheduleLocked(m_timer);
+		m_timer->release();
+		m_timer = NULL;
+	}
+
+	/// 得到节点数
+	int getNodeCount() { return m_count; }
+
+	/// 得到发布次数
+	int getPublishCount() { return m_publishCount; }
+
+	/// 得到应用次数, 和发布次数的差值表示被OpenGL线程跳过的更新
+	int getApplyCount() { return m_applyCount; }
+};
+
+/**
+ * @struct wyUpdateThreadCallback
+ *
+ * \if English
+ * Callback of \link wyUpdateThread wyUpdateThread\endlink
+ * \else
+ * \link wyUpdateThread wyUpdateThread\endlink的回调函数结构定义
+ * \endif
+ */
+typedef struct wyUpdateThreadCallback {
+	/**
+	 * \if English
+	 * Invoked on update thread, game logic should write render state to snapshot here
+	 * and must not touch GL or node tree directly
+	 *
+	 * @param delta time since last update in second
+	 * @param snapshot render snapshot
+	 * @param data user data pointer
+	 * \else
+	 * 在更新线程中调用, 游戏逻辑应该在这里把渲染状态写入快照, 不能直接调用OpenGL或修改节点树
+	 *
+	 * @param delta 距离上次更新的时间, 单位秒
+	 * @param snapshot 渲染快照
+	 * @param data 附加数据指针
+	 * \endif
+	 */
+	void (*onUpdate)(float delta, wyRenderSnapshot* snapshot, void* data);
+} wyUpdateThreadCallback;
+
+/**
+ * @class wyUpdateThreadExit
+ *
+ * 持有更新线程在运行期间的引用. 它在OpenGL线程中创建, 线程退出时交给\link wyGLTaskQueue wyGLTaskQueue\endlink,
+ * 因此最后的release和可能的析构总是在OpenGL线程中发生
+ */
+class wyUpdateThreadExit : public wyRunnable {
+private:
+	/// 更新线程
+	wyObject* m_thread;
+
+public:
+	wyUpdateThreadExit(wyObject* thread) : m_thread(thread) {
+		m_thread->retain();
+	}
+
+	virtual ~wyUpdateThreadExit() {
+		m_thread->release();
+	}
+
+	virtual void run() {
+	}
+};
+
+/**
+ * @class wyUpdateThread
+ *
+ * \if English
+ * Run game update on its own thread at a fixed rate, publishing a
+ * \link wyRenderSnapshot wyRenderSnapshot\endlink after every update. On multi-core devices
+ * CPU update overlaps with GL submission.
+ * \else
+ * 在单独的线程中以固定频率运行游戏更新, 每次更新后发布一个\link wyRenderSnapshot wyRenderSnapshot\endlink.
+ * 在多核设备上, CPU更新和OpenGL提交可以并行.
+ * \endif
+ */
+class wyUpdateThread : public wyObject {
+protected:
+	/// 渲染快照
+	wyRenderSnapshot* m_snapshot;
+
+	/// 回调
+	wyUpdateThreadCallback m_callback;
+
+	/// 回调附加数据
+	void* m_data;
+
+	/// 更新间隔, 单位秒
+	float m_interval;
+
+	/// true表示线程正在运行
+	volatile bool m_running;
+
+	/// true表示线程已经退出
+	volatile bool m_exited;
+
+	/// 线程退出时交给OpenGL线程的任务, 持有线程运行期间的引用
+	wyUpdateThreadExit* m_exit;
+
+protected:
+	static void threadEntry(void* arg) {
+		wyUpdateThread* t = (wyUpdateThread*)arg;
+		t->loop();
+	}
+
+	void loop() {
+		int64_t last = wyUtils::currentTimeMillis();
+		int intervalMs = MAX(1, (int)(m_interval * 1000));
+		while(m_running) {
+			int64_t now = wyUtils::currentTimeMillis();
+			if(m_callback.onUpdate)
+				m_callback.onUpdate((now - last) / 1000.f, m_snapshot, m_data);
+			m_snapshot->publish();
+			last = now;
+
+			int64_t spent = wyUtils::currentTimeMillis() - now;
+			if(spent < intervalMs)
+				usleep((useconds_t)((intervalMs - spent) * 1000));
+		}
+		// refcount is not atomic, reference of thread is dropped in GL thread
+		wyUpdateThreadExit* exit = m_exit;
+		m_exit = NULL;
+		m_exited = true;
+		wyGLTaskQueue::getInstance()->postLocked(exit);
+	}
+
+public:
+	/**
+	 * \if English
+	 * Static factory method
+	 *
+	 * @param snapshot render snapshot to be published
+	 * @param callback \link wyUpdateThreadCallback wyUpdateThreadCallback\endlink, it will be copied
+	 * @param data user data pointer
+	 * @param interval update interval in second
+	 * \else
+	 * 静态构造方法
+	 *
+	 * @param snapshot 需要发布的渲染快照
+	 * @param callback \link wyUpdateThreadCallback wyUpdateThreadCallback\endlink, 内容会被复制
+	 * @param data 附加数据指针
+	 * @param interval 更新间隔, 单位秒
+	 * \endif
+	 */
+	static wyUpdateThread* make(wyRenderSnapshot* snapshot, wyUpdateThreadCallback* callback, void* data, float interval) {
+		wyUpdateThread* t = new wyUpdateThread(snapshot, callback, data, interval);
+		return (wyUpdateThread*)t->autoRelease();
+	}
+
+	wyUpdateThread(wyRenderSnapshot* snapshot, wyUpdateThreadCallback* callback, void* data, float interval) :
+			m_snapshot(snapshot),
+			m_data(data),
+			m_interval(interval),
+			m_running(false),
+			m_exited(true),
+			m_exit(NULL) {
+		m_snapshot->retain();
+		if(callback)
+			m_callback = *callback;
+		else
+			memset(&m_callback, 0, sizeof(wyUpdateThreadCallback));
+	}
+
+	virtual ~wyUpdateThread() {
+		m_snapshot->release();
+	}
+
+	/**
+	 * \if English
+	 * Start update thread, and start applying snapshot on GL thread
+	 * \else
+	 * 启动更新线程, 并开始在OpenGL线程中应用快照
+	 * \endif
+	 */
+	void start() {
+		if(m_running || !m_exited)
+			return;
+
+		m_running = true;
+		m_exited = false;
+		m_snapshot->start();
+
+		// thread holds a reference until loop exits, it is taken and dropped in GL thread
+		wyGLTaskQueue::getInstance();
+		m_exit = new wyUpdateThreadExit(this);
+		wyThreadCallback cb = { threadEntry, this };
+		if(wyThread::runThread(&cb) != 0) {
+			m_running = false;
+			m_exited = true;
+			wyUpdateThreadExit* exit = m_exit;
+			m_exit = NULL;
+			exit->release();
+		}
+	}
+
+	/**
+	 * \if English
+	 * Request update thread to stop, it exits after current update
+	 * \else
+	 * 请求更新线程停止, 线程会在当前更新完成后退出
+	 * \endif
+	 */
+	void stop() {
+		m_running = false;
+		m_snapshot->stop();
+	}
+
+	/// 线程是否正在运行
+	bool isRunning() { return m_running; }
+
+	/// 得到渲染快照
+	wyRenderSnapshot* getSnapshot() { return m_snapshot; }
+};
+
+#endif // __wyRenderSnapshot_h__
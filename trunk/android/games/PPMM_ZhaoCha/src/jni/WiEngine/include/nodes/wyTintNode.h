@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2010 WiYun Inc.
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __wyTintNode_h__
+#define __wyTintNode_h__
+
+#include "wyNode.h"
+#include "wyTypes.h"
+#include "wyTintStage.h"
+
+/**
+ * @class wyTintNode
+ *
+ * \if English
+ * Container node which tints and fades its whole subtree by \link wyTintStage wyTintStage\endlink.
+ * Put an atlas label, tile map or particle system under it and run \link wyFadeTo wyFadeTo\endlink or
+ * \link wyTintTo wyTintTo\endlink on this node, each frame costs the same no matter how many quads
+ * children have, instead of rewriting color of every quad.
+ * \else
+ * 通过\link wyTintStage wyTintStage\endlink给整个子树着色和渐变的容器节点. 把atlas标签, 地图或者粒子系统放在
+ * 它下面, 然后在这个节点上执行\link wyFadeTo wyFadeTo\endlink或者\link wyTintTo wyTintTo\endlink, 每帧的开销
+ * 和子节点有多少矩形无关, 不需要改写每个矩形的颜色.
+ * \endif
+ */
+class wyTintNode : public wyNode {
+private:
+	/// tint颜色
+	wyColor4B m_color;
+
+protected:
+	wyTintNode() {
+		m_color = wyc4bWhite;
+	}
+
+public:
+	/**
+	 * 静态构造函数
+	 */
+	static wyTintNode* make() {
+		wyTintNode* n = new wyTintNode();
+		return (wyTintNode*)n->autoRelease();
+	}
+
+	virtual ~wyTintNode() {
+	}
+
+	/// @see wyNode::visit
+	virtual void visit() {
+		if(!m_visible)
+			return;
+
+		// plain white needs no stage, fully transparent needs no drawing
+		if(m_color.a == 0)
+			return;
+		if(m_color.r == 255 && m_color.g == 255 && m_color.b == 255 && m_color.a == 255) {
+			wyNode::visit();
+			return;
+		}
+
+		wyTintStage* stage = wyTintStage::getInstance();
+		stage->begin(m_color);
+		wyNode::visit();
+		stage->end();
+	}
+
+	/// @see wyNode::getAlpha
+	virtual int getAlpha() { return m_color.a; }
+
+	/// @see wyNode::setAlpha
+	virtual void setAlpha(int alpha) { m_color.a = alpha; }
+
+	/// @see wyNode::getColor
+	virtual wyColor3B getColor() {
+		wyColor3B c = { m_color.r, m_color.g, m_color.b };
+		return c;
+	}
+
+	/// @see wyNode::setColor
+	virtual void setColor(wyColor3B color) {
+		m_color.r = color.r;
+		m_color.g = color.g;
+		m_color.b = color.b;
+	}
+
+	/// @see wyNode::setColor
+	virtual void setColor(wyColor4B color) { m_color = color; }
+};
+
+#endif // __wyTintNode_h__
@@ -0,0 +1,559 @@
+/*
+ * Copyright (c) 2010 WiYun Inc.
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __wyAsyncTextureLoader_h__
+#define __wyAsyncTextureLoader_h__
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "wyObject.h"
+#include "wyArray.h"
+#include "wyThread.h"
+#include "wyRunnable.h"
+#include "wyTexture2D.h"
+#include "wyNode.h"
+#include "wyDirector.h"
+#include "wyGlobal.h"
+#include "wyUtils.h"
+#include "wyImageScaler.h"
+#include "wyGLTaskQueue.h"
+#include "wyLog.h"
+
+/// 缺省的解码线程数
+#define WY_ASYNC_TEXTURE_DEFAULT_WORKERS 2
+
+class wyAsyncTexture;
+
+/**
+ * @enum wyAsyncTextureState
+ *
+ * 异步贴图的状态
+ */
+typedef enum {
+	/// 等待解码
+	AT_PENDING,
+
+	/// 正在解码
+	AT_DECODING,
+
+	/// 解码完成, 等待在OpenGL线程中上传
+	AT_UPLOADING,
+
+	/// 贴图已经可用
+	AT_READY,
+
+	/// 载入失败
+	AT_FAILED,
+
+	/// 已被取消
+	AT_CANCELLED
+} wyAsyncTextureState;
+
+/**
+ * @struct wyAsyncTextureCallback
+ *
+ * \if English
+ * Callback of \link wyAsyncTexture wyAsyncTexture\endlink, always invoked in OpenGL thread
+ * \else
+ * \link wyAsyncTexture wyAsyncTexture\endlink的回调, 总是在OpenGL线程中被调用
+ * \endif
+ */
+typedef struct wyAsyncTextureCallback {
+	/**
+	 * \if English
+	 * Invoked when texture is uploaded and ready to use
+	 *
+	 * @param at async texture
+	 * @param tex loaded texture
+	 * @param data user data
+	 * \else
+	 * 贴图上传完毕可以使用时被调用
+	 *
+	 * @param at 异步贴图
+	 * @param tex 载入的贴图
+	 * @param data 附加数据
+	 * \endif
+	 */
+	void (*onTextureLoaded)(wyAsyncTexture* at, wyTexture2D* tex, void* data);
+
+	/**
+	 * \if English
+	 * Invoked when image can't be decoded
+	 *
+	 * @param at async texture
+	 * @param data user data
+	 * \else
+	 * 图片无法解码时被调用
+	 *
+	 * @param at 异步贴图
+	 * @param data 附加数据
+	 * \endif
+	 */
+	void (*onTextureFailed)(wyAsyncTexture* at, void* data);
+} wyAsyncTextureCallback;
+
+/**
+ * @class wyAsyncTexture
+ *
+ * \if English
+ * Handle of a texture which is loaded by \link wyAsyncTextureLoader wyAsyncTextureLoader\endlink.
+ * The handle is usable immediately: \c getTexture returns placeholder until real texture is ready.
+ * Nodes added by \c addTarget are switched to real texture automatically when it is uploaded.
+ * \else
+ * 由\link wyAsyncTextureLoader wyAsyncTextureLoader\endlink载入的贴图句柄. 句柄可以立即使用:
+ * 在真实贴图准备好之前, \c getTexture返回占位贴图. 通过\c addTarget添加的节点会在贴图上传后
+ * 自动切换到真实贴图.
+ * \endif
+ */
+class wyAsyncTexture : public wyObject {
+	friend class wyAsyncTextureLoader;
+	friend class wyAsyncTextureUpload;
+
+protected:
+	/// 图片路径
+	const char* m_path;
+
+	/// true表示路径是文件系统路径, false表示是assets路径
+	bool m_isFile;
+
+	/// true表示是PNG图片, false表示是JPG图片
+	bool m_png;
+
+	/// 期望的贴图格式
+	wyTexturePixelFormat m_format;
+
+	/// 解码时的缩放比例, 由图片和屏幕的density决定
+	float m_scale;
+
+	/// 状态
+	volatile wyAsyncTextureState m_state;
+
+	/// 保护状态的锁, 取消和状态推进必须是原子的
+	pthread_mutex_t m_stateMutex;
+
+	/// 解码后的像素, RGBA8888格式
+	char* m_pixels;
+
+	/// 图片宽度
+	int m_width;
+
+	/// 图片高度
+	int m_height;
+
+	/// 占位贴图
+	wyTexture2D* m_placeholder;
+
+	/// 真实贴图
+	wyTexture2D* m_texture;
+
+	/// 贴图上传后需要切换贴图的节点
+	wyArray* m_targets;
+
+	/// 回调
+	wyAsyncTextureCallback m_callback;
+
+	/// 回调附加数据
+	void* m_data;
+
+protected:
+	wyAsyncTexture(const char* path, bool isFile, bool png, wyTexturePixelFormat format, float scale,
+			wyTexture2D* placeholder, wyAsyncTextureCallback* callback, void* data) :
+			m_path(wyUtils::copy(path)),
+			m_isFile(isFile),
+			m_png(png),
+			m_format(format),
+			m_scale(scale),
+			m_state(AT_PENDING),
+			m_pixels(NULL),
+			m_width(0),
+			m_height(0),
+			m_placeholder(placeholder),
+			m_texture(NULL),
+			m_targets(wyArrayNew(2)),
+			m_data(data) {
+		pthread_mutex_init(&m_stateMutex, NULL);
+		wyObjectRetain(m_placeholder);
+		if(callback)
+			m_callback = *callback;
+		else
+			memset(&m_callback, 0, sizeof(wyAsyncTextureCallback));
+	}
+
+	/// 如果没有被取消, 把状态推进到\c state, 返回是否推进
+	bool advance(wyAsyncTextureState state) {
+		pthread_mutex_lock(&m_stateMutex);
+		bool ok = m_state != AT_CANCELLED;
+		if(ok)
+			m_state = state;
+		pthread_mutex_unlock(&m_stateMutex);
+		return ok;
+	}
+
+	/// 在解码线程中解码图片
+	void decode() {
+		// scaler decodes shrunk images at target size instead of rescaling a full size decode
+		if(m_png)
+			m_pixels = wyImageScaler::loadPNG(m_path, m_isFile, m_scale, m_scale, &m_width, &m_height);
+		else
+			m_pixels = wyImageScaler::loadJPG(m_path, m_isFile, m_scale, m_scale, &m_width, &m_height);
+	}
+
+	/// 在OpenGL线程中上传贴图并通知
+	void upload() {
+		if(!advance(m_pixels ? AT_READY : AT_FAILED)) {
+			if(m_pixels) {
+				free(m_pixels);
+				m_pixels = NULL;
+			}
+			return;
+		}
+
+		if(m_pixels == NULL) {
+			LOGW("wyAsyncTexture: failed to decode %s", m_path);
+			if(m_callback.onTextureFailed)
+				m_callback.onTextureFailed(this, m_data);
+			return;
+		}
+
+		// makeRaw copies pixels, decoded buffer is not needed any more
+		m_texture = wyTexture2D::makeRaw(m_pixels, m_width, m_height, m_format);
+		m_texture->retain();
+		m_texture->load();
+		free(m_pixels);
+		m_pixels = NULL;
+
+		for(int i = 0; i < m_targets->num; i++) {
+			wyNode* node = (wyNode*)wyArrayGet(m_targets, i);
+			node->setTexture(m_texture);
+			node->release();
+		}
+		wyArrayClear(m_targets);
+
+		if(m_callback.onTextureLoaded)
+			m_callback.onTextureLoaded(this, m_texture, m_data);
+	}
+
+public:
+	virtual ~wyAsyncTexture() {
+		for(int i = 0; i < m_targets->num; i++)
+			((wyNode*)wyArrayGet(m_targets, i))->release();
+		wyArrayDestroy(m_targets);
+		wyObjectRelease(m_placeholder);
+		wyObjectRelease(m_texture);
+		if(m_pixels)
+			free(m_pixels);
+		free((void*)m_path);
+		pthread_mutex_destroy(&m_stateMutex);
+	}
+
+	/**
+	 * \if English
+	 * Get texture, it is placeholder until real texture is ready
+	 *
+	 * @return texture, may be NULL if no placeholder is set and texture is not ready
+	 * \else
+	 * 得到贴图, 在真实贴图准备好之前返回占位贴图
+	 *
+	 * @return 贴图, 如果没有设置占位贴图并且贴图还没有准备好, 返回NULL
+	 * \endif
+	 */
+	wyTexture2D* getTexture() { return m_texture ? m_texture : m_placeholder; }
+
+	/**
+	 * \if English
+	 * Add a node which should use this texture. The node uses placeholder now, and
+	 * is switched to real texture when it is ready. Must be called in OpenGL thread.
+	 *
+	 * @param node node to set texture
+	 * \else
+	 * 添加一个使用这个贴图的节点. 节点现在使用占位贴图, 贴图准备好后会被切换到真实贴图.
+	 * 必须在OpenGL线程中调用.
+	 *
+	 * @param node 需要设置贴图的节点
+	 * \endif
+	 */
+	void addTarget(wyNode* node) {
+		if(m_state == AT_READY) {
+			node->setTexture(m_texture);
+		} else {
+			if(m_placeholder)
+				node->setTexture(m_placeholder);
+			node->retain();
+			wyArrayPush(m_targets, node);
+		}
+	}
+
+	/**
+	 * \if English
+	 * Cancel loading, callback will not be invoked. It has no effect if texture is ready.
+	 * \else
+	 * 取消载入, 回调不会被调用. 如果贴图已经准备好则没有效果.
+	 * \endif
+	 */
+	void cancel() {
+		pthread_mutex_lock(&m_stateMutex);
+		if(m_state != AT_READY && m_state != AT_FAILED)
+			m_state = AT_CANCELLED;
+		pthread_mutex_unlock(&m_stateMutex);
+	}
+
+	/// 得到状态
+	wyAsyncTextureState getState() { return m_state; }
+
+	/// 贴图是否已经可用
+	bool isReady() { return m_state == AT_READY; }
+
+	/// 得到图片路径
+	const char* getPath() { return m_path; }
+};
+
+/**
+ * @class wyAsyncTextureUpload
+ *
+ * 在OpenGL线程中上传异步贴图的runnable. 它在OpenGL线程中创建和释放, 工作线程只借用它, 不改变引用计数
+ */
+class wyAsyncTextureUpload : public wyRunnable {
+	friend class wyAsyncTextureLoader;
+
+private:
+	/// 需要上传的贴图
+	wyAsyncTexture* m_tex;
+
+public:
+	wyAsyncTextureUpload(wyAsyncTexture* tex) : m_tex(tex) {
+		m_tex->retain();
+	}
+
+	virtual ~wyAsyncTextureUpload() {
+		m_tex->release();
+	}
+
+	virtual void run() {
+		m_tex->upload();
+	}
+};
+
+/**
+ * @class wyAsyncTextureLoader
+ *
+ * \if English
+ * Loads JPG/PNG textures without blocking the caller. Images are decoded in worker threads,
+ * then uploaded in OpenGL thread through \link wyGLTaskQueue wyGLTaskQueue\endlink, so construction
+ * of a scene doesn't stall frame and many uploads are spread over frames. Workers are created on demand and exit when there is no pending job.
+ * \else
+ * 不阻塞调用者的载入JPG/PNG贴图. 图片在工作线程中解码, 然后通过\link wyGLTaskQueue wyGLTaskQueue\endlink在
+ * OpenGL线程中上传, 因此构造场景时不会卡住帧, 大量上传也会被分散到多帧中. 工作线程按需创建, 没有待处理任务时退出.
+ * \endif
+ */
+class wyAsyncTextureLoader : public wyObject {
+private:
+	/// 待解码贴图的上传任务, 在OpenGL线程中创建, 由工作线程交给\link wyGLTaskQueue wyGLTaskQueue\endlink
+	wyArray* m_jobs;
+
+	/// 保护任务队列的锁
+	pthread_mutex_t m_mutex;
+
+	/// 最大工作线程数
+	int m_maxWorkers;
+
+	/// 当前工作线程数
+	int m_workers;
+
+	/// 上传任务的优先级
+	int m_uploadPriority;
+
+private:
+	wyAsyncTextureLoader() :
+			m_jobs(wyArrayNew(8)),
+			m_maxWorkers(WY_ASYNC_TEXTURE_DEFAULT_WORKERS),
+			m_workers(0),
+			m_uploadPriority(GL_TASK_PRIORITY_NORMAL) {
+		pthread_mutex_init(&m_mutex, NULL);
+
+		// task queue must be created in OpenGL thread, workers only post to it
+		wyGLTaskQueue::getInstance();
+	}
+
+	static void workerEntry(void* arg) {
+		((wyAsyncTextureLoader*)arg)->work();
+	}
+
+	void work() {
+		while(true) {
+			pthread_mutex_lock(&m_mutex);
+			wyAsyncTextureUpload* r = m_jobs->num > 0 ? (wyAsyncTextureUpload*)wyArrayDeleteIndex(m_jobs, 0) : NULL;
+			if(r == NULL)
+				m_workers--;
+			pthread_mutex_unlock(&m_mutex);
+			if(r == NULL)
+				break;
+
+			// refcounts are not atomic, upload task is handed to OpenGL thread which releases it
+			wyAsyncTexture* at = r->m_tex;
+			if(at->advance(AT_DECODING)) {
+				at->decode();
+				at->advance(AT_UPLOADING);
+			}
+			wyGLTaskQueue::getInstance()->postLocked(r, m_uploadPriority);
+		}
+	}
+
+	/// 和\c wyTexture2D::makeJPG一样计算解码比例, 只有密度适配模式才缩放
+	static float textureScale(float inDensity) {
+		if(inDensity == 0)
+			inDensity = wyDirector::getDefaultInDensity();
+		return wyGlobal::scaleMode == SCALE_MODE_BY_DENSITY ? wyGlobal::density / inDensity : 1.f;
+	}
+
+	wyAsyncTexture* enqueue(wyAsyncTexture* at) {
+		bool spawn = false;
+		wyAsyncTextureUpload* r = new wyAsyncTextureUpload(at);
+		pthread_mutex_lock(&m_mutex);
+		wyArrayPush(m_jobs, r);
+		if(m_workers < m_maxWorkers && m_workers < m_jobs->num) {
+			m_workers++;
+			spawn = true;
+		}
+		pthread_mutex_unlock(&m_mutex);
+
+		if(spawn) {
+			wyThreadCallback cb = { workerEntry, this };
+			if(wyThread::runThread(&cb) != 0) {
+				pthread_mutex_lock(&m_mutex);
+				m_workers--;
+				pthread_mutex_unlock(&m_mutex);
+				LOGW("wyAsyncTextureLoader: failed to start worker thread");
+			}
+		}
+		return (wyAsyncTexture*)at->autoRelease();
+	}
+
+public:
+	/**
+	 * \if English
+	 * Get singleton
+	 * \else
+	 * 得到单例
+	 * \endif
+	 */
+	static wyAsyncTextureLoader* getInstance() {
+		static wyAsyncTextureLoader* s_instance = NULL;
+		if(s_instance == NULL)
+			s_instance = new wyAsyncTextureLoader();
+		return s_instance;
+	}
+
+	virtual ~wyAsyncTextureLoader() {
+		for(int i = 0; i < m_jobs->num; i++)
+			((wyAsyncTextureUpload*)wyArrayGet(m_jobs, i))->release();
+		wyArrayDestroy(m_jobs);
+		pthread_mutex_destroy(&m_mutex);
+	}
+
+	/**
+	 * \if English
+	 * Load a JPG image asynchronously
+	 *
+	 * @param path assets path or file system path
+	 * @param isFile true means \c path is file system path
+	 * @param callback callback, can be NULL. It will be copied.
+	 * @param data user data of callback
+	 * @param placeholder texture used before real texture is ready, can be NULL
+	 * @param format pixel format of texture
+	 * @param inDensity density of image, 0 means default which can be set by \c wyDirector::setDefaultInDensity
+	 * @return \link wyAsyncTexture wyAsyncTexture\endlink, usable immediately
+	 * \else
+	 * 异步载入一个JPG图片
+	 *
+	 * @param path assets路径或文件系统路径
+	 * @param isFile true表示\c path是文件系统路径
+	 * @param callback 回调, 可以为NULL. 结构会被复制.
+	 * @param data 回调的附加数据
+	 * @param placeholder 真实贴图准备好之前使用的贴图, 可以为NULL
+	 * @param format 贴图格式
+	 * @param inDensity 图片的density, 缺省为0, 表示使用缺省设置, 可以通过\c wyDirector::setDefaultInDensity指定
+	 * @return \link wyAsyncTexture wyAsyncTexture\endlink, 可以立即使用
+	 * \endif
+	 */
+	wyAsyncTexture* loadJPG(const char* path, bool isFile, wyAsyncTextureCallback* callback = NULL, void* data = NULL,
+			wyTexture2D* placeholder = NULL, wyTexturePixelFormat format = WY_TEXTURE_PIXEL_FORMAT_RGBA8888, float inDensity = 0) {
+		return enqueue(new wyAsyncTexture(path, isFile, false, format, textureScale(inDensity), placeholder, callback, data));
+	}
+
+	/**
+	 * \if English
+	 * Load a PNG image asynchronously
+	 *
+	 * @see loadJPG
+	 * \else
+	 * 异步载入一个PNG图片
+	 *
+	 * @see loadJPG
+	 * \endif
+	 */
+	wyAsyncTexture* loadPNG(const char* path, bool isFile, wyAsyncTextureCallback* callback = NULL, void* data = NULL,
+			wyTexture2D* placeholder = NULL, wyTexturePixelFormat format = WY_TEXTURE_PIXEL_FORMAT_RGBA8888, float inDensity = 0) {
+		return enqueue(new wyAsyncTexture(path, isFile, true, format, textureScale(inDensity), placeholder, callback, data));
+	}
+
+	/**
+	 * \if English
+	 * Set max count of worker threads, it affects workers created later
+	 *
+	 * @param count max count of worker threads, at least 1
+	 * \else
+	 * 设置最大工作线程数, 影响之后创建的线程
+	 *
+	 * @param count 最大工作线程数, 至少为1
+	 * \endif
+	 */
+	void setMaxWorkers(int count) { m_maxWorkers = MAX(1, count); }
+
+	/// 得到最大工作线程数
+	int getMaxWorkers() { return m_maxWorkers; }
+
+	/**
+	 * \if English
+	 * Set priority of upload tasks posted to \link wyGLTaskQueue wyGLTaskQueue\endlink
+	 *
+	 * @param priority priority, see \link wyGLTaskPriority wyGLTaskPriority\endlink
+	 * \else
+	 * 设置提交到\link wyGLTaskQueue wyGLTaskQueue\endlink的上传任务的优先级
+	 *
+	 * @param priority 优先级, 参考\link wyGLTaskPriority wyGLTaskPriority\endlink
+	 * \endif
+	 */
+	void setUploadPriority(int priority) { m_uploadPriority = priority; }
+
+	/// 得到上传任务的优先级
+	int getUploadPriority() { return m_uploadPriority; }
+
+	/// 得到待解码的任务数
+	int getPendingCount() {
+		pthread_mutex_lock(&m_mutex);
+		int count = m_jobs->num;
+		pthread_mutex_unlock(&m_mutex);
+		return count;
+	}
+};
+
+#endif // __wyAsyncTextureLoader_h__
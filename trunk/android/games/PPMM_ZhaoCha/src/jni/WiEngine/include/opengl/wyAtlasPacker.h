@@ -0,0 +1,629 @@
+/*
+ * Copyright (c) 2010 WiYun Inc.
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __wyAtlasPacker_h__
+#define __wyAtlasPacker_h__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "wyObject.h"
+#include "wyArray.h"
+#include "wyTexture2D.h"
+#include "wySprite.h"
+#include "wyZwoptex.h"
+#include "wyZwoptexManager.h"
+#include "wyUtils.h"
+#include "wyLog.h"
+
+/// 缺省的图集页大小
+#define WY_ATLAS_DEFAULT_PAGE_SIZE 1024
+
+/// 缺省的图片间隔像素, 间隔中填充图片的边缘像素, 避免过滤时相邻图片的颜色渗入
+#define WY_ATLAS_DEFAULT_PADDING 1
+
+/**
+ * @class wyMaxRectsPacker
+ *
+ * \if English
+ * MaxRects bin packer with best short side fit heuristic. It keeps a list of maximal free
+ * rectangles and places each new rectangle in the free rectangle which leaves the shortest
+ * leftover side. Rectangles are not rotated.
+ * \else
+ * 使用最短边最佳匹配策略的MaxRects装箱算法. 它维护一个极大空闲矩形列表, 并把每个新矩形放在剩余
+ * 短边最小的空闲矩形中. 矩形不会被旋转.
+ * \endif
+ */
+class wyMaxRectsPacker {
+private:
+	/// 整数矩形
+	typedef struct wyPackRect {
+		int x, y, w, h;
+	} wyPackRect;
+
+	/// 箱子宽度
+	int m_width;
+
+	/// 箱子高度
+	int m_height;
+
+	/// 空闲矩形
+	wyPackRect* m_free;
+
+	/// 空闲矩形数
+	int m_freeCount;
+
+	/// 空闲矩形数组容量
+	int m_freeCapacity;
+
+	/// 已经使用的面积
+	int m_usedArea;
+
+private:
+	void pushFree(int x, int y, int w, int h) {
+		if(m_freeCount >= m_freeCapacity) {
+			m_freeCapacity *= 2;
+			m_free = (wyPackRect*)realloc(m_free, m_freeCapacity * sizeof(wyPackRect));
+		}
+		wyPackRect r = { x, y, w, h };
+		m_free[m_freeCount++] = r;
+	}
+
+	static bool contains(wyPackRect& a, wyPackRect& b) {
+		return b.x >= a.x && b.y >= a.y && b.x + b.w <= a.x + a.w && b.y + b.h <= a.y + a.h;
+	}
+
+	/// 把与已用矩形相交的空闲矩形切分为最多四个极大矩形
+	void splitFree(wyPackRect& used) {
+		int count = m_freeCount;
+		for(int i = 0; i < count; i++) {
+			wyPackRect f = m_free[i];
+			if(used.x >= f.x + f.w || used.x + used.w <= f.x || used.y >= f.y + f.h || used.y + used.h <= f.y)
+				continue;
+
+			if(used.x > f.x)
+				pushFree(f.x, f.y, used.x - f.x, f.h);
+			if(used.x + used.w < f.x + f.w)
+				pushFree(used.x + used.w, f.y, f.x + f.w - used.x - used.w, f.h);
+			if(used.y > f.y)
+				pushFree(f.x, f.y, f.w, used.y - f.y);
+			if(used.y + used.h < f.y + f.h)
+				pushFree(f.x, used.y + used.h, f.w, f.y + f.h - used.y - used.h);
+
+			// mark as removed
+			m_free[i].w = 0;
+		}
+	}
+
+	/// 删除空的和被其它空闲矩形包含的空闲矩形
+	void pruneFree() {
+		for(int i = 0; i < m_freeCount; i++) {
+			if(m_free[i].w <= 0 || m_free[i].h <= 0)
+				continue;
+			for(int j = 0; j < m_freeCount; j++) {
+				if(i == j || m_free[j].w <= 0 || m_free[j].h <= 0)
+					continue;
+				if(contains(m_free[j], m_free[i])) {
+					m_free[i].w = 0;
+					break;
+				}
+			}
+		}
+
+		int n = 0;
+		for(int i = 0; i < m_freeCount; i++) {
+			if(m_free[i].w > 0 && m_free[i].h > 0)
+				m_free[n++] = m_free[i];
+		}
+		m_freeCount = n;
+	}
+
+public:
+	/**
+	 * \if English
+	 * Constructor
+	 *
+	 * @param width width of bin
+	 * @param height height of bin
+	 * \else
+	 * 构造函数
+	 *
+	 * @param width 箱子宽度
+	 * @param height 箱子高度
+	 * \endif
+	 */
+	wyMaxRectsPacker(int width, int height) :
+			m_width(width),
+			m_height(height),
+			m_freeCount(0),
+			m_freeCapacity(16),
+			m_usedArea(0) {
+		m_free = (wyPackRect*)malloc(m_freeCapacity * sizeof(wyPackRect));
+		pushFree(0, 0, width, height);
+	}
+
+	virtual ~wyMaxRectsPacker() {
+		free(m_free);
+	}
+
+	/**
+	 * \if English
+	 * Place a rectangle
+	 *
+	 * @param w width of rectangle
+	 * @param h height of rectangle
+	 * @param x returns x position of placed rectangle
+	 * @param y returns y position of placed rectangle
+	 * @return false if rectangle can't be placed
+	 * \else
+	 * 放置一个矩形
+	 *
+	 * @param w 矩形宽度
+	 * @param h 矩形高度
+	 * @param x 返回放置的矩形的x位置
+	 * @param y 返回放置的矩形的y位置
+	 * @return false表示矩形无法放置
+	 * \endif
+	 */
+	bool insert(int w, int h, int* x, int* y) {
+		int best = -1;
+		int bestShort = INT_MAX, bestLong = INT_MAX;
+		for(int i = 0; i < m_freeCount; i++) {
+			wyPackRect& f = m_free[i];
+			if(f.w < w || f.h < h)
+				continue;
+			int dw = f.w - w, dh = f.h - h;
+			int s = dw < dh ? dw : dh;
+			int l = dw < dh ? dh : dw;
+			if(s < bestShort || (s == bestShort && l < bestLong)) {
+				best = i;
+				bestShort = s;
+				bestLong = l;
+			}
+		}
+		if(best < 0)
+			return false;
+
+		wyPackRect used = { m_free[best].x, m_free[best].y, w, h };
+		splitFree(used);
+		pruneFree();
+		m_usedArea += w * h;
+		*x = used.x;
+		*y = used.y;
+		return true;
+	}
+
+	/// 得到已用面积占总面积的比例
+	float getOccupancy() { return (float)m_usedArea / (m_width * m_height); }
+
+	/// 得到箱子宽度
+	int getWidth() { return m_width; }
+
+	/// 得到箱子高度
+	int getHeight() { return m_height; }
+};
+
+/**
+ * @class wyAtlasBuilder
+ *
+ * \if English
+ * Packs many small images into shared texture pages at runtime. Every small image loaded by
+ * \c wyTexture2D::makeJPG becomes its own texture padded to power of two and costs its own
+ * texture bind, packing them together saves memory and binds. Images are decoded by \c addJPG
+ * and \c addPNG, placed by \link wyMaxRectsPacker wyMaxRectsPacker\endlink, and composed into
+ * pages by \c build. Each image gets a \link wyZwoptexFrame wyZwoptexFrame\endlink, and pages
+ * can be registered to \link wyZwoptexManager wyZwoptexManager\endlink so that existing
+ * \c wyZwoptexManager::makeSprite calls return sprites of sub rectangles transparently.
+ * \else
+ * 在运行时把许多小图片打包到共享的贴图页中. 每个通过\c wyTexture2D::makeJPG载入的小图片都是一个
+ * 独立的, 补齐到2的幂的贴图, 并且需要单独绑定贴图, 把它们打包在一起可以节省内存和绑定次数. 图片通过
+ * \c addJPG和\c addPNG解码, 由\link wyMaxRectsPacker wyMaxRectsPacker\endlink放置, 由\c build合成
+ * 到页中. 每个图片得到一个\link wyZwoptexFrame wyZwoptexFrame\endlink, 页还可以注册到
+ * \link wyZwoptexManager wyZwoptexManager\endlink中, 这样已有的\c wyZwoptexManager::makeSprite
+ * 调用可以透明的返回子矩形的sprite.
+ * \endif
+ */
+class wyAtlasBuilder : public wyObject {
+private:
+	/// 图集中的一个图片
+	typedef struct wyAtlasEntry {
+		/// 图片名称
+		const char* name;
+
+		/// 解码后的像素, RGBA8888格式, 合成后释放
+		char* pixels;
+
+		/// 图片宽度
+		int width;
+
+		/// 图片高度
+		int height;
+
+		/// 所在页的索引
+		int page;
+
+		/// 在页中的x位置, 不包括间隔
+		int x;
+
+		/// 在页中的y位置, 不包括间隔
+		int y;
+
+		/// 对应的帧
+		wyZwoptexFrame* frame;
+	} wyAtlasEntry;
+
+	/// 页大小
+	int m_pageSize;
+
+	/// 图片间隔
+	int m_padding;
+
+	/// 图片, 元素是wyAtlasEntry
+	wyArray* m_entries;
+
+	/// 每一页的装箱器
+	wyArray* m_packers;
+
+	/// 合成后每一页的贴图
+	wyArray* m_pages;
+
+	/// 贴图格式
+	wyTexturePixelFormat m_format;
+
+	/// 是否已经合成
+	bool m_built;
+
+private:
+	wyAtlasEntry* find(const char* name) {
+		for(int i = 0; i < m_entries->num; i++) {
+			wyAtlasEntry* e = (wyAtlasEntry*)wyArrayGet(m_entries, i);
+			if(!strcmp(e->name, name))
+				return e;
+		}
+		return NULL;
+	}
+
+	bool add(const char* name, char* pixels, int width, int height) {
+		if(pixels == NULL) {
+			LOGW("wyAtlasBuilder: failed to decode %s", name);
+			return false;
+		}
+		if(m_built || find(name) != NULL) {
+			free(pixels);
+			return false;
+		}
+
+		int pw = width + m_padding * 2;
+		int ph = height + m_padding * 2;
+		if(pw > m_pageSize || ph > m_pageSize) {
+			LOGW("wyAtlasBuilder: %s is larger than page size", name);
+			free(pixels);
+			return false;
+		}
+
+		// try existing pages first, then open a new page
+		int page = -1, x = 0, y = 0;
+		for(int i = 0; i < m_packers->num && page < 0; i++) {
+			if(((wyMaxRectsPacker*)wyArrayGet(m_packers, i))->insert(pw, ph, &x, &y))
+				page = i;
+		}
+		if(page < 0) {
+			wyMaxRectsPacker* packer = new wyMaxRectsPacker(m_pageSize, m_pageSize);
+			packer->insert(pw, ph, &x, &y);
+			wyArrayPush(m_packers, packer);
+			page = m_packers->num - 1;
+		}
+
+		wyAtlasEntry* e = (wyAtlasEntry*)malloc(sizeof(wyAtlasEntry));
+		e->name = wyUtils::copy(name);
+		e->pixels = pixels;
+		e->width = width;
+		e->height = height;
+		e->page = page;
+		e->x = x + m_padding;
+		e->y = y + m_padding;
+		e->frame = NULL;
+		wyArrayPush(m_entries, e);
+		return true;
+	}
+
+	/// 把图片复制到页中, 并把边缘像素扩展到间隔中
+	void blit(wyAtlasEntry* e, char* page) {
+		int stride = m_pageSize * 4;
+		int rowBytes = e->width * 4;
+		for(int row = -m_padding; row < e->height + m_padding; row++) {
+			int srcRow = row < 0 ? 0 : (row >= e->height ? e->height - 1 : row);
+			const char* src = e->pixels + srcRow * rowBytes;
+			char* dst = page + (e->y + row) * stride + e->x * 4;
+			memcpy(dst, src, rowBytes);
+			for(int p = 1; p <= m_padding; p++) {
+				memcpy(dst - p * 4, src, 4);
+				memcpy(dst + rowBytes + (p - 1) * 4, src + rowBytes - 4, 4);
+			}
+		}
+	}
+
+	static void appendXML(FILE* f, const char* s) {
+		for(; *s; s++) {
+			switch(*s) {
+				case '&': fputs("&amp;", f); break;
+				case '<': fputs("&lt;", f); break;
+				case '>': fputs("&gt;", f); break;
+				default: fputc(*s, f); break;
+			}
+		}
+	}
+
+public:
+	/**
+	 * \if English
+	 * Static factory method
+	 *
+	 * @param pageSize width and height of page, should be power of two
+	 * @param padding gap around each image, filled with its edge pixels
+	 * @param format pixel format of page textures
+	 * \else
+	 * 静态构造方法
+	 *
+	 * @param pageSize 页的宽度和高度, 应该是2的幂
+	 * @param padding 图片周围的间隔, 填充图片的边缘像素
+	 * @param format 页贴图的格式
+	 * \endif
+	 */
+	static wyAtlasBuilder* make(int pageSize = WY_ATLAS_DEFAULT_PAGE_SIZE, int padding = WY_ATLAS_DEFAULT_PADDING,
+			wyTexturePixelFormat format = WY_TEXTURE_PIXEL_FORMAT_RGBA8888) {
+		wyAtlasBuilder* b = new wyAtlasBuilder(pageSize, padding, format);
+		return (wyAtlasBuilder*)b->autoRelease();
+	}
+
+	wyAtlasBuilder(int pageSize, int padding, wyTexturePixelFormat format) :
+			m_pageSize(pageSize),
+			m_padding(padding),
+			m_entries(wyArrayNew(32)),
+			m_packers(wyArrayNew(2)),
+			m_pages(wyArrayNew(2)),
+			m_format(format),
+			m_built(false) {
+	}
+
+	virtual ~wyAtlasBuilder() {
+		for(int i = 0; i < m_entries->num; i++) {
+			wyAtlasEntry* e = (wyAtlasEntry*)wyArrayGet(m_entries, i);
+			free((void*)e->name);
+			if(e->pixels)
+				free(e->pixels);
+			wyObjectRelease(e->frame);
+			free(e);
+		}
+		wyArrayDestroy(m_entries);
+		for(int i = 0; i < m_packers->num; i++)
+			delete (wyMaxRectsPacker*)wyArrayGet(m_packers, i);
+		wyArrayDestroy(m_packers);
+		for(int i = 0; i < m_pages->num; i++)
+			((wyTexture2D*)wyArrayGet(m_pages, i))->release();
+		wyArrayDestroy(m_pages);
+	}
+
+	/**
+	 * \if English
+	 * Decode and place a JPG image, must be called before \c build
+	 *
+	 * @param path assets path or file system path, also used as frame name
+	 * @param isFile true means \c path is file system path
+	 * @return true if image is added
+	 * \else
+	 * 解码并放置一个JPG图片, 必须在\c build之前调用
+	 *
+	 * @param path assets路径或文件系统路径, 也作为帧名称
+	 * @param isFile true表示\c path是文件系统路径
+	 * @return true表示图片被添加
+	 * \endif
+	 */
+	bool addJPG(const char* path, bool isFile = false) {
+		int w, h;
+		char* pixels = wyUtils::loadJPG(path, isFile, &w, &h, false, 1.f, 1.f);
+		return add(path, pixels, w, h);
+	}
+
+	/**
+	 * \if English
+	 * Decode and place a PNG image, must be called before \c build
+	 *
+	 * @see addJPG
+	 * \else
+	 * 解码并放置一个PNG图片, 必须在\c build之前调用
+	 *
+	 * @see addJPG
+	 * \endif
+	 */
+	bool addPNG(const char* path, bool isFile = false) {
+		int w, h;
+		char* pixels = wyUtils::loadPNG(path, isFile, &w, &h, false, 1.f, 1.f);
+		return add(path, pixels, w, h);
+	}
+
+	/**
+	 * \if English
+	 * Compose pages and create page textures. Decoded pixels of images are released.
+	 * \else
+	 * 合成页并创建页贴图. 图片解码后的像素会被释放.
+	 * \endif
+	 */
+	void build() {
+		if(m_built)
+			return;
+		m_built = true;
+
+		size_t pageBytes = (size_t)m_pageSize * m_pageSize * 4;
+		for(int p = 0; p < m_packers->num; p++) {
+			char* page = (char*)calloc(pageBytes, 1);
+			for(int i = 0; i < m_entries->num; i++) {
+				wyAtlasEntry* e = (wyAtlasEntry*)wyArrayGet(m_entries, i);
+				if(e->page == p)
+					blit(e, page);
+			}
+
+			wyTexture2D* tex = wyTexture2D::makeRaw(page, m_pageSize, m_pageSize, m_format);
+			free(page);
+			tex->retain();
+			wyArrayPush(m_pages, tex);
+		}
+
+		for(int i = 0; i < m_entries->num; i++) {
+			wyAtlasEntry* e = (wyAtlasEntry*)wyArrayGet(m_entries, i);
+			free(e->pixels);
+			e->pixels = NULL;
+
+			wyZwoptexFrame* f = new wyZwoptexFrame();
+			f->key = wyUtils::copy(e->name);
+			f->rect = wyr(e->x, e->y, e->width, e->height);
+			f->sourceColorRect = wyr(0, 0, e->width, e->height);
+			f->offset = wyp(0, 0);
+			f->sourceSize = wys(e->width, e->height);
+			f->rotated = false;
+			e->frame = f;
+		}
+	}
+
+	/**
+	 * \if English
+	 * Write zwoptex plist of every page into a directory and register them to
+	 * \link wyZwoptexManager wyZwoptexManager\endlink, must be called after \c build.
+	 * Zwoptex of page i is named \c name_i.
+	 *
+	 * @param name name prefix of zwoptex
+	 * @param dir writable directory in file system
+	 * \else
+	 * 把每一页的zwoptex plist写入一个目录并注册到\link wyZwoptexManager wyZwoptexManager\endlink中,
+	 * 必须在\c build之后调用. 第i页的zwoptex名称是\c name_i.
+	 *
+	 * @param name zwoptex名称前缀
+	 * @param dir 文件系统中可写的目录
+	 * \endif
+	 */
+	void registerZwoptex(const char* name, const char* dir) {
+		if(!m_built)
+			return;
+
+		for(int p = 0; p < m_pages->num; p++) {
+			char zwoptexName[256];
+			char path[512];
+			snprintf(zwoptexName, sizeof(zwoptexName), "%s_%d", name, p);
+			snprintf(path, sizeof(path), "%s/%s.plist", dir, zwoptexName);
+
+			FILE* f = fopen(path, "wb");
+			if(f == NULL) {
+				LOGW("wyAtlasBuilder: can't write %s", path);
+				continue;
+			}
+
+			fputs("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<plist version=\"1.0\">\n<dict>\n<key>frames</key>\n<dict>\n", f);
+			for(int i = 0; i < m_entries->num; i++) {
+				wyAtlasEntry* e = (wyAtlasEntry*)wyArrayGet(m_entries, i);
+				if(e->page != p)
+					continue;
+				fputs("<key>", f);
+				appendXML(f, e->name);
+				fprintf(f, "</key>\n<dict>\n"
+						"<key>frame</key><string>{{%d,%d},{%d,%d}}</string>\n"
+						"<key>offset</key><string>{0,0}</string>\n"
+						"<key>rotated</key><false/>\n"
+						"<key>sourceColorRect</key><string>{{0,0},{%d,%d}}</string>\n"
+						"<key>sourceSize</key><string>{%d,%d}</string>\n"
+						"</dict>\n",
+						e->x, e->y, e->width, e->height, e->width, e->height, e->width, e->height);
+			}
+			fprintf(f, "</dict>\n<key>metadata</key>\n<dict>\n"
+					"<key>format</key><integer>2</integer>\n"
+					"<key>size</key><string>{%d,%d}</string>\n"
+					"</dict>\n</dict>\n</plist>\n", m_pageSize, m_pageSize);
+			fclose(f);
+
+			wyZwoptexManager::getInstance()->addZwoptex(zwoptexName, path, true, (wyTexture2D*)wyArrayGet(m_pages, p));
+		}
+	}
+
+	/**
+	 * \if English
+	 * Get frame of an image, available after \c build
+	 *
+	 * @param name image name, which is the path passed to \c addJPG or \c addPNG
+	 * @return \link wyZwoptexFrame wyZwoptexFrame\endlink, or NULL if not found
+	 * \else
+	 * 得到一个图片的帧, \c build之后可用
+	 *
+	 * @param name 图片名称, 即传给\c addJPG或\c addPNG的路径
+	 * @return \link wyZwoptexFrame wyZwoptexFrame\endlink, 如果没有找到返回NULL
+	 * \endif
+	 */
+	wyZwoptexFrame* getFrame(const char* name) {
+		wyAtlasEntry* e = find(name);
+		return e ? e->frame : NULL;
+	}
+
+	/**
+	 * \if English
+	 * Get page texture containing an image, available after \c build
+	 *
+	 * @param name image name
+	 * @return page texture, or NULL if not found
+	 * \else
+	 * 得到包含一个图片的页贴图, \c build之后可用
+	 *
+	 * @param name 图片名称
+	 * @return 页贴图, 如果没有找到返回NULL
+	 * \endif
+	 */
+	wyTexture2D* getTexture(const char* name) {
+		wyAtlasEntry* e = find(name);
+		return (e && m_built) ? (wyTexture2D*)wyArrayGet(m_pages, e->page) : NULL;
+	}
+
+	/**
+	 * \if English
+	 * Create a sprite showing an image, available after \c build
+	 *
+	 * @param name image name
+	 * @return \link wySprite wySprite\endlink, or NULL if not found
+	 * \else
+	 * 创建一个显示图片的sprite, \c build之后可用
+	 *
+	 * @param name 图片名称
+	 * @return \link wySprite wySprite\endlink, 如果没有找到返回NULL
+	 * \endif
+	 */
+	wySprite* makeSprite(const char* name) {
+		wyTexture2D* tex = getTexture(name);
+		return tex ? wySprite::make(tex, getFrame(name)) : NULL;
+	}
+
+	/// 得到页数
+	int getPageCount() { return m_packers->num; }
+
+	/// 得到图片数
+	int getImageCount() { return m_entries->num; }
+
+	/// 得到第\c page页的占用率
+	float getOccupancy(int page) { return ((wyMaxRectsPacker*)wyArrayGet(m_packers, page))->getOccupancy(); }
+};
+
+#endif // __wyAtlasPacker_h__
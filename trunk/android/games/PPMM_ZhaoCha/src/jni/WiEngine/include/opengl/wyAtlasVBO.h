@@ -0,0 +1,860 @@
+/*
+ * Copyright (c) 2010 WiYun Inc.
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __wyAtlasVBO_h__
+#define __wyAtlasVBO_h__
+
+#if ANDROID
+	#include <GLES/gl.h>
+#elif IOS
+	#import <OpenGLES/ES1/gl.h>
+	#import <OpenGLES/ES1/glext.h>
+#endif
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wyObject.h"
+#include "wyTextureAtlas.h"
+#include "wyDirector.h"
+#include "wyGLState.h"
+#include "wyLog.h"
+
+/// 一个atlas VBO最多能容纳的矩形数, 受限于16位索引
+#define WY_ATLAS_VBO_MAX_QUADS 16384
+
+/**
+ * @struct wyInterleavedVertex
+ *
+ * 交错存放的atlas顶点, 位置, 贴图坐标和颜色放在一起, 共24字节
+ */
+typedef struct wyInterleavedVertex {
+	/// 位置
+	GLfloat x, y, z;
+
+	/// 贴图坐标
+	GLfloat u, v;
+
+	/// 颜色
+	GLubyte r, g, b, a;
+} wyInterleavedVertex;
+
+/// 紧凑顶点中贴图坐标的定点比例, 贴图坐标乘以这个值后存为16位整数
+#define WY_COMPACT_TEXCOORD_SCALE 32767.f
+
+/**
+ * @struct wyCompactVertex
+ *
+ * 2D内容使用的紧凑顶点, 2D位置, 16位定点贴图坐标和打包的颜色, 共16字节
+ */
+typedef struct wyCompactVertex {
+	/// 位置
+	GLfloat x, y;
+
+	/// 贴图坐标, 乘以\c WY_COMPACT_TEXCOORD_SCALE
+	GLshort u, v;
+
+	/// 颜色
+	GLubyte r, g, b, a;
+} wyCompactVertex;
+
+/**
+ * @typedef wyAtlasVertexFormat
+ *
+ * atlas VBO的顶点格式
+ */
+typedef enum {
+	/// \link wyInterleavedVertex wyInterleavedVertex\endlink, 每个矩形96字节
+	ATLAS_VERTEX_FULL,
+
+	/// \link wyCompactVertex wyCompactVertex\endlink, 每个矩形64字节, 忽略z坐标, 贴图坐标必须在0到1之间
+	ATLAS_VERTEX_COMPACT_2D
+} wyAtlasVertexFormat;
+
+/**
+ * @typedef wyAtlasVBOMode
+ *
+ * VBO的更新方式
+ */
+typedef enum {
+	/// 上传前用glBufferData(NULL)丢弃旧的存储, 驱动可以分配新的存储而不必等待GPU
+	ATLAS_VBO_ORPHAN,
+
+	/// 两个VBO交替使用, 写入的总是GPU上一帧没有使用的那个
+	ATLAS_VBO_DOUBLE_BUFFER
+} wyAtlasVBOMode;
+
+/**
+ * @class wyTextureAtlasAccessor
+ *
+ * 通过成员指针访问\link wyTextureAtlas wyTextureAtlas\endlink的保护成员, 不会被实例化
+ */
+class wyTextureAtlasAccessor : public wyTextureAtlas {
+private:
+	wyTextureAtlasAccessor();
+
+public:
+	static GLfloat* vertices(wyTextureAtlas* a) { return a->*(&wyTextureAtlasAccessor::m_vertices); }
+	static GLfloat* texCoords(wyTextureAtlas* a) { return a->*(&wyTextureAtlasAccessor::m_texCoords); }
+	static GLubyte* colors(wyTextureAtlas* a) { return a->*(&wyTextureAtlasAccessor::m_colors); }
+	static int& totalQuads(wyTextureAtlas* a) { return a->*(&wyTextureAtlasAccessor::m_totalQuads); }
+};
+
+/**
+ * @struct wyQuadRange
+ *
+ * 一段连续的矩形, 不包括\c end
+ */
+typedef struct wyQuadRange {
+	int start;
+	int end;
+} wyQuadRange;
+
+/**
+ * @struct wyQuadRangeList
+ *
+ * 有序的矩形区间列表, 相邻或重叠的区间会被合并
+ */
+typedef struct wyQuadRangeList {
+	/// 区间
+	wyQuadRange* ranges;
+
+	/// 区间数
+	int count;
+
+	/// \c ranges能容纳的区间数
+	int capacity;
+} wyQuadRangeList;
+
+/**
+ * @class wyAtlasVBO
+ *
+ * \if English
+ * Interleaved vertex buffer object for a \link wyTextureAtlas wyTextureAtlas\endlink. The atlas keeps
+ * positions, texture coordinates and colors in three client side arrays and submits all of them
+ * from CPU memory in every draw. This class mirrors quads of an atlas into one interleaved array
+ * in a VBO, with a static index buffer, and uploads only when quads changed since last draw.
+ *
+ * Changes are tracked where quads are set: methods of this class, such as \c updateQuad and
+ * \c removeQuad, and \c markDirty record changed quads, so a frame costs only the changed quads.
+ * Quads modified directly by engine nodes such as \link wySpriteBatchNode wySpriteBatchNode\endlink
+ * are not seen, turn on \c setAutoDetect for such atlas to compare every quad with last uploaded one
+ * in each frame. VBOs are recreated automatically after OpenGL context is lost.
+ *
+ * Changed quads are recorded as sorted ranges, ranges closer than \c setMergeGap are merged, and
+ * only those ranges are uploaded with \c glBufferSubData. \c removeQuad and \c insertQuad can swap
+ * with last quad instead of moving whole tail when order of quads is not significant.
+ *
+ * For 2D content, \c ATLAS_VERTEX_COMPACT_2D drops z and stores texture coordinates as 16 bit fixed
+ * point, a quad takes 64 bytes instead of 96 bytes of atlas arrays or full interleaved format.
+ * \else
+ * \link wyTextureAtlas wyTextureAtlas\endlink的交错顶点缓冲对象. atlas把位置, 贴图坐标和颜色存放在三个
+ * 客户端数组中, 每次绘制都从CPU内存提交全部数据. 这个类把atlas的矩形镜像到VBO中的一个交错数组, 使用静态
+ * 的索引缓冲, 只有矩形在上次绘制后改变时才上传.
+ *
+ * 改变在设置矩形的地方被记录: 这个类的方法, 比如\c updateQuad和\c removeQuad, 以及\c markDirty会记录
+ * 改变的矩形, 因此每帧的开销只和改变的矩形有关. \link wySpriteBatchNode wySpriteBatchNode\endlink等引擎
+ * 节点直接修改的矩形不会被发现, 对这样的atlas需要用\c setAutoDetect打开比较, 每帧把每个矩形和上次上传的
+ * 比较. OpenGL上下文丢失后VBO会被自动重新创建.
+ *
+ * 改变的矩形被记录为有序的区间, 距离小于\c setMergeGap的区间会被合并, 只有这些区间通过\c glBufferSubData
+ * 上传. 当矩形顺序不重要时, \c removeQuad和\c insertQuad可以和最后一个矩形交换, 而不必移动整个尾部.
+ *
+ * 对于2D内容, \c ATLAS_VERTEX_COMPACT_2D丢弃z坐标并且把贴图坐标存为16位定点数, 一个矩形占用64字节, 而atlas
+ * 数组或完整交错格式需要96字节.
+ * \endif
+ */
+class wyAtlasVBO : public wyObject {
+private:
+	/// 镜像的atlas
+	wyTextureAtlas* m_atlas;
+
+	/// 交错顶点, 和最近一次上传的内容一致
+	char* m_staging;
+
+	/// 顶点格式
+	wyAtlasVertexFormat m_format;
+
+	/// 一个矩形的字节数
+	int m_quadSize;
+
+	/// \c m_staging能容纳的矩形数
+	int m_capacity;
+
+	/// 顶点缓冲, 双缓冲时使用两个
+	GLuint m_vbo[2];
+
+	/// 索引缓冲
+	GLuint m_ibo;
+
+	/// 当前使用的顶点缓冲
+	int m_current;
+
+	/// 创建缓冲时的surface代数, 和当前不同表示缓冲已经失效
+	int m_generation;
+
+	/// 更新方式
+	wyAtlasVBOMode m_mode;
+
+	/// true表示下次绘制前需要上传全部矩形
+	bool m_dirty;
+
+	/// 是否通过比较发现改变的矩形
+	bool m_autoDetect;
+
+	/// 间隔不超过这个矩形数的区间会被合并
+	int m_mergeGap;
+
+	/// 下次上传的区间
+	wyQuadRangeList m_ranges;
+
+	/// 双缓冲时上次上传的区间, 另一个缓冲还没有它们
+	wyQuadRangeList m_prevRanges;
+
+	/// 上传的总矩形数
+	int m_uploadedQuadCount;
+
+	/// 上次上传时的矩形数
+	int m_uploadedQuads;
+
+	/// 上传次数
+	int m_uploadCount;
+
+	/// 上传的总字节数
+	size_t m_uploadBytes;
+
+private:
+	static int* surfaceGeneration() {
+		static int s_generation = 0;
+		static bool s_listening = false;
+		if(!s_listening) {
+			wyDirectorLifecycleListener l;
+			memset(&l, 0, sizeof(wyDirectorLifecycleListener));
+			l.onSurfaceCreated = onSurfaceCreated;
+			wyDirector::getInstance()->addLifecycleListener(&l, NULL);
+			s_listening = true;
+		}
+		return &s_generation;
+	}
+
+	static void onSurfaceCreated(void* data) {
+		(*surfaceGeneration())++;
+	}
+
+	/// 添加一个区间, 保持有序并且合并间隔不超过gap的区间
+	static void addRange(wyQuadRangeList* list, int start, int end, int gap) {
+		if(start >= end)
+			return;
+
+		// find first range which can be merged or which is after new one
+		int i = 0;
+		while(i < list->count && list->ranges[i].end + gap < start)
+			i++;
+		int j = i;
+		while(j < list->count && list->ranges[j].start <= end + gap) {
+			if(list->ranges[j].start < start)
+				start = list->ranges[j].start;
+			if(list->ranges[j].end > end)
+				end = list->ranges[j].end;
+			j++;
+		}
+
+		// ranges i to j - 1 are replaced by merged one
+		int delta = 1 - (j - i);
+		if(list->count + delta > list->capacity) {
+			list->capacity = list->capacity * 2 + 8;
+			list->ranges = (wyQuadRange*)realloc(list->ranges, list->capacity * sizeof(wyQuadRange));
+		}
+		if(delta != 0)
+			memmove(list->ranges + j + delta, list->ranges + j, (list->count - j) * sizeof(wyQuadRange));
+		list->ranges[i].start = start;
+		list->ranges[i].end = end;
+		list->count += delta;
+	}
+
+	/// 复制atlas中的一个矩形到另一个位置
+	void copyQuad(int from, int to) {
+		memcpy(wyTextureAtlasAccessor::vertices(m_atlas) + to * 12, wyTextureAtlasAccessor::vertices(m_atlas) + from * 12, 12 * sizeof(GLfloat));
+		memcpy(wyTextureAtlasAccessor::texCoords(m_atlas) + to * 8, wyTextureAtlasAccessor::texCoords(m_atlas) + from * 8, 8 * sizeof(GLfloat));
+		GLubyte* colors = wyTextureAtlasAccessor::colors(m_atlas);
+		if(colors)
+			memcpy(colors + to * 16, colors + from * 16, 16);
+	}
+
+	/// 把atlas中的一个矩形转换为交错顶点, 返回true表示和\c m_staging中原来的内容不同
+	bool interleave(int index) {
+		const GLfloat* v = wyTextureAtlasAccessor::vertices(m_atlas) + index * 12;
+		const GLfloat* t = wyTextureAtlasAccessor::texCoords(m_atlas) + index * 8;
+		const GLubyte* c = m_atlas->isWithColorArray() ? wyTextureAtlasAccessor::colors(m_atlas) + index * 16 : NULL;
+		static const GLubyte white[16] = {
+			255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255
+		};
+		if(c == NULL)
+			c = white;
+
+		char quad[4 * sizeof(wyInterleavedVertex)];
+		if(m_format == ATLAS_VERTEX_COMPACT_2D) {
+			wyCompactVertex* out = (wyCompactVertex*)quad;
+			for(int i = 0; i < 4; i++) {
+				out[i].x = v[i * 3];
+				out[i].y = v[i * 3 + 1];
+				out[i].u = (GLshort)(t[i * 2] * WY_COMPACT_TEXCOORD_SCALE + 0.5f);
+				out[i].v = (GLshort)(t[i * 2 + 1] * WY_COMPACT_TEXCOORD_SCALE + 0.5f);
+				memcpy(&out[i].r, c + i * 4, 4);
+			}
+		} else {
+			wyInterleavedVertex* out = (wyInterleavedVertex*)quad;
+			for(int i = 0; i < 4; i++) {
+				out[i].x = v[i * 3];
+				out[i].y = v[i * 3 + 1];
+				out[i].z = v[i * 3 + 2];
+				out[i].u = t[i * 2];
+				out[i].v = t[i * 2 + 1];
+				memcpy(&out[i].r, c + i * 4, 4);
+			}
+		}
+
+		char* dst = m_staging + index * m_quadSize;
+		if(memcmp(dst, quad, m_quadSize) == 0)
+			return false;
+		memcpy(dst, quad, m_quadSize);
+		return true;
+	}
+
+	/// 按atlas容量创建或扩大缓冲
+	void ensureBuffers() {
+		int capacity = m_atlas->getCapacity();
+		if(capacity > WY_ATLAS_VBO_MAX_QUADS)
+			capacity = WY_ATLAS_VBO_MAX_QUADS;
+		int generation = *surfaceGeneration();
+		if(m_ibo != 0 && capacity <= m_capacity && generation == m_generation)
+			return;
+
+		// old names are invalid after context loss, don't delete them
+		if(m_ibo != 0 && generation == m_generation)
+			deleteBuffers();
+		if(capacity > m_capacity) {
+			m_staging = (char*)realloc(m_staging, capacity * sizeof(wyInterleavedVertex) * 4);
+			m_capacity = capacity;
+		}
+
+		GLushort* indices = (GLushort*)malloc(m_capacity * 6 * sizeof(GLushort));
+		for(int i = 0; i < m_capacity; i++) {
+			indices[i * 6] = i * 4;
+			indices[i * 6 + 1] = i * 4 + 1;
+			indices[i * 6 + 2] = i * 4 + 2;
+			indices[i * 6 + 3] = i * 4 + 3;
+			indices[i * 6 + 4] = i * 4 + 2;
+			indices[i * 6 + 5] = i * 4 + 1;
+		}
+		wyGLState* gl = wyGLState::getInstance();
+		gl->begin();
+		glGenBuffers(1, &m_ibo);
+		gl->bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_capacity * 6 * sizeof(GLushort), indices, GL_STATIC_DRAW);
+		free(indices);
+
+		int count = m_mode == ATLAS_VBO_DOUBLE_BUFFER ? 2 : 1;
+		glGenBuffers(count, m_vbo);
+		for(int i = 0; i < count; i++) {
+			gl->bindBuffer(GL_ARRAY_BUFFER, m_vbo[i]);
+			glBufferData(GL_ARRAY_BUFFER, m_capacity * m_quadSize, NULL, GL_DYNAMIC_DRAW);
+		}
+		gl->end();
+
+		m_generation = generation;
+		m_current = 0;
+		m_dirty = true;
+	}
+
+	void deleteBuffers() {
+		if(m_ibo == 0)
+			return;
+		wyGLState* gl = wyGLState::getInstance();
+		gl->forgetBuffer(m_ibo);
+		gl->forgetBuffer(m_vbo[0]);
+		gl->forgetBuffer(m_vbo[1]);
+		glDeleteBuffers(1, &m_ibo);
+		glDeleteBuffers(m_vbo[1] != 0 ? 2 : 1, m_vbo);
+		m_ibo = 0;
+		m_vbo[0] = m_vbo[1] = 0;
+	}
+
+	/// 上传一段矩形到当前绑定的缓冲
+	void uploadRange(int start, int end) {
+		glBufferSubData(GL_ARRAY_BUFFER, start * m_quadSize, (end - start) * m_quadSize, m_staging + start * m_quadSize);
+		m_uploadBytes += (end - start) * m_quadSize;
+		m_uploadedQuadCount += end - start;
+	}
+
+protected:
+	/**
+	 * 构造函数
+	 *
+	 * @param atlas 需要镜像的\link wyTextureAtlas wyTextureAtlas\endlink
+	 * @param mode VBO的更新方式
+	 * @param format 顶点格式
+	 */
+	wyAtlasVBO(wyTextureAtlas* atlas, wyAtlasVBOMode mode, wyAtlasVertexFormat format) :
+			m_atlas(atlas),
+			m_staging(NULL),
+			m_format(format),
+			m_quadSize(format == ATLAS_VERTEX_COMPACT_2D ? 4 * sizeof(wyCompactVertex) : 4 * sizeof(wyInterleavedVertex)),
+			m_capacity(0),
+			m_ibo(0),
+			m_current(0),
+			m_generation(0),
+			m_mode(mode),
+			m_dirty(true),
+			m_autoDetect(false),
+			m_mergeGap(2),
+			m_uploadedQuadCount(0),
+			m_uploadedQuads(0),
+			m_uploadCount(0),
+			m_uploadBytes(0) {
+		m_vbo[0] = m_vbo[1] = 0;
+		memset(&m_ranges, 0, sizeof(wyQuadRangeList));
+		memset(&m_prevRanges, 0, sizeof(wyQuadRangeList));
+		wyObjectRetain(m_atlas);
+	}
+
+public:
+	/**
+	 * \if English
+	 * Create a VBO mirror for an atlas
+	 *
+	 * @param atlas atlas to mirror, it is retained
+	 * @param mode how buffer is updated, orphaning by default
+	 * @param format vertex format, \c ATLAS_VERTEX_COMPACT_2D takes 2/3 memory and bandwidth of
+	 * 		full format for 2D content
+	 * \else
+	 * 为一个atlas创建VBO镜像
+	 *
+	 * @param atlas 需要镜像的atlas, 它会被retain
+	 * @param mode VBO的更新方式, 缺省是丢弃旧存储
+	 * @param format 顶点格式, 对于2D内容, \c ATLAS_VERTEX_COMPACT_2D占用的内存和带宽是完整格式的2/3
+	 * \endif
+	 */
+	static wyAtlasVBO* make(wyTextureAtlas* atlas, wyAtlasVBOMode mode = ATLAS_VBO_ORPHAN, wyAtlasVertexFormat format = ATLAS_VERTEX_FULL) {
+		wyAtlasVBO* vbo = new wyAtlasVBO(atlas, mode, format);
+		return (wyAtlasVBO*)vbo->autoRelease();
+	}
+
+	virtual ~wyAtlasVBO() {
+		if(m_generation == *surfaceGeneration())
+			deleteBuffers();
+		if(m_staging)
+			free(m_staging);
+		if(m_ranges.ranges)
+			free(m_ranges.ranges);
+		if(m_prevRanges.ranges)
+			free(m_prevRanges.ranges);
+		wyObjectRelease(m_atlas);
+	}
+
+	/// 得到镜像的atlas
+	wyTextureAtlas* getAtlas() { return m_atlas; }
+
+	/**
+	 * \if English
+	 * Change vertex format, buffers are rebuilt in next draw
+	 *
+	 * @param format vertex format
+	 * \else
+	 * 改变顶点格式, 缓冲会在下次绘制时重建
+	 *
+	 * @param format 顶点格式
+	 * \endif
+	 */
+	void setVertexFormat(wyAtlasVertexFormat format) {
+		if(format == m_format)
+			return;
+		m_format = format;
+		m_quadSize = format == ATLAS_VERTEX_COMPACT_2D ? 4 * sizeof(wyCompactVertex) : 4 * sizeof(wyInterleavedVertex);
+		if(m_generation == *surfaceGeneration())
+			deleteBuffers();
+		m_dirty = true;
+	}
+
+	/// 得到顶点格式
+	wyAtlasVertexFormat getVertexFormat() { return m_format; }
+
+	/**
+	 * \if English
+	 * Force uploading all quads in next draw
+	 * \else
+	 * 强制在下次绘制时上传所有矩形
+	 * \endif
+	 */
+	void markDirty() { m_dirty = true; }
+
+	/**
+	 * \if English
+	 * Mark a range of quads as changed
+	 *
+	 * @param start index of first quad
+	 * @param count number of quads
+	 * \else
+	 * 标记一段矩形已经改变
+	 *
+	 * @param start 第一个矩形的索引
+	 * @param count 矩形数
+	 * \endif
+	 */
+	void markDirty(int start, int count) { addRange(&m_ranges, start, start + count, m_mergeGap); }
+
+	/**
+	 * \if English
+	 * Set whether changed quads are found by comparing every quad in each frame. Enable it only if
+	 * engine nodes modify atlas directly, changes through this class or \c markDirty are tracked
+	 * without it. It is disabled by default.
+	 * \else
+	 * 设置是否每帧比较每个矩形来发现改变. 只有引擎节点直接修改atlas时才需要启用, 通过这个类或者\c markDirty
+	 * 的修改不需要它也能被记录. 缺省是禁用的.
+	 * \endif
+	 */
+	void setAutoDetect(bool flag) { m_autoDetect = flag; }
+
+	/**
+	 * \if English
+	 * Set max gap between two dirty ranges which are merged into one upload, default is 2 quads
+	 * \else
+	 * 设置两个脏区间合并为一次上传的最大间隔, 缺省是2个矩形
+	 * \endif
+	 */
+	void setMergeGap(int gap) { m_mergeGap = gap; }
+
+	/// 更新一个矩形, 参见\c wyTextureAtlas::updateQuad
+	void updateQuad(wyQuad2D& quadT, wyQuad3D& quadV, int index) {
+		m_atlas->updateQuad(quadT, quadV, index);
+		addRange(&m_ranges, index, index + 1, m_mergeGap);
+	}
+
+	/// 更新一个矩形的颜色, 参见\c wyTextureAtlas::updateColor
+	void updateColor(wyColor4B color, int index) {
+		m_atlas->updateColor(color, index);
+		addRange(&m_ranges, index, index + 1, m_mergeGap);
+	}
+
+	/// 添加一个矩形到末尾, 参见\c wyTextureAtlas::appendQuad
+	int appendQuad(wyQuad2D& quadT, wyQuad3D& quadV) {
+		int index = m_atlas->appendQuad(quadT, quadV);
+		addRange(&m_ranges, index, index + 1, m_mergeGap);
+		return index;
+	}
+
+	/**
+	 * \if English
+	 * Insert a quad
+	 *
+	 * @param quadT texture coordinates
+	 * @param quadV vertices
+	 * @param index index to insert at
+	 * @param keepOrder false means quad at \c index is moved to the end instead of shifting whole tail
+	 * \else
+	 * 插入一个矩形
+	 *
+	 * @param quadT 贴图坐标
+	 * @param quadV 顶点
+	 * @param index 插入的位置
+	 * @param keepOrder false表示把\c index处的矩形移到末尾, 而不是移动整个尾部
+	 * \endif
+	 */
+	void insertQuad(wyQuad2D& quadT, wyQuad3D& quadV, int index, bool keepOrder = true) {
+		int total = m_atlas->getTotalQuads();
+		if(keepOrder || index >= total) {
+			m_atlas->insertQuad(quadT, quadV, index);
+			addRange(&m_ranges, index, total + 1, m_mergeGap);
+		} else {
+			if(total >= m_atlas->getCapacity())
+				m_atlas->resizeCapacity(total * 4 / 3 + 1);
+			copyQuad(index, total);
+			wyTextureAtlasAccessor::totalQuads(m_atlas)++;
+			m_atlas->updateQuad(quadT, quadV, index);
+			addRange(&m_ranges, index, index + 1, m_mergeGap);
+			addRange(&m_ranges, total, total + 1, m_mergeGap);
+		}
+	}
+
+	/**
+	 * \if English
+	 * Remove a quad
+	 *
+	 * @param index index of quad
+	 * @param keepOrder false means last quad is moved to \c index instead of shifting whole tail
+	 * \else
+	 * 删除一个矩形
+	 *
+	 * @param index 矩形的索引
+	 * @param keepOrder false表示把最后一个矩形移到\c index, 而不是移动整个尾部
+	 * \endif
+	 */
+	void removeQuad(int index, bool keepOrder = true) {
+		int last = m_atlas->getTotalQuads() - 1;
+		if(index > last)
+			return;
+		if(keepOrder) {
+			m_atlas->removeQuad(index);
+			addRange(&m_ranges, index, last, m_mergeGap);
+		} else {
+			if(index != last) {
+				copyQuad(last, index);
+				addRange(&m_ranges, index, index + 1, m_mergeGap);
+			}
+			wyTextureAtlasAccessor::totalQuads(m_atlas)--;
+		}
+	}
+
+	/**
+	 * \if English
+	 * Upload changed quads to VBO, must be called in OpenGL thread. \c drawRange calls it, call
+	 * it directly only before several \c drawUploaded calls in one frame.
+	 * \else
+	 * 把改变的矩形上传到VBO, 必须在OpenGL线程中调用. \c drawRange会调用这个方法, 只有在一帧中
+	 * 调用多次\c drawUploaded之前才需要直接调用.
+	 * \endif
+	 */
+	void sync() {
+		ensureBuffers();
+		int total = m_atlas->getTotalQuads();
+		if(total > m_capacity)
+			total = m_capacity;
+
+		// find changed quads, staging always mirrors latest uploaded content
+		if(m_dirty) {
+			for(int i = 0; i < total; i++)
+				interleave(i);
+			m_ranges.count = 0;
+		} else if(m_autoDetect) {
+			m_ranges.count = 0;
+			for(int i = 0; i < total; i++) {
+				if(interleave(i))
+					addRange(&m_ranges, i, i + 1, m_mergeGap);
+			}
+			if(total > m_uploadedQuads)
+				addRange(&m_ranges, m_uploadedQuads, total, m_mergeGap);
+		} else {
+			if(total > m_uploadedQuads)
+				addRange(&m_ranges, m_uploadedQuads, total, m_mergeGap);
+			for(int r = 0; r < m_ranges.count; r++) {
+				int end = m_ranges.ranges[r].end < total ? m_ranges.ranges[r].end : total;
+				for(int i = m_ranges.ranges[r].start; i < end; i++)
+					interleave(i);
+			}
+		}
+
+		// count quads to upload, back buffer of double buffering also misses last ranges
+		bool full = m_dirty;
+		int changed = 0;
+		for(int r = 0; r < m_ranges.count; r++)
+			changed += m_ranges.ranges[r].end - m_ranges.ranges[r].start;
+		if(m_mode == ATLAS_VBO_DOUBLE_BUFFER) {
+			if(!full && changed == 0 && m_prevRanges.count == 0) {
+				m_uploadedQuads = total;
+				return;
+			}
+		} else {
+			if(!full && changed == 0) {
+				m_uploadedQuads = total;
+				return;
+			}
+
+			// orphaning needs all content, worth it only when most quads changed
+			if(changed * 2 > total)
+				full = true;
+		}
+
+		wyGLState* gl = wyGLState::getInstance();
+		gl->begin();
+		if(m_mode == ATLAS_VBO_DOUBLE_BUFFER) {
+			if(full) {
+				// fill both buffers so that later uploads only need ranges
+				for(int i = 0; i < 2; i++) {
+					gl->bindBuffer(GL_ARRAY_BUFFER, m_vbo[i]);
+					uploadRange(0, total);
+				}
+				m_prevRanges.count = 0;
+			} else {
+				m_current = 1 - m_current;
+				gl->bindBuffer(GL_ARRAY_BUFFER, m_vbo[m_current]);
+
+				// swap lists, then add current ranges to previous ones for this upload
+				wyQuadRangeList tmp = m_prevRanges;
+				m_prevRanges = m_ranges;
+				m_ranges = tmp;
+				for(int r = 0; r < m_prevRanges.count; r++)
+					addRange(&m_ranges, m_prevRanges.ranges[r].start, m_prevRanges.ranges[r].end, m_mergeGap);
+				for(int r = 0; r < m_ranges.count; r++) {
+					int end = m_ranges.ranges[r].end < total ? m_ranges.ranges[r].end : total;
+					if(m_ranges.ranges[r].start < end)
+						uploadRange(m_ranges.ranges[r].start, end);
+				}
+			}
+		} else {
+			gl->bindBuffer(GL_ARRAY_BUFFER, m_vbo[0]);
+			if(full) {
+				glBufferData(GL_ARRAY_BUFFER, m_capacity * m_quadSize, NULL, GL_DYNAMIC_DRAW);
+				uploadRange(0, total);
+			} else {
+				for(int r = 0; r < m_ranges.count; r++) {
+					int end = m_ranges.ranges[r].end < total ? m_ranges.ranges[r].end : total;
+					if(m_ranges.ranges[r].start < end)
+						uploadRange(m_ranges.ranges[r].start, end);
+				}
+			}
+		}
+		gl->end();
+
+		m_ranges.count = 0;
+		m_uploadedQuads = total;
+		m_dirty = false;
+		m_uploadCount++;
+	}
+
+	/**
+	 * \if English
+	 * Draw a range of quads from VBO, must be called in OpenGL thread. Quads are synchronized
+	 * first. Texturing on unit 0, vertex and texture coordinate arrays are enabled and disabled by
+	 * this method, color array is used only if atlas has one.
+	 *
+	 * @param start index of first quad
+	 * @param numOfQuads number of quads
+	 * \else
+	 * 从VBO绘制一段矩形, 必须在OpenGL线程中调用. 绘制前会先同步矩形. 这个方法会打开和关闭单元0的贴图,
+	 * 顶点和贴图坐标数组, 只有atlas有颜色数组时才使用颜色数组.
+	 *
+	 * @param start 第一个矩形的索引
+	 * @param numOfQuads 矩形数
+	 * \endif
+	 */
+	void drawRange(int start, int numOfQuads) {
+		sync();
+
+		// engine turns texturing off between draws
+		wyGLState* gl = wyGLState::getInstance();
+		gl->begin();
+		gl->activeTexture(GL_TEXTURE0);
+		gl->enable(GL_TEXTURE_2D);
+		drawUploaded(start, numOfQuads);
+		gl->end();
+	}
+
+	/**
+	 * \if English
+	 * Draw a range of quads already uploaded by \c sync, without comparing quads again. Texturing
+	 * is not turned on by this method, engine turns \c GL_TEXTURE_2D off between draws so caller must
+	 * enable it on every unit used.
+	 *
+	 * @param start index of first quad
+	 * @param numOfQuads number of quads
+	 * @param bindTexture false means caller has bound textures, atlas texture is not bound
+	 * @param texCoordUnits number of texture units which take texture coordinates of quads
+	 * \else
+	 * 绘制一段已经通过\c sync上传的矩形, 不再比较矩形. 这个方法不打开贴图, 引擎在两次绘制之间关闭
+	 * \c GL_TEXTURE_2D, 因此调用者必须在用到的每个单元上打开它.
+	 *
+	 * @param start 第一个矩形的索引
+	 * @param numOfQuads 矩形数
+	 * @param bindTexture false表示调用者已经绑定了贴图, 不绑定atlas的贴图
+	 * @param texCoordUnits 使用矩形贴图坐标的贴图单元数
+	 * \endif
+	 */
+	void drawUploaded(int start, int numOfQuads, bool bindTexture = true, int texCoordUnits = 1) {
+		if(start + numOfQuads > m_uploadedQuads)
+			numOfQuads = m_uploadedQuads - start;
+		if(numOfQuads <= 0)
+			return;
+
+		// states are restored by outermost range, runs drawn in a range share client arrays
+		wyGLState* gl = wyGLState::getInstance();
+		gl->begin();
+		bool color = m_atlas->isWithColorArray();
+		if(bindTexture)
+			gl->bindTexture(m_atlas->getTexture()->getTexture());
+		gl->bindBuffer(GL_ARRAY_BUFFER, m_vbo[m_current]);
+		gl->bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+		gl->enableClientState(GL_VERTEX_ARRAY);
+		bool compact = m_format == ATLAS_VERTEX_COMPACT_2D;
+		if(compact)
+			glVertexPointer(2, GL_FLOAT, sizeof(wyCompactVertex), (const GLvoid*)offsetof(wyCompactVertex, x));
+		else
+			glVertexPointer(3, GL_FLOAT, sizeof(wyInterleavedVertex), (const GLvoid*)offsetof(wyInterleavedVertex, x));
+		for(int unit = 0; unit < texCoordUnits; unit++) {
+			if(texCoordUnits > 1) {
+				gl->clientActiveTexture(GL_TEXTURE0 + unit);
+				gl->activeTexture(GL_TEXTURE0 + unit);
+			}
+			gl->enableClientState(GL_TEXTURE_COORD_ARRAY);
+			if(compact) {
+				// fixed pipeline doesn't normalize short texture coordinates, scale by texture matrix
+				glTexCoordPointer(2, GL_SHORT, sizeof(wyCompactVertex), (const GLvoid*)offsetof(wyCompactVertex, u));
+				glMatrixMode(GL_TEXTURE);
+				glPushMatrix();
+				glLoadIdentity();
+				glScalef(1.f / WY_COMPACT_TEXCOORD_SCALE, 1.f / WY_COMPACT_TEXCOORD_SCALE, 1.f);
+				glMatrixMode(GL_MODELVIEW);
+			} else {
+				glTexCoordPointer(2, GL_FLOAT, sizeof(wyInterleavedVertex), (const GLvoid*)offsetof(wyInterleavedVertex, u));
+			}
+		}
+		if(color) {
+			gl->enableClientState(GL_COLOR_ARRAY);
+			if(compact)
+				glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(wyCompactVertex), (const GLvoid*)offsetof(wyCompactVertex, r));
+			else
+				glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(wyInterleavedVertex), (const GLvoid*)offsetof(wyInterleavedVertex, r));
+		} else {
+			gl->disableClientState(GL_COLOR_ARRAY);
+		}
+
+		glDrawElements(GL_TRIANGLES, numOfQuads * 6, GL_UNSIGNED_SHORT, (const GLvoid*)(start * 6 * sizeof(GLushort)));
+
+		if(compact) {
+			for(int unit = texCoordUnits - 1; unit >= 0; unit--) {
+				if(texCoordUnits > 1)
+					gl->activeTexture(GL_TEXTURE0 + unit);
+				glMatrixMode(GL_TEXTURE);
+				glPopMatrix();
+			}
+			glMatrixMode(GL_MODELVIEW);
+		}
+		gl->end();
+	}
+
+	/**
+	 * \if English
+	 * Draw all quads from VBO
+	 * \else
+	 * 从VBO绘制所有矩形
+	 * \endif
+	 */
+	void drawAll() { drawRange(0, m_atlas->getTotalQuads()); }
+
+	/// 得到上传次数
+	int getUploadCount() { return m_uploadCount; }
+
+	/// 得到上传的总字节数
+	size_t getUploadBytes() { return m_uploadBytes; }
+
+	/// 得到上传的总矩形数
+	int getUploadedQuadCount() { return m_uploadedQuadCount; }
+};
+
+#endif // __wyAtlasVBO_h__
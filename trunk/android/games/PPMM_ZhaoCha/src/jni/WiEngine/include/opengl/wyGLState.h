@@ -0,0 +1,596 @@
+/*
+ * Copyright (c) 2010 WiYun Inc.
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __wyGLState_h__
+#define __wyGLState_h__
+
+#if ANDROID
+	#include <GLES/gl.h>
+#elif IOS
+	#import <OpenGLES/ES1/gl.h>
+	#import <OpenGLES/ES1/glext.h>
+#endif
+#include <string.h>
+#include "wyObject.h"
+#include "wyDirector.h"
+#include "wyScheduler.h"
+#include "wyTargetSelector.h"
+
+/// 状态缓存跟踪的贴图单元数
+#define WY_GL_STATE_MAX_UNITS 4
+
+/**
+ * @typedef wyGLStateFlag
+ *
+ * 状态缓存跟踪的开关状态, 包括glEnable和glEnableClientState的开关
+ */
+typedef enum {
+	GL_STATE_BLEND,
+	GL_STATE_DITHER,
+	GL_STATE_ALPHA_TEST,
+	GL_STATE_DEPTH_TEST,
+	GL_STATE_SCISSOR_TEST,
+	GL_STATE_VERTEX_ARRAY,
+	GL_STATE_COLOR_ARRAY,
+	GL_STATE_NORMAL_ARRAY,
+
+	/// 每个贴图单元一个, 对应当前激活的贴图单元
+	GL_STATE_TEXTURE_2D,
+
+	/// 每个客户端贴图单元一个, 对应当前激活的客户端贴图单元
+	GL_STATE_TEXTURE_COORD_ARRAY = GL_STATE_TEXTURE_2D + WY_GL_STATE_MAX_UNITS,
+
+	GL_STATE_FLAG_COUNT = GL_STATE_TEXTURE_COORD_ARRAY + WY_GL_STATE_MAX_UNITS
+} wyGLStateFlag;
+
+/**
+ * @struct wyGLCachedValue
+ *
+ * 一个被缓存的状态值
+ */
+typedef struct wyGLCachedValue {
+	/// true表示当前值已知
+	bool known;
+
+	/// 当前值
+	GLint value;
+
+	/// 进入缓存范围时的值, 离开最外层范围时恢复
+	GLint original;
+} wyGLCachedValue;
+
+/**
+ * @class wyGLState
+ *
+ * \if English
+ * Thin OpenGL state cache. Binds, blend state, capabilities, client arrays, buffers and current
+ * color set through this class are skipped if state already matches, and skipped calls are counted.
+ *
+ * Prebuilt engine nodes call OpenGL directly, so the cache only trusts what it sees between
+ * \c begin and \c end. The first time a state is touched in a frame its current value is queried,
+ * at the end of outermost range every touched state goes back to its value at beginning, so code
+ * outside never sees a difference. Ranges can nest, inner \c end does nothing, so a helper which
+ * brackets its own calls can run inside a bigger range of caller and share the cache.
+ *
+ * Engine nodes put state back to engine defaults after they draw, so states are seeded once per frame
+ * instead of queried: texturing and client arrays are off, unit 0 is active and no buffer is bound. Other
+ * states are queried the first time they are touched in a frame, learned values are still valid for
+ * later ranges of same frame. Texture bindings are not restored by anyone, they are forgotten at every
+ * outermost \c begin, binding a texture whose current binding is unknown is issued without a query.
+ * Learning a state is a synchronous query on most GLES drivers, queries are counted by \c getQueries.
+ * If code inside a frame leaves a state different from engine default, call \c invalidate.
+ * \else
+ * 一个很薄的OpenGL状态缓存. 通过这个类设置的贴图绑定, 混合状态, 开关, 客户端数组, 缓冲和当前颜色
+ * 如果和当前状态相同则会被跳过, 并且跳过的调用会被计数.
+ *
+ * 预编译的引擎节点直接调用OpenGL, 因此缓存只信任在\c begin和\c end之间看到的状态. 一个状态在一帧内
+ * 第一次被使用时会查询它的当前值, 最外层范围结束时所有用过的状态都恢复到范围开始时的值, 因此范围
+ * 之外的代码看不到任何区别. 范围可以嵌套, 内层的\c end什么也不做, 因此自己有范围的辅助方法可以在调用者
+ * 更大的范围内执行并共享缓存.
+ *
+ * 引擎节点绘制后会把状态恢复为引擎的缺省状态, 因此每帧用缺省值填充一次状态而不是查询: 贴图和客户端数组
+ * 关闭, 单元0激活, 没有绑定缓冲. 其它状态在一帧中第一次被使用时查询, 学习到的值对同一帧后面的范围仍然有效.
+ * 贴图绑定没有人恢复, 每个最外层\c begin都会忘记, 绑定一个当前绑定未知的贴图时直接执行, 不做查询. 在大部分GLES驱动上学习一个状态是一次同步查询, 查询数由\c getQueries
+ * 统计. 如果一帧中有代码没有把状态恢复为引擎缺省状态, 需要调用\c invalidate.
+ * \endif
+ */
+class wyGLState : public wyObject {
+private:
+	/// 范围嵌套深度
+	int m_depth;
+
+	/// true表示新的一帧开始了, 下一个最外层范围需要重新学习状态
+	bool m_stale;
+
+	/// 每帧标记一次状态过期的定时器
+	wyTimer* m_timer;
+
+	/// 开关状态
+	wyGLCachedValue m_flags[GL_STATE_FLAG_COUNT];
+
+	/// 每个单元绑定的贴图, 不需要恢复, 因此也不需要查询
+	wyGLCachedValue m_textures[WY_GL_STATE_MAX_UNITS];
+
+	/// 激活的贴图单元
+	wyGLCachedValue m_activeTexture;
+
+	/// 激活的客户端贴图单元
+	wyGLCachedValue m_clientActiveTexture;
+
+	/// 混合源因子
+	wyGLCachedValue m_blendSrc;
+
+	/// 混合目标因子
+	wyGLCachedValue m_blendDst;
+
+	/// 绑定的顶点缓冲
+	wyGLCachedValue m_arrayBuffer;
+
+	/// 绑定的索引缓冲
+	wyGLCachedValue m_elementBuffer;
+
+	/// true表示当前颜色已知
+	bool m_colorKnown;
+
+	/// 当前颜色
+	GLfloat m_color[4];
+
+	/// 进入范围时的颜色
+	GLfloat m_originalColor[4];
+
+	/// 实际执行的调用数
+	int m_issuedCalls;
+
+	/// 被跳过的调用数
+	int m_elidedCalls;
+
+	/// 学习状态时执行的查询数
+	int m_queries;
+
+private:
+	wyGLState() :
+			m_depth(0),
+			m_stale(true),
+			m_issuedCalls(0),
+			m_elidedCalls(0),
+			m_queries(0) {
+		invalidate();
+
+		wyDirectorLifecycleListener l;
+		memset(&l, 0, sizeof(wyDirectorLifecycleListener));
+		l.onSurfaceCreated = onSurfaceCreated;
+		wyDirector::getInstance()->addLifecycleListener(&l, this);
+
+		// scheduler ticks once per frame before scene is drawn
+		m_timer = wyTimer::make(wyTargetSelector::make(this, 0, NULL));
+		m_timer->retain();
+		wyScheduler::getInstance()->scheduleLocked(m_timer);
+	}
+
+	static void onSurfaceCreated(void* data) {
+		wyGLState* state = (wyGLState*)data;
+		state->m_depth = 0;
+		state->m_stale = true;
+		state->invalidate();
+	}
+
+	/// 得到开关对应的OpenGL常量
+	static GLenum capOf(int flag) {
+		switch(flag) {
+			case GL_STATE_BLEND:
+				return GL_BLEND;
+			case GL_STATE_DITHER:
+				return GL_DITHER;
+			case GL_STATE_ALPHA_TEST:
+				return GL_ALPHA_TEST;
+			case GL_STATE_DEPTH_TEST:
+				return GL_DEPTH_TEST;
+			case GL_STATE_SCISSOR_TEST:
+				return GL_SCISSOR_TEST;
+			case GL_STATE_VERTEX_ARRAY:
+				return GL_VERTEX_ARRAY;
+			case GL_STATE_COLOR_ARRAY:
+				return GL_COLOR_ARRAY;
+			case GL_STATE_NORMAL_ARRAY:
+				return GL_NORMAL_ARRAY;
+			default:
+				if(flag >= GL_STATE_TEXTURE_COORD_ARRAY)
+					return GL_TEXTURE_COORD_ARRAY;
+				else
+					return GL_TEXTURE_2D;
+		}
+	}
+
+	static bool isClientFlag(int flag) {
+		return (flag >= GL_STATE_VERTEX_ARRAY && flag <= GL_STATE_NORMAL_ARRAY) || flag >= GL_STATE_TEXTURE_COORD_ARRAY;
+	}
+
+	/// 得到OpenGL常量对应的开关, 不跟踪的常量返回-1
+	int flagOf(GLenum cap) {
+		switch(cap) {
+			case GL_BLEND:
+				return GL_STATE_BLEND;
+			case GL_DITHER:
+				return GL_STATE_DITHER;
+			case GL_ALPHA_TEST:
+				return GL_STATE_ALPHA_TEST;
+			case GL_DEPTH_TEST:
+				return GL_STATE_DEPTH_TEST;
+			case GL_SCISSOR_TEST:
+				return GL_STATE_SCISSOR_TEST;
+			case GL_VERTEX_ARRAY:
+				return GL_STATE_VERTEX_ARRAY;
+			case GL_COLOR_ARRAY:
+				return GL_STATE_COLOR_ARRAY;
+			case GL_NORMAL_ARRAY:
+				return GL_STATE_NORMAL_ARRAY;
+			case GL_TEXTURE_2D:
+			{
+				int unit = activeUnit();
+				return unit < WY_GL_STATE_MAX_UNITS ? GL_STATE_TEXTURE_2D + unit : -1;
+			}
+			case GL_TEXTURE_COORD_ARRAY:
+			{
+				int unit = clientActiveUnit();
+				return unit < WY_GL_STATE_MAX_UNITS ? GL_STATE_TEXTURE_COORD_ARRAY + unit : -1;
+			}
+			default:
+				return -1;
+		}
+	}
+
+	/// 第一次使用时查询当前值
+	void learn(wyGLCachedValue* v, GLenum pname) {
+		if(!v->known) {
+			m_queries++;
+			glGetIntegerv(pname, &v->value);
+			v->original = v->value;
+			v->known = true;
+		}
+	}
+
+	int activeUnit() {
+		learn(&m_activeTexture, GL_ACTIVE_TEXTURE);
+		return m_activeTexture.value - GL_TEXTURE0;
+	}
+
+	int clientActiveUnit() {
+		learn(&m_clientActiveTexture, GL_CLIENT_ACTIVE_TEXTURE);
+		return m_clientActiveTexture.value - GL_TEXTURE0;
+	}
+
+	/// 设置一个开关
+	void setFlag(GLenum cap, bool client, bool on) {
+		int flag = m_depth > 0 ? flagOf(cap) : -1;
+		if(flag >= 0) {
+			wyGLCachedValue* v = &m_flags[flag];
+			if(!v->known) {
+				m_queries++;
+				v->value = glIsEnabled(cap);
+				v->original = v->value;
+				v->known = true;
+			}
+			if((v->value != 0) == on) {
+				m_elidedCalls++;
+				return;
+			}
+			v->value = on;
+		}
+
+		m_issuedCalls++;
+		if(client) {
+			if(on)
+				glEnableClientState(cap);
+			else
+				glDisableClientState(cap);
+		} else {
+			if(on)
+				glEnable(cap);
+			else
+				glDisable(cap);
+		}
+	}
+
+	/// 设置一个绑定类的值, 返回false表示和当前值相同
+	bool setValue(wyGLCachedValue* v, GLenum pname, GLint value) {
+		if(m_depth > 0) {
+			learn(v, pname);
+			if(v->value == value) {
+				m_elidedCalls++;
+				return false;
+			}
+			v->value = value;
+		}
+		m_issuedCalls++;
+		return true;
+	}
+
+	static bool isChanged(wyGLCachedValue* v) {
+		return v->known && v->value != v->original;
+	}
+
+	static void resetValue(wyGLCachedValue* v) {
+		v->known = false;
+	}
+
+	static void seedValue(wyGLCachedValue* v, GLint value) {
+		v->known = true;
+		v->value = value;
+		v->original = value;
+	}
+
+	/// 用引擎在两次绘制之间的缺省状态填充缓存, 不需要查询
+	void seedDefaults() {
+		for(int i = GL_STATE_VERTEX_ARRAY; i < GL_STATE_FLAG_COUNT; i++)
+			seedValue(&m_flags[i], GL_FALSE);
+		seedValue(&m_activeTexture, GL_TEXTURE0);
+		seedValue(&m_clientActiveTexture, GL_TEXTURE0);
+		seedValue(&m_arrayBuffer, 0);
+		seedValue(&m_elementBuffer, 0);
+	}
+
+public:
+	/**
+	 * 获得\link wyGLState wyGLState\endlink单例, 第一次调用必须在OpenGL线程中, 因为需要调度每帧的定时器
+	 *
+	 * @return \link wyGLState wyGLState\endlink
+	 */
+	static wyGLState* getInstance() {
+		static wyGLState* s_instance = NULL;
+		if(s_instance == NULL)
+			s_instance = new wyGLState();
+		return s_instance;
+	}
+
+	virtual ~wyGLState() {
+		wyScheduler::getInstance()->unscheduleLocked(m_timer);
+		m_timer->release();
+	}
+
+	virtual void onTargetSelectorInvoked(wyTargetSelector* ts) {
+		m_stale = true;
+	}
+
+	/**
+	 * \if English
+	 * Begin a cached range, must be called in OpenGL thread. Outermost \c begin forgets texture
+	 * bindings because engine nodes bind textures freely, and forgets all states in first range of
+	 * a frame.
+	 * \else
+	 * 开始一个缓存范围, 必须在OpenGL线程中调用. 最外层的\c begin会忘记贴图绑定, 因为引擎节点随意绑定贴图,
+	 * 一帧中的第一个范围会忘记所有状态.
+	 * \endif
+	 */
+	void begin() {
+		if(m_depth++ == 0) {
+			if(m_stale) {
+				invalidate();
+				seedDefaults();
+				m_stale = false;
+			} else {
+				for(int i = 0; i < WY_GL_STATE_MAX_UNITS; i++)
+					resetValue(&m_textures[i]);
+			}
+		}
+	}
+
+	/**
+	 * \if English
+	 * End a cached range. Outermost \c end restores every state touched in range to its value at
+	 * beginning, only states which really differ are set.
+	 * \else
+	 * 结束一个缓存范围. 最外层的\c end把范围内用过的状态恢复到范围开始时的值, 只设置确实不同的状态.
+	 * \endif
+	 */
+	void end() {
+		if(m_depth <= 0 || --m_depth > 0)
+			return;
+
+		// flags of texture units are restored with their units active, so keep range open for now
+		m_depth = 1;
+		for(int i = 0; i < GL_STATE_FLAG_COUNT; i++) {
+			wyGLCachedValue* v = &m_flags[i];
+			if(!v->known || v->value == v->original)
+				continue;
+			bool client = isClientFlag(i);
+			if(i >= GL_STATE_TEXTURE_COORD_ARRAY)
+				clientActiveTexture(GL_TEXTURE0 + i - GL_STATE_TEXTURE_COORD_ARRAY);
+			else if(i >= GL_STATE_TEXTURE_2D)
+				activeTexture(GL_TEXTURE0 + i - GL_STATE_TEXTURE_2D);
+			setFlag(capOf(i), client, v->original != 0);
+		}
+		if(m_blendSrc.known && (m_blendSrc.value != m_blendSrc.original || m_blendDst.value != m_blendDst.original))
+			blendFunc(m_blendSrc.original, m_blendDst.original);
+		if(isChanged(&m_arrayBuffer))
+			bindBuffer(GL_ARRAY_BUFFER, m_arrayBuffer.original);
+		if(isChanged(&m_elementBuffer))
+			bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_elementBuffer.original);
+		if(isChanged(&m_clientActiveTexture))
+			clientActiveTexture(m_clientActiveTexture.original);
+		if(isChanged(&m_activeTexture))
+			activeTexture(m_activeTexture.original);
+		if(m_colorKnown && memcmp(m_color, m_originalColor, sizeof(m_color)) != 0)
+			color4f(m_originalColor[0], m_originalColor[1], m_originalColor[2], m_originalColor[3]);
+		m_depth = 0;
+	}
+
+	/**
+	 * \if English
+	 * Forget all cached states, call it if OpenGL is called directly inside a range, or if state is
+	 * left different from engine defaults between ranges
+	 * \else
+	 * 忘记所有缓存的状态, 如果在范围内直接调用了OpenGL, 或者在范围之间状态没有恢复为引擎缺省状态, 需要调用
+	 * 这个方法
+	 * \endif
+	 */
+	void invalidate() {
+		for(int i = 0; i < GL_STATE_FLAG_COUNT; i++)
+			resetValue(&m_flags[i]);
+		for(int i = 0; i < WY_GL_STATE_MAX_UNITS; i++)
+			resetValue(&m_textures[i]);
+		resetValue(&m_activeTexture);
+		resetValue(&m_clientActiveTexture);
+		resetValue(&m_blendSrc);
+		resetValue(&m_blendDst);
+		resetValue(&m_arrayBuffer);
+		resetValue(&m_elementBuffer);
+		m_colorKnown = false;
+	}
+
+	/// 是否在缓存范围内
+	bool isInRange() { return m_depth > 0; }
+
+	/// 同glEnable
+	void enable(GLenum cap) { setFlag(cap, false, true); }
+
+	/// 同glDisable
+	void disable(GLenum cap) { setFlag(cap, false, false); }
+
+	/// 同glEnableClientState
+	void enableClientState(GLenum array) { setFlag(array, true, true); }
+
+	/// 同glDisableClientState
+	void disableClientState(GLenum array) { setFlag(array, true, false); }
+
+	/// 同glActiveTexture
+	void activeTexture(GLenum unit) {
+		if(setValue(&m_activeTexture, GL_ACTIVE_TEXTURE, unit))
+			glActiveTexture(unit);
+	}
+
+	/// 同glClientActiveTexture
+	void clientActiveTexture(GLenum unit) {
+		if(setValue(&m_clientActiveTexture, GL_CLIENT_ACTIVE_TEXTURE, unit))
+			glClientActiveTexture(unit);
+	}
+
+	/// 同glBindTexture(GL_TEXTURE_2D, texture), 绑定到当前激活的贴图单元
+	void bindTexture(GLuint texture) {
+		int unit = m_depth > 0 ? activeUnit() : -1;
+		if(unit >= 0 && unit < WY_GL_STATE_MAX_UNITS) {
+			wyGLCachedValue* v = &m_textures[unit];
+			if(v->known && v->value == (GLint)texture) {
+				m_elidedCalls++;
+				return;
+			}
+			v->value = texture;
+			v->known = true;
+		}
+		m_issuedCalls++;
+		glBindTexture(GL_TEXTURE_2D, texture);
+	}
+
+	/// 同glBlendFunc
+	void blendFunc(GLenum src, GLenum dst) {
+		if(m_depth > 0) {
+			learn(&m_blendSrc, GL_BLEND_SRC);
+			learn(&m_blendDst, GL_BLEND_DST);
+			if(m_blendSrc.value == (GLint)src && m_blendDst.value == (GLint)dst) {
+				m_elidedCalls++;
+				return;
+			}
+			m_blendSrc.value = src;
+			m_blendDst.value = dst;
+		}
+		m_issuedCalls++;
+		glBlendFunc(src, dst);
+	}
+
+	/// 同glBindBuffer, 只跟踪GL_ARRAY_BUFFER和GL_ELEMENT_ARRAY_BUFFER
+	void bindBuffer(GLenum target, GLuint buffer) {
+		bool changed;
+		if(target == GL_ARRAY_BUFFER)
+			changed = setValue(&m_arrayBuffer, GL_ARRAY_BUFFER_BINDING, buffer);
+		else
+			changed = setValue(&m_elementBuffer, GL_ELEMENT_ARRAY_BUFFER_BINDING, buffer);
+		if(changed)
+			glBindBuffer(target, buffer);
+	}
+
+	/**
+	 * \if English
+	 * Forget a deleted buffer, so that a new buffer which gets same name is bound again
+	 *
+	 * @param buffer deleted buffer
+	 * \else
+	 * 忘记一个被删除的缓冲, 这样得到相同名字的新缓冲会被重新绑定
+	 *
+	 * @param buffer 被删除的缓冲
+	 * \endif
+	 */
+	void forgetBuffer(GLuint buffer) {
+		if(m_arrayBuffer.known && m_arrayBuffer.value == (GLint)buffer)
+			m_arrayBuffer.value = 0;
+		if(m_elementBuffer.known && m_elementBuffer.value == (GLint)buffer)
+			m_elementBuffer.value = 0;
+	}
+
+	/// 同glColor4f
+	void color4f(GLfloat r, GLfloat g, GLfloat b, GLfloat a) {
+		if(m_depth > 0) {
+			if(!m_colorKnown) {
+				m_queries++;
+				glGetFloatv(GL_CURRENT_COLOR, m_color);
+				memcpy(m_originalColor, m_color, sizeof(m_color));
+				m_colorKnown = true;
+			}
+			if(m_color[0] == r && m_color[1] == g && m_color[2] == b && m_color[3] == a) {
+				m_elidedCalls++;
+				return;
+			}
+			m_color[0] = r;
+			m_color[1] = g;
+			m_color[2] = b;
+			m_color[3] = a;
+		}
+		m_issuedCalls++;
+		glColor4f(r, g, b, a);
+	}
+
+	/// 以0到255的分量设置当前颜色
+	void color4ub(GLubyte r, GLubyte g, GLubyte b, GLubyte a) { color4f(r / 255.f, g / 255.f, b / 255.f, a / 255.f); }
+
+	/// 得到实际执行的调用数
+	int getIssuedCalls() { return m_issuedCalls; }
+
+	/// 得到被跳过的调用数, 实际节省的调用数要减去\c getQueries
+	int getElidedCalls() { return m_elidedCalls; }
+
+	/**
+	 * \if English
+	 * Get count of \c glGetIntegerv, \c glIsEnabled and \c glGetFloatv issued to learn states. They are
+	 * synchronous on most GLES drivers, so they cost at least as much as a state call.
+	 * \else
+	 * 得到为了学习状态执行的\c glGetIntegerv, \c glIsEnabled和\c glGetFloatv调用数. 它们在大部分GLES驱动上
+	 * 是同步的, 因此代价至少和一次状态调用相当.
+	 * \endif
+	 */
+	int getQueries() { return m_queries; }
+
+	/// 清空调用计数
+	void resetCounters() {
+		m_issuedCalls = 0;
+		m_elidedCalls = 0;
+		m_queries = 0;
+	}
+};
+
+#endif // __wyGLState_h__
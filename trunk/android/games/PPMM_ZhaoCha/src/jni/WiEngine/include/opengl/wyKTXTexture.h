@@ -0,0 +1,558 @@
+/*
+ * Copyright (c) 2010 WiYun Inc.
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __wyKTXTexture_h__
+#define __wyKTXTexture_h__
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "wyTexture2D.h"
+#include "wyGLTexture2D.h"
+#include "wyDirector.h"
+#include "wyArray.h"
+#include "wyUtils.h"
+#include "wyTextureCaps.h"
+#include "wyLog.h"
+
+#ifndef GL_ETC1_RGB8_OES
+	#define GL_ETC1_RGB8_OES 0x8D64
+#endif
+
+/// KTX文件头部的endianness字段值
+#define WY_KTX_ENDIANNESS 0x04030201
+
+/**
+ * @typedef wyETC1AlphaMode
+ *
+ * ETC1贴图的透明通道存放方式, ETC1本身只有RGB
+ */
+typedef enum {
+	/// 没有透明通道
+	ETC1_ALPHA_NONE,
+
+	/// 透明通道存放在另一个KTX文件中, 文件名是在扩展名前加上_alpha, 比如a.ktx的透明通道在a_alpha.ktx中, 取R分量
+	ETC1_ALPHA_SEPARATE,
+
+	/// 图片的下半部分是透明通道, 取R分量, 贴图高度是文件中高度的一半
+	ETC1_ALPHA_BOTTOM_HALF
+} wyETC1AlphaMode;
+
+/**
+ * @struct wyKTXHeader
+ *
+ * KTX文件头部结构
+ */
+typedef struct wyKTXHeader {
+	uint8_t identifier[12];
+	uint32_t endianness;
+	uint32_t glType;
+	uint32_t glTypeSize;
+	uint32_t glFormat;
+	uint32_t glInternalFormat;
+	uint32_t glBaseInternalFormat;
+	uint32_t pixelWidth;
+	uint32_t pixelHeight;
+	uint32_t pixelDepth;
+	uint32_t numberOfArrayElements;
+	uint32_t numberOfFaces;
+	uint32_t numberOfMipmapLevels;
+	uint32_t bytesOfKeyValueData;
+} wyKTXHeader;
+
+/**
+ * @class wyKTXTexture
+ *
+ * \if English
+ * Loads ETC1 textures stored in KTX container. ETC1 takes 4 bits per pixel, it is 1/8 of RGBA8888
+ * and 1/4 of RGB565, and unlike PVRTC it is supported by almost every OpenGL ES GPU. When driver
+ * has \c GL_OES_compressed_ETC1_RGB8_texture, data is uploaded as is with \c glCompressedTexImage2D,
+ * including all mipmap levels, and is uploaded again to same texture name when surface is created.
+ * Otherwise, blocks are decoded on CPU and texture is created by \c wyTexture2D::makeRaw in a
+ * fallback format, so game works everywhere.
+ *
+ * ETC1 has no alpha channel. Alpha can be stored in a second KTX file or in bottom half of image,
+ * see \link wyETC1AlphaMode wyETC1AlphaMode\endlink. Fixed pipeline can't combine two textures
+ * for a node drawn by engine, so images with alpha are merged on CPU and go fallback path too.
+ * \else
+ * 载入KTX容器中的ETC1贴图. ETC1每个像素占4位, 是RGBA8888的1/8, RGB565的1/4, 而且和PVRTC不同, 几乎所有
+ * OpenGL ES的GPU都支持. 如果驱动支持\c GL_OES_compressed_ETC1_RGB8_texture, 数据用\c glCompressedTexImage2D
+ * 直接上传, 包括所有mipmap级别, 并且在surface创建时重新上传到相同的贴图名字上. 否则在CPU上解码数据块, 并
+ * 通过\c wyTexture2D::makeRaw以后备格式创建贴图, 因此游戏在任何设备上都能运行.
+ *
+ * ETC1没有透明通道. 透明通道可以存放在另一个KTX文件中, 或者图片的下半部分, 参见\link wyETC1AlphaMode wyETC1AlphaMode\endlink.
+ * 固定管线无法为引擎绘制的节点合并两个贴图, 所以带透明通道的图片在CPU上合并, 也走后备路径.
+ * \endif
+ */
+class wyKTXTexture : public wyObject {
+private:
+	/// 需要在surface创建时重新上传的压缩贴图
+	typedef struct wyCompressedTexture {
+		/// 路径, 为NULL表示数据来自内存
+		const char* path;
+
+		/// true表示\c path是文件系统路径
+		bool isFile;
+
+		/// 数据来自内存时保存的KTX数据拷贝
+		char* data;
+
+		/// \c data的长度
+		int length;
+
+		/// OpenGL贴图名字
+		GLuint texture;
+	} wyCompressedTexture;
+
+	/// 压缩贴图列表
+	wyArray* m_compressed;
+
+	/// 是否已经检查过扩展
+	bool m_checked;
+
+	/// 是否支持ETC1
+	bool m_etc1;
+
+	/// 以压缩格式上传的字节数
+	size_t m_compressedBytes;
+
+	/// 在CPU上解码的贴图数
+	int m_decodeCount;
+
+private:
+	wyKTXTexture() :
+			m_compressed(wyArrayNew(16)),
+			m_checked(false),
+			m_etc1(false),
+			m_compressedBytes(0),
+			m_decodeCount(0) {
+		wyDirectorLifecycleListener l;
+		memset(&l, 0, sizeof(wyDirectorLifecycleListener));
+		l.onSurfaceCreated = onSurfaceCreated;
+		wyDirector::getInstance()->addLifecycleListener(&l, this);
+	}
+
+	static void onSurfaceCreated(void* data) {
+		((wyKTXTexture*)data)->restoreAll();
+	}
+
+	static wyKTXTexture* getInstance() {
+		static wyKTXTexture* s_instance = NULL;
+		if(s_instance == NULL)
+			s_instance = new wyKTXTexture();
+		return s_instance;
+	}
+
+	static inline uint32_t readUInt32(const uint8_t* p) {
+		uint32_t v;
+		memcpy(&v, p, 4);
+		return v;
+	}
+
+	/// 检查KTX数据, 成功时返回第一个mipmap级别的偏移
+	static int parseHeader(const char* data, int length, wyKTXHeader* header) {
+		static const uint8_t identifier[12] = {
+			0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+		};
+
+		if(data == NULL || length < (int)sizeof(wyKTXHeader))
+			return -1;
+		memcpy(header, data, sizeof(wyKTXHeader));
+		if(memcmp(header->identifier, identifier, 12) != 0) {
+			LOGW("wyKTXTexture: not a KTX file");
+			return -1;
+		}
+		if(header->endianness != WY_KTX_ENDIANNESS) {
+			LOGW("wyKTXTexture: KTX file with swapped endianness is not supported");
+			return -1;
+		}
+		if(header->glInternalFormat != GL_ETC1_RGB8_OES) {
+			LOGW("wyKTXTexture: unsupported internal format 0x%x", header->glInternalFormat);
+			return -1;
+		}
+		int offset = sizeof(wyKTXHeader) + header->bytesOfKeyValueData;
+		if(offset + 4 > length)
+			return -1;
+		if(header->numberOfMipmapLevels == 0)
+			header->numberOfMipmapLevels = 1;
+		return offset;
+	}
+
+	/// 解码一个ETC1数据块到RGBA8888, stride是目标一行的像素数, 超出bw, bh的像素被忽略
+	static void decodeBlock(const uint8_t* block, uint8_t* out, int stride, int bw, int bh) {
+		static const int modifiers[8][4] = {
+			{ 2, 8, -2, -8 },
+			{ 5, 17, -5, -17 },
+			{ 9, 29, -9, -29 },
+			{ 13, 42, -13, -42 },
+			{ 18, 60, -18, -60 },
+			{ 24, 80, -24, -80 },
+			{ 33, 106, -33, -106 },
+			{ 47, 183, -47, -183 }
+		};
+
+		int base[2][3];
+		bool diff = (block[3] & 2) != 0;
+		bool flip = (block[3] & 1) != 0;
+		for(int c = 0; c < 3; c++) {
+			if(diff) {
+				int c1 = block[c] >> 3;
+				int d = block[c] & 7;
+				int c2 = c1 + (d >= 4 ? d - 8 : d);
+				base[0][c] = (c1 << 3) | (c1 >> 2);
+				base[1][c] = ((c2 & 0x1F) << 3) | ((c2 & 0x1F) >> 2);
+			} else {
+				base[0][c] = (block[c] >> 4) * 17;
+				base[1][c] = (block[c] & 0xF) * 17;
+			}
+		}
+		const int* table[2] = { modifiers[block[3] >> 5], modifiers[(block[3] >> 2) & 7] };
+
+		uint32_t msb = (block[4] << 8) | block[5];
+		uint32_t lsb = (block[6] << 8) | block[7];
+		for(int x = 0; x < bw; x++) {
+			for(int y = 0; y < bh; y++) {
+				int i = x * 4 + y;
+				int sub = flip ? (y >= 2) : (x >= 2);
+				int m = table[sub][(((msb >> i) & 1) << 1) | ((lsb >> i) & 1)];
+				uint8_t* p = out + (y * stride + x) * 4;
+				for(int c = 0; c < 3; c++) {
+					int v = base[sub][c] + m;
+					p[c] = v < 0 ? 0 : (v > 255 ? 255 : v);
+				}
+				p[3] = 0xFF;
+			}
+		}
+	}
+
+	/// 解码KTX的第一个mipmap级别到RGBA8888, 返回的像素由调用者释放
+	static char* decodeKTX(const char* data, int length, int* w, int* h) {
+		wyKTXHeader header;
+		int offset = parseHeader(data, length, &header);
+		if(offset < 0)
+			return NULL;
+
+		int width = header.pixelWidth;
+		int height = header.pixelHeight;
+		int bx = (width + 3) / 4;
+		int by = (height + 3) / 4;
+		uint32_t imageSize = readUInt32((const uint8_t*)data + offset);
+		if(imageSize < (uint32_t)bx * by * 8 || offset + 4 + (int)imageSize > length) {
+			LOGW("wyKTXTexture: truncated ETC1 data");
+			return NULL;
+		}
+
+		const uint8_t* block = (const uint8_t*)data + offset + 4;
+		uint8_t* rgba = (uint8_t*)malloc((size_t)width * height * 4);
+		for(int y = 0; y < by; y++) {
+			for(int x = 0; x < bx; x++, block += 8) {
+				int bw = width - x * 4;
+				int bh = height - y * 4;
+				decodeBlock(block, rgba + ((size_t)y * 4 * width + x * 4) * 4, width, bw < 4 ? bw : 4, bh < 4 ? bh : 4);
+			}
+		}
+		*w = width;
+		*h = height;
+		return (char*)rgba;
+	}
+
+	/// 得到透明通道文件的路径, 返回的字符串需要调用者释放
+	static char* alphaPathFor(const char* path) {
+		const char* dot = strrchr(path, '.');
+		const char* slash = strrchr(path, '/');
+		if(dot == NULL || (slash != NULL && dot < slash))
+			dot = path + strlen(path);
+		int prefix = dot - path;
+		char* alphaPath = (char*)malloc(strlen(path) + 7);
+		memcpy(alphaPath, path, prefix);
+		strcpy(alphaPath + prefix, "_alpha");
+		strcat(alphaPath, dot);
+		return alphaPath;
+	}
+
+	/// 把压缩数据的所有mipmap级别上传到一个贴图, 失败返回false
+	bool uploadCompressed(const char* data, int length, GLuint texture) {
+		wyKTXHeader header;
+		int offset = parseHeader(data, length, &header);
+		if(offset < 0)
+			return false;
+
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, header.numberOfMipmapLevels > 1 ? GL_LINEAR_MIPMAP_NEAREST : GL_LINEAR);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		int w = header.pixelWidth;
+		int h = header.pixelHeight;
+		for(uint32_t level = 0; level < header.numberOfMipmapLevels; level++) {
+			if(offset + 4 > length)
+				return false;
+			uint32_t imageSize = readUInt32((const uint8_t*)data + offset);
+			if(offset + 4 + (int)imageSize > length)
+				return false;
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, GL_ETC1_RGB8_OES, w, h, 0, imageSize, data + offset + 4);
+			m_compressedBytes += imageSize;
+			offset += 4 + ((imageSize + 3) & ~3);
+			w = w > 1 ? w / 2 : 1;
+			h = h > 1 ? h / 2 : 1;
+		}
+		return true;
+	}
+
+	/// 在CPU上解码并合并透明通道, 然后用makeRaw创建贴图
+	wyTexture2D* makeDecoded(const char* data, int length, const char* path, bool isFile, wyETC1AlphaMode alpha, wyTexturePixelFormat format) {
+		int w, h;
+		char* rgba = decodeKTX(data, length, &w, &h);
+		if(rgba == NULL)
+			return NULL;
+
+		if(alpha == ETC1_ALPHA_BOTTOM_HALF) {
+			h /= 2;
+			for(int i = 0; i < w * h; i++)
+				rgba[i * 4 + 3] = rgba[((size_t)w * h + i) * 4];
+		} else if(alpha == ETC1_ALPHA_SEPARATE && path != NULL) {
+			char* alphaPath = alphaPathFor(path);
+			int alphaLength = 0;
+			char* alphaData = wyUtils::loadRaw(alphaPath, isFile, &alphaLength);
+			int aw = 0, ah = 0;
+			char* a = decodeKTX(alphaData, alphaLength, &aw, &ah);
+			if(a != NULL && aw == w && ah == h) {
+				for(int i = 0; i < w * h; i++)
+					rgba[i * 4 + 3] = a[i * 4];
+			} else {
+				LOGW("wyKTXTexture: can't load alpha of %s from %s", path, alphaPath);
+			}
+			if(a)
+				free(a);
+			if(alphaData)
+				free(alphaData);
+			free(alphaPath);
+		}
+
+		// makeRaw copies pixels
+		m_decodeCount++;
+		wyTexture2D* tex = wyTexture2D::makeRaw(rgba, w, h, format);
+		free(rgba);
+		return tex;
+	}
+
+	wyTexture2D* make(const char* data, int length, const char* path, bool isFile, wyETC1AlphaMode alpha, wyTexturePixelFormat format) {
+		wyKTXHeader header;
+		if(parseHeader(data, length, &header) < 0)
+			return NULL;
+
+		// compressed path only when driver accepts this size as is
+		int texWidth, texHeight;
+		wyTextureCaps::getInstance()->textureSize(header.pixelWidth, header.pixelHeight, &texWidth, &texHeight);
+		if(alpha != ETC1_ALPHA_NONE || !isETC1Supported() ||
+				texWidth != (int)header.pixelWidth || texHeight != (int)header.pixelHeight)
+			return makeDecoded(data, length, path, isFile, alpha, format);
+
+		GLuint texture;
+		glGenTextures(1, &texture);
+		if(!uploadCompressed(data, length, texture)) {
+			glDeleteTextures(1, &texture);
+			return makeDecoded(data, length, path, isFile, alpha, format);
+		}
+
+		wyCompressedTexture* ct = (wyCompressedTexture*)malloc(sizeof(wyCompressedTexture));
+		ct->path = path == NULL ? NULL : wyUtils::copy(path);
+		ct->isFile = isFile;
+		ct->data = NULL;
+		ct->length = 0;
+		if(path == NULL) {
+			ct->data = (char*)malloc(length);
+			memcpy(ct->data, data, length);
+			ct->length = length;
+		}
+		ct->texture = texture;
+		wyArrayPush(m_compressed, ct);
+		return wyTexture2D::makeGL(texture, header.pixelWidth, header.pixelHeight);
+	}
+
+	wyTexture2D* makeFromPath(const char* path, bool isFile, wyETC1AlphaMode alpha, wyTexturePixelFormat format) {
+		int length = 0;
+		char* data = wyUtils::loadRaw(path, isFile, &length);
+		if(data == NULL) {
+			LOGW("wyKTXTexture: can't load %s", path);
+			return NULL;
+		}
+		wyTexture2D* tex = make(data, length, path, isFile, alpha, format);
+		free(data);
+		return tex;
+	}
+
+	void restoreAll() {
+		for(int i = 0; i < m_compressed->num; i++) {
+			wyCompressedTexture* ct = (wyCompressedTexture*)wyArrayGet(m_compressed, i);
+			if(ct->path == NULL) {
+				uploadCompressed(ct->data, ct->length, ct->texture);
+			} else {
+				int length = 0;
+				char* data = wyUtils::loadRaw(ct->path, ct->isFile, &length);
+				if(data == NULL || !uploadCompressed(data, length, ct->texture))
+					LOGW("wyKTXTexture: can't restore %s", ct->path);
+				if(data)
+					free(data);
+			}
+		}
+	}
+
+public:
+	/**
+	 * \if English
+	 * Does driver support ETC1 compressed textures. OpenGL surface must be created before first call.
+	 * \else
+	 * 驱动是否支持ETC1压缩贴图. 第一次调用前OpenGL surface必须已经创建.
+	 * \endif
+	 */
+	static bool isETC1Supported() {
+		wyKTXTexture* inst = getInstance();
+		if(!inst->m_checked) {
+			inst->m_etc1 = wyDirector::getInstance()->isExtensionSupported("GL_OES_compressed_ETC1_RGB8_texture");
+			inst->m_checked = true;
+		}
+		return inst->m_etc1;
+	}
+
+	/**
+	 * \if English
+	 * Create texture from a KTX file in assets
+	 *
+	 * @param assetPath path of KTX file in assets
+	 * @param alpha how alpha channel is stored
+	 * @param format pixel format used when ETC1 has to be decoded on CPU
+	 * @return \link wyTexture2D wyTexture2D\endlink, NULL if failed
+	 * \else
+	 * 从assets中的KTX文件创建贴图
+	 *
+	 * @param assetPath KTX文件在assets中的路径
+	 * @param alpha 透明通道的存放方式
+	 * @param format 需要在CPU上解码ETC1时使用的像素格式
+	 * @return \link wyTexture2D wyTexture2D\endlink, 失败返回NULL
+	 * \endif
+	 */
+	static wyTexture2D* makeKTX(const char* assetPath, wyETC1AlphaMode alpha = ETC1_ALPHA_NONE, wyTexturePixelFormat format = WY_TEXTURE_PIXEL_FORMAT_RGB565) {
+		return getInstance()->makeFromPath(assetPath, false, alpha, format);
+	}
+
+	/**
+	 * \if English
+	 * Create texture from a KTX file in file system
+	 *
+	 * @see makeKTX
+	 * \else
+	 * 从文件系统中的KTX文件创建贴图
+	 *
+	 * @see makeKTX
+	 * \endif
+	 */
+	static wyTexture2D* makeFileKTX(const char* fsPath, wyETC1AlphaMode alpha = ETC1_ALPHA_NONE, wyTexturePixelFormat format = WY_TEXTURE_PIXEL_FORMAT_RGB565) {
+		return getInstance()->makeFromPath(fsPath, true, alpha, format);
+	}
+
+	/**
+	 * \if English
+	 * Create texture from KTX data in memory, data is copied if it has to be uploaded again.
+	 * \c ETC1_ALPHA_SEPARATE is not supported because there is no path to derive alpha file.
+	 *
+	 * @param data KTX data
+	 * @param length length of data
+	 * @param alpha how alpha channel is stored
+	 * @param format pixel format used when ETC1 has to be decoded on CPU
+	 * @return \link wyTexture2D wyTexture2D\endlink, NULL if failed
+	 * \else
+	 * 从内存中的KTX数据创建贴图, 如果需要重新上传, 数据会被拷贝. 不支持\c ETC1_ALPHA_SEPARATE, 因为没有路径
+	 * 可以得到透明通道文件.
+	 *
+	 * @param data KTX数据
+	 * @param length 数据长度
+	 * @param alpha 透明通道的存放方式
+	 * @param format 需要在CPU上解码ETC1时使用的像素格式
+	 * @return \link wyTexture2D wyTexture2D\endlink, 失败返回NULL
+	 * \endif
+	 */
+	static wyTexture2D* makeKTX(const char* data, int length, wyETC1AlphaMode alpha = ETC1_ALPHA_NONE, wyTexturePixelFormat format = WY_TEXTURE_PIXEL_FORMAT_RGB565) {
+		return getInstance()->make(data, length, NULL, false, alpha, format);
+	}
+
+	/**
+	 * \if English
+	 * Decode first mipmap level of a KTX file with ETC1 data on CPU
+	 *
+	 * @param data KTX data
+	 * @param length length of data
+	 * @param w returns width
+	 * @param h returns height
+	 * @return pixels in RGBA8888 format, caller should free it. NULL if failed
+	 * \else
+	 * 在CPU上解码一个ETC1数据的KTX文件的第一个mipmap级别
+	 *
+	 * @param data KTX数据
+	 * @param length 数据长度
+	 * @param w 返回宽度
+	 * @param h 返回高度
+	 * @return RGBA8888格式的像素, 调用者负责释放. 失败返回NULL
+	 * \endif
+	 */
+	static char* decode(const char* data, int length, int* w, int* h) {
+		return decodeKTX(data, length, w, h);
+	}
+
+	/**
+	 * \if English
+	 * Delete a compressed texture created by this class, it won't be uploaded again. Textures
+	 * decoded on CPU are managed by engine and can be removed by \link wyTextureManager wyTextureManager\endlink.
+	 *
+	 * @param tex texture returned by \c makeKTX or \c makeFileKTX
+	 * \else
+	 * 删除一个由这个类创建的压缩贴图, 它不会再被重新上传. 在CPU上解码的贴图由引擎管理, 可以通过
+	 * \link wyTextureManager wyTextureManager\endlink删除.
+	 *
+	 * @param tex \c makeKTX或\c makeFileKTX返回的贴图
+	 * \endif
+	 */
+	static void releaseKTX(wyTexture2D* tex) {
+		wyArray* compressed = getInstance()->m_compressed;
+		GLuint texture = tex->getTexture();
+		for(int i = compressed->num - 1; i >= 0; i--) {
+			wyCompressedTexture* ct = (wyCompressedTexture*)wyArrayGet(compressed, i);
+			if(ct->texture == texture) {
+				wyArrayDeleteIndex(compressed, i);
+				glDeleteTextures(1, &ct->texture);
+				if(ct->path)
+					free((void*)ct->path);
+				if(ct->data)
+					free(ct->data);
+				free(ct);
+			}
+		}
+	}
+
+	/// 得到以压缩格式上传的总字节数
+	static size_t getCompressedBytes() { return getInstance()->m_compressedBytes; }
+
+	/// 得到在CPU上解码的贴图数
+	static int getDecodeCount() { return getInstance()->m_decodeCount; }
+};
+
+#endif // __wyKTXTexture_h__
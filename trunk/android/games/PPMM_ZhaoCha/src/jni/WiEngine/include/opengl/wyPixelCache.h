@@ -0,0 +1,498 @@
+/*
+ * Copyright (c) 2010 WiYun Inc.
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __wyPixelCache_h__
+#define __wyPixelCache_h__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "wyObject.h"
+#include "wyArray.h"
+#include "wyGLTexture2D.h"
+#include "wyDirector.h"
+#include "wyPixelConvert.h"
+#include "wyTextureCaps.h"
+#include "wyLatencyTracker.h"
+#include "wyLog.h"
+
+/// 像素缓存文件的魔数
+#define WY_PIXEL_CACHE_MAGIC 0x43505957
+
+/// 像素缓存文件的版本
+#define WY_PIXEL_CACHE_VERSION 1
+
+/**
+ * @struct wyCachedPixels
+ *
+ * 从像素缓存中映射出的像素数据
+ */
+typedef struct wyCachedPixels {
+	/// 映射的起始地址
+	void* base;
+
+	/// 映射的长度
+	size_t length;
+
+	/// 像素数据, 已经是\c format格式
+	const char* pixels;
+
+	/// 宽度
+	int width;
+
+	/// 高度
+	int height;
+
+	/// 贴图格式
+	wyTexturePixelFormat format;
+
+	/// 上传后贴图的宽度, 不支持非2的幂贴图时大于\c width
+	int texWidth;
+
+	/// 上传后贴图的高度, 不支持非2的幂贴图时大于\c height
+	int texHeight;
+} wyCachedPixels;
+
+/**
+ * @class wyPixelCache
+ *
+ * \if English
+ * Disk cache of decoded, format-converted pixels. When OpenGL context is lost, every texture
+ * has to be decoded from PNG/JPG again, so resuming from background is slow. Pixels stored
+ * in this cache are memory mapped instead, so reloading a texture is only a mmap plus
+ * glTexImage2D. Entries are keyed by source (path, resource name or MFS name) and pixel format.
+ *
+ * Textures uploaded by \c upload and registered with \c registerTexture are restored
+ * automatically from cache when surface is created again, into same OpenGL texture name.
+ * \else
+ * 解码并转换过格式的像素的磁盘缓存. OpenGL上下文丢失后, 所有贴图都必须从PNG/JPG重新解码,
+ * 因此从后台恢复很慢. 存在这个缓存中的像素则是通过内存映射读取, 重新载入贴图只需要一次mmap加上
+ * glTexImage2D. 缓存项以来源(路径, 资源名或内存文件名)和贴图格式为键.
+ *
+ * 通过\c upload上传并用\c registerTexture注册的贴图, 在surface重新创建时会自动从缓存恢复到
+ * 相同的OpenGL贴图名字上.
+ * \endif
+ */
+class wyPixelCache : public wyObject {
+private:
+	/// 注册的需要恢复的贴图
+	typedef struct wyRestorableTexture {
+		/// 来源
+		const char* source;
+
+		/// 贴图格式
+		wyTexturePixelFormat format;
+
+		/// OpenGL贴图名字
+		GLuint texture;
+	} wyRestorableTexture;
+
+	/// 缓存目录, 为NULL表示缓存没有启用
+	const char* m_directory;
+
+	/// 注册的需要恢复的贴图
+	wyArray* m_restorables;
+
+	/// 缓存命中次数
+	int m_hits;
+
+	/// 缓存未命中次数
+	int m_misses;
+
+	/// 上次恢复的贴图数
+	int m_lastRestoreCount;
+
+	/// 上次恢复花费的时间, 单位微秒
+	int64_t m_lastRestoreTime;
+
+private:
+	wyPixelCache() :
+			m_directory(NULL),
+			m_restorables(wyArrayNew(16)),
+			m_hits(0),
+			m_misses(0),
+			m_lastRestoreCount(0),
+			m_lastRestoreTime(0) {
+		wyDirectorLifecycleListener l;
+		memset(&l, 0, sizeof(wyDirectorLifecycleListener));
+		l.onSurfaceCreated = onSurfaceCreated;
+		wyDirector::getInstance()->addLifecycleListener(&l, this);
+	}
+
+	static void onSurfaceCreated(void* data) {
+		((wyPixelCache*)data)->restoreAll();
+	}
+
+	/// 得到缓存文件路径, 返回的字符串需要调用者释放
+	char* pathFor(const char* source, wyTexturePixelFormat format) {
+		int len = strlen(m_directory) + 32;
+		char* path = (char*)malloc(len);
+		snprintf(path, len, "%s/%08x_%d.pix", m_directory, hash(source), format);
+		return path;
+	}
+
+public:
+	/**
+	 * \if English
+	 * Get singleton
+	 * \else
+	 * 得到单例
+	 * \endif
+	 */
+	static wyPixelCache* getInstance() {
+		static wyPixelCache* s_instance = NULL;
+		if(s_instance == NULL)
+			s_instance = new wyPixelCache();
+		return s_instance;
+	}
+
+	/**
+	 * \if English
+	 * FNV-1a hash of a string, used to name cache files
+	 * \else
+	 * 字符串的FNV-1a哈希值, 用于缓存文件命名
+	 * \endif
+	 */
+	static uint32_t hash(const char* s) {
+		uint32_t h = 2166136261u;
+		while(*s) {
+			h ^= (uint8_t)*s++;
+			h *= 16777619u;
+		}
+		return h;
+	}
+
+	virtual ~wyPixelCache() {
+		for(int i = 0; i < m_restorables->num; i++) {
+			wyRestorableTexture* rt = (wyRestorableTexture*)wyArrayGet(m_restorables, i);
+			free((void*)rt->source);
+			free(rt);
+		}
+		wyArrayDestroy(m_restorables);
+		if(m_directory)
+			free((void*)m_directory);
+	}
+
+	/**
+	 * \if English
+	 * Set cache directory, cache is disabled until a directory is set
+	 *
+	 * @param dir writable directory in file system, such as cache directory of application.
+	 * 		NULL disables cache
+	 * \else
+	 * 设置缓存目录, 设置目录之前缓存不起作用
+	 *
+	 * @param dir 文件系统中可写的目录, 比如应用的缓存目录. NULL表示禁用缓存
+	 * \endif
+	 */
+	void setDirectory(const char* dir) {
+		if(m_directory)
+			free((void*)m_directory);
+		m_directory = NULL;
+		if(dir) {
+			mkdir(dir, 0755);
+			m_directory = wyUtils::copy(dir);
+		}
+	}
+
+	/// 缓存是否启用
+	bool isEnabled() { return m_directory != NULL; }
+
+	/**
+	 * \if English
+	 * Store pixels into cache, pixels are converted to \c format before writing
+	 *
+	 * @param source source of pixels, such as asset path
+	 * @param format pixel format to store
+	 * @param rgba pixels in RGBA8888 format
+	 * @param width width of image
+	 * @param height height of image
+	 * @param dither dithering mode used when converting to 16 bits formats
+	 * @return true if stored
+	 * \else
+	 * 把像素存入缓存, 写入前像素被转换为\c format格式
+	 *
+	 * @param source 像素的来源, 比如assets路径
+	 * @param format 存储的贴图格式
+	 * @param rgba RGBA8888格式的像素
+	 * @param width 图片宽度
+	 * @param height 图片高度
+	 * @param dither 转换为16位格式时使用的抖动方式
+	 * @return true表示存储成功
+	 * \endif
+	 */
+	bool store(const char* source, wyTexturePixelFormat format, const char* rgba, int width, int height, wyDitherMode dither = DITHER_NONE) {
+		if(!isEnabled())
+			return false;
+
+		int count = width * height;
+		size_t size = (size_t)count * wyPixelConvert::bytesPerPixel(format);
+		char* pixels = (char*)malloc(size);
+		if(pixels == NULL)
+			return false;
+		wyPixelConvert::convertImage(rgba, width, height, format, pixels, dither);
+
+		// write to a temp file and rename, so a half written file is never mapped
+		char* path = pathFor(source, format);
+		int len = strlen(path) + 5;
+		char* tmp = (char*)malloc(len);
+		snprintf(tmp, len, "%s.tmp", path);
+
+		bool ok = false;
+		FILE* f = fopen(tmp, "wb");
+		if(f) {
+			uint32_t srcLen = strlen(source);
+			uint32_t header[6] = { WY_PIXEL_CACHE_MAGIC, WY_PIXEL_CACHE_VERSION, (uint32_t)width, (uint32_t)height, (uint32_t)format, srcLen };
+			uint32_t pad = 0;
+			ok = fwrite(header, sizeof(header), 1, f) == 1 &&
+					fwrite(source, srcLen, 1, f) == 1 &&
+					fwrite(&pad, (4 - srcLen % 4) % 4, 1, f) <= 1 &&
+					fwrite(pixels, size, 1, f) == 1;
+			ok = fclose(f) == 0 && ok;
+			ok = ok && rename(tmp, path) == 0;
+			if(!ok)
+				unlink(tmp);
+		}
+
+		free(tmp);
+		free(path);
+		free(pixels);
+		return ok;
+	}
+
+	/**
+	 * \if English
+	 * Map cached pixels
+	 *
+	 * @param source source of pixels
+	 * @param format pixel format
+	 * @param out returns mapped pixels, must be released by \c close
+	 * @return true if cache hits
+	 * \else
+	 * 映射缓存的像素
+	 *
+	 * @param source 像素的来源
+	 * @param format 贴图格式
+	 * @param out 返回映射的像素, 必须通过\c close释放
+	 * @return true表示缓存命中
+	 * \endif
+	 */
+	bool open(const char* source, wyTexturePixelFormat format, wyCachedPixels* out) {
+		memset(out, 0, sizeof(wyCachedPixels));
+		if(!isEnabled())
+			return false;
+
+		char* path = pathFor(source, format);
+		int fd = ::open(path, O_RDONLY);
+		free(path);
+		if(fd < 0) {
+			m_misses++;
+			return false;
+		}
+
+		struct stat st;
+		void* base = MAP_FAILED;
+		if(fstat(fd, &st) == 0 && st.st_size > (off_t)(6 * sizeof(uint32_t)))
+			base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if(base == MAP_FAILED) {
+			m_misses++;
+			return false;
+		}
+
+		// validate header and source, hash of file name may collide
+		const uint32_t* header = (const uint32_t*)base;
+		uint32_t srcLen = strlen(source);
+		size_t offset = 6 * sizeof(uint32_t) + srcLen + (4 - srcLen % 4) % 4;
+		size_t size = (size_t)header[2] * header[3] * wyPixelConvert::bytesPerPixel(format);
+		if(header[0] != WY_PIXEL_CACHE_MAGIC || header[1] != WY_PIXEL_CACHE_VERSION ||
+				header[4] != (uint32_t)format || header[5] != srcLen ||
+				(size_t)st.st_size != offset + size ||
+				memcmp((const char*)base + 6 * sizeof(uint32_t), source, srcLen) != 0) {
+			munmap(base, st.st_size);
+			m_misses++;
+			return false;
+		}
+
+		out->base = base;
+		out->length = st.st_size;
+		out->pixels = (const char*)base + offset;
+		out->width = header[2];
+		out->height = header[3];
+		out->format = format;
+		m_hits++;
+		return true;
+	}
+
+	/**
+	 * \if English
+	 * Unmap pixels returned by \c open
+	 *
+	 * @param cp mapped pixels
+	 * \else
+	 * 释放\c open返回的映射
+	 *
+	 * @param cp 映射的像素
+	 * \endif
+	 */
+	void close(wyCachedPixels* cp) {
+		if(cp->base) {
+			munmap(cp->base, cp->length);
+			memset(cp, 0, sizeof(wyCachedPixels));
+		}
+	}
+
+	/**
+	 * \if English
+	 * Upload mapped pixels to an OpenGL texture, must be called in OpenGL thread. Texture has
+	 * exact image size if driver supports npot textures, otherwise it is padded to power of two
+	 * and \c texWidth, \c texHeight of \c cp are set to padded size.
+	 *
+	 * @param cp mapped pixels
+	 * @param texture OpenGL texture name to upload to, 0 means generating a new one
+	 * @return OpenGL texture name
+	 * \else
+	 * 把映射的像素上传到OpenGL贴图, 必须在OpenGL线程中调用. 如果驱动支持非2的幂贴图, 贴图和图片
+	 * 大小相同, 否则补齐到2的幂, 并且\c cp的\c texWidth, \c texHeight被设置为补齐后的大小.
+	 *
+	 * @param cp 映射的像素
+	 * @param texture 上传到的OpenGL贴图名字, 0表示生成一个新的
+	 * @return OpenGL贴图名字
+	 * \endif
+	 */
+	GLuint upload(wyCachedPixels* cp, GLuint texture = 0) {
+		if(texture == 0)
+			glGenTextures(1, &texture);
+
+		GLenum glFormat, glType;
+		wyPixelConvert::glFormatOf(cp->format, &glFormat, &glType);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, wyPixelConvert::bytesPerPixel(cp->format));
+		wyTextureCaps::getInstance()->textureSize(cp->width, cp->height, &cp->texWidth, &cp->texHeight);
+		if(cp->texWidth == cp->width && cp->texHeight == cp->height) {
+			glTexImage2D(GL_TEXTURE_2D, 0, glFormat, cp->width, cp->height, 0, glFormat, glType, cp->pixels);
+		} else {
+			glTexImage2D(GL_TEXTURE_2D, 0, glFormat, cp->texWidth, cp->texHeight, 0, glFormat, glType, NULL);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, cp->width, cp->height, glFormat, glType, cp->pixels);
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		return texture;
+	}
+
+	/**
+	 * \if English
+	 * Register a texture which should be restored from cache when surface is created again.
+	 * The texture is uploaded into same name, so \link wyTexture2D wyTexture2D\endlink created
+	 * by \c wyTexture2D::makeGL with this name keeps working.
+	 *
+	 * @param source source of pixels
+	 * @param format pixel format
+	 * @param texture OpenGL texture name
+	 * \else
+	 * 注册一个在surface重新创建时需要从缓存恢复的贴图. 贴图会被上传到相同的名字上, 因此用这个名字
+	 * 通过\c wyTexture2D::makeGL创建的\link wyTexture2D wyTexture2D\endlink可以继续使用.
+	 *
+	 * @param source 像素的来源
+	 * @param format 贴图格式
+	 * @param texture OpenGL贴图名字
+	 * \endif
+	 */
+	void registerTexture(const char* source, wyTexturePixelFormat format, GLuint texture) {
+		wyRestorableTexture* rt = (wyRestorableTexture*)malloc(sizeof(wyRestorableTexture));
+		rt->source = wyUtils::copy(source);
+		rt->format = format;
+		rt->texture = texture;
+		wyArrayPush(m_restorables, rt);
+	}
+
+	/**
+	 * \if English
+	 * Unregister a texture
+	 *
+	 * @param texture OpenGL texture name
+	 * \else
+	 * 取消注册一个贴图
+	 *
+	 * @param texture OpenGL贴图名字
+	 * \endif
+	 */
+	void unregisterTexture(GLuint texture) {
+		for(int i = m_restorables->num - 1; i >= 0; i--) {
+			wyRestorableTexture* rt = (wyRestorableTexture*)wyArrayGet(m_restorables, i);
+			if(rt->texture == texture) {
+				wyArrayDeleteIndex(m_restorables, i);
+				free((void*)rt->source);
+				free(rt);
+			}
+		}
+	}
+
+	/**
+	 * \if English
+	 * Restore all registered textures from cache, called automatically when surface is created
+	 * \else
+	 * 从缓存恢复所有注册的贴图, 在surface创建时被自动调用
+	 * \endif
+	 */
+	void restoreAll() {
+		int64_t start = wyLatencyTracker::currentTimeMicros();
+		int count = 0;
+		for(int i = 0; i < m_restorables->num; i++) {
+			wyRestorableTexture* rt = (wyRestorableTexture*)wyArrayGet(m_restorables, i);
+			wyCachedPixels cp;
+			if(open(rt->source, rt->format, &cp)) {
+				upload(&cp, rt->texture);
+				close(&cp);
+				count++;
+			} else {
+				LOGW("wyPixelCache: can't restore %s, cache missed", rt->source);
+			}
+		}
+
+		m_lastRestoreCount = count;
+		m_lastRestoreTime = wyLatencyTracker::currentTimeMicros() - start;
+		if(count > 0)
+			LOGD("wyPixelCache: restored %d textures in %.2fms", count, m_lastRestoreTime / 1000.f);
+	}
+
+	/// 得到缓存命中次数
+	int getHitCount() { return m_hits; }
+
+	/// 得到缓存未命中次数
+	int getMissCount() { return m_misses; }
+
+	/// 得到上次恢复的贴图数
+	int getLastRestoreCount() { return m_lastRestoreCount; }
+
+	/// 得到上次恢复花费的时间, 单位毫秒
+	float getLastRestoreTime() { return m_lastRestoreTime / 1000.f; }
+};
+
+#endif // __wyPixelCache_h__
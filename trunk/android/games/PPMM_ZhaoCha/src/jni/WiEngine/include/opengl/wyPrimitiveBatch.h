@@ -0,0 +1,483 @@
+/*
+ * Copyright (c) 2010 WiYun Inc.
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __wyPrimitiveBatch_h__
+#define __wyPrimitiveBatch_h__
+
+#include <stdlib.h>
+#include <math.h>
+#include "wyObject.h"
+#include "wyTypes.h"
+#include "wyStreamBuffer.h"
+
+/// 粗线折角的最大斜接长度, 以线宽的一半为单位, 超过时截断
+#define WY_PRIMITIVE_MITER_LIMIT 4.f
+
+/**
+ * @typedef wyPrimitiveList
+ *
+ * 一个图元类型的顶点列表
+ */
+typedef struct wyPrimitiveList {
+	/// 顶点
+	wyStreamVertex* vertices;
+
+	/// 顶点数
+	int count;
+
+	/// \c vertices能容纳的顶点数
+	int capacity;
+} wyPrimitiveList;
+
+/**
+ * @class wyPrimitiveBatch
+ *
+ * \if English
+ * Batched replacement of \c wyDrawLine, \c wyDrawRect, \c wyDrawPoly, \c wyDrawCircle and
+ * \c wyDrawDashPath. Those functions issue one \c glDrawArrays each with their own client array and
+ * use current color. This class accumulates lines, rectangles, circles, polygons and dashes with per
+ * vertex color and draws all of them through \link wyStreamBuffer wyStreamBuffer\endlink, at most
+ * one draw for hairlines and one for filled shapes and thick lines. Lists bigger than ring of
+ * \link wyStreamBuffer wyStreamBuffer\endlink are split into several draws on primitive boundaries.
+ *
+ * Thick lines are triangulated, so they don't depend on \c glLineWidth which many drivers limit to a
+ * few pixels. Joins of thick paths are mitered, and cut at \c WY_PRIMITIVE_MITER_LIMIT.
+ *
+ * Content is kept after \c draw, so shapes which don't change are added once and drawn every frame.
+ * Call \c clear to rebuild. Coordinates are in space of current model view matrix, the same as
+ * \c wyDrawXXX functions.
+ * \else
+ * \c wyDrawLine, \c wyDrawRect, \c wyDrawPoly, \c wyDrawCircle和\c wyDrawDashPath的批处理替代. 那些函数每次
+ * 调用都使用自己的客户端数组和当前颜色执行一次\c glDrawArrays. 这个类收集带有顶点颜色的线, 矩形, 圆,
+ * 多边形和虚线, 然后通过\link wyStreamBuffer wyStreamBuffer\endlink全部绘制, 细线最多一次绘制, 填充图形
+ * 和粗线最多一次绘制. 超过\link wyStreamBuffer wyStreamBuffer\endlink环形缓冲的列表按图元边界拆分为多次绘制.
+ *
+ * 粗线被三角化, 因此不依赖\c glLineWidth, 很多驱动把线宽限制在几个像素. 粗路径的折角使用斜接, 超过
+ * \c WY_PRIMITIVE_MITER_LIMIT时截断.
+ *
+ * \c draw之后内容仍然保留, 因此不变的图形只需要添加一次, 然后每帧绘制. 调用\c clear重新构建. 坐标在当前
+ * 模型视图矩阵的空间中, 和\c wyDrawXXX函数相同.
+ * \endif
+ */
+class wyPrimitiveBatch : public wyObject {
+private:
+	/// 三角形, 用于填充图形和粗线
+	wyPrimitiveList m_triangles;
+
+	/// 线段, 用于细线
+	wyPrimitiveList m_lines;
+
+private:
+	wyPrimitiveBatch() {
+		memset(&m_triangles, 0, sizeof(wyPrimitiveList));
+		memset(&m_lines, 0, sizeof(wyPrimitiveList));
+	}
+
+	static wyStreamVertex* reserve(wyPrimitiveList* list, int count) {
+		if(list->count + count > list->capacity) {
+			int capacity = list->capacity * 2;
+			if(capacity < list->count + count)
+				capacity = list->count + count;
+			list->vertices = (wyStreamVertex*)realloc(list->vertices, capacity * sizeof(wyStreamVertex));
+			list->capacity = capacity;
+		}
+		wyStreamVertex* v = list->vertices + list->count;
+		list->count += count;
+		return v;
+	}
+
+	static void setVertex(wyStreamVertex* v, float x, float y, wyColor4B c) {
+		v->x = x;
+		v->y = y;
+		v->u = 0;
+		v->v = 0;
+		v->r = c.r;
+		v->g = c.g;
+		v->b = c.b;
+		v->a = c.a;
+	}
+
+	/// 分段追加顶点, 一次追加不能超过环形缓冲, 每段是\c unit的整数倍, 不拆开图元
+	static void appendChunks(wyStreamBuffer* stream, GLenum mode, wyPrimitiveList* list, int unit) {
+		int max = stream->getMaxAppendVertices();
+		max -= max % unit;
+		if(max <= 0)
+			return;
+		for(int start = 0; start < list->count; start += max) {
+			int count = list->count - start;
+			if(count > max)
+				count = max;
+			stream->append(mode, 0, list->vertices + start, count);
+		}
+	}
+
+	void addTriangle(float x1, float y1, float x2, float y2, float x3, float y3, wyColor4B color) {
+		wyStreamVertex* v = reserve(&m_triangles, 3);
+		setVertex(v, x1, y1, color);
+		setVertex(v + 1, x2, y2, color);
+		setVertex(v + 2, x3, y3, color);
+	}
+
+	void addQuad(float x1, float y1, float x2, float y2, float x3, float y3, float x4, float y4, wyColor4B color) {
+		addTriangle(x1, y1, x2, y2, x3, y3, color);
+		addTriangle(x1, y1, x3, y3, x4, y4, color);
+	}
+
+public:
+	/**
+	 * 静态构造函数
+	 */
+	static wyPrimitiveBatch* make() {
+		wyPrimitiveBatch* b = new wyPrimitiveBatch();
+		return (wyPrimitiveBatch*)b->autoRelease();
+	}
+
+	virtual ~wyPrimitiveBatch() {
+		if(m_triangles.vertices)
+			free(m_triangles.vertices);
+		if(m_lines.vertices)
+			free(m_lines.vertices);
+	}
+
+	/**
+	 * \if English
+	 * Remove all shapes, memory is kept for next frame
+	 * \else
+	 * 删除所有图形, 内存被保留给下一帧使用
+	 * \endif
+	 */
+	void clear() {
+		m_triangles.count = 0;
+		m_lines.count = 0;
+	}
+
+	/**
+	 * \if English
+	 * Draw all shapes, must be called in OpenGL thread, usually in \c draw of a node
+	 * \else
+	 * 绘制所有图形, 必须在OpenGL线程中调用, 一般是在节点的\c draw中
+	 * \endif
+	 */
+	void draw() {
+		if(m_triangles.count == 0 && m_lines.count == 0)
+			return;
+		wyStreamBuffer* stream = wyStreamBuffer::getInstance();
+		stream->begin();
+		appendChunks(stream, GL_TRIANGLES, &m_triangles, 3);
+		appendChunks(stream, GL_LINES, &m_lines, 2);
+		stream->end();
+	}
+
+	/// 添加一条细线
+	void addLine(float x1, float y1, float x2, float y2, wyColor4B color) {
+		wyStreamVertex* v = reserve(&m_lines, 2);
+		setVertex(v, x1, y1, color);
+		setVertex(v + 1, x2, y2, color);
+	}
+
+	/**
+	 * \if English
+	 * Add a polyline or polygon outline
+	 *
+	 * @param points even positions are x, odd positions are y
+	 * @param length length of points, it is number of points multiplied by 2
+	 * @param close true to connect last point to first
+	 * @param color color
+	 * \else
+	 * 添加一条折线或者多边形轮廓
+	 *
+	 * @param points 偶数位置是x坐标，奇数位置是y坐标
+	 * @param length points长度，是点数乘以2，注意不是点数
+	 * @param close 是否闭合
+	 * @param color 颜色
+	 * \endif
+	 */
+	void addPoly(const float* points, int length, bool close, wyColor4B color) {
+		int n = length / 2;
+		for(int i = 0; i + 1 < n; i++)
+			addLine(points[i * 2], points[i * 2 + 1], points[i * 2 + 2], points[i * 2 + 3], color);
+		if(close && n > 2)
+			addLine(points[n * 2 - 2], points[n * 2 - 1], points[0], points[1], color);
+	}
+
+	/**
+	 * \if English
+	 * Add a filled convex polygon
+	 *
+	 * @param points even positions are x, odd positions are y
+	 * @param length length of points, it is number of points multiplied by 2
+	 * @param color color
+	 * \else
+	 * 添加一个填充的凸多边形
+	 *
+	 * @param points 偶数位置是x坐标，奇数位置是y坐标
+	 * @param length points长度，是点数乘以2，注意不是点数
+	 * @param color 颜色
+	 * \endif
+	 */
+	void addSolidPoly(const float* points, int length, wyColor4B color) {
+		int n = length / 2;
+		for(int i = 1; i + 1 < n; i++)
+			addTriangle(points[0], points[1], points[i * 2], points[i * 2 + 1], points[i * 2 + 2], points[i * 2 + 3], color);
+	}
+
+	/// 添加一个矩形轮廓
+	void addRect(wyRect r, wyColor4B color) {
+		float p[] = {
+			r.x, r.y,
+			r.x + r.width, r.y,
+			r.x + r.width, r.y + r.height,
+			r.x, r.y + r.height
+		};
+		addPoly(p, 8, true, color);
+	}
+
+	/// 添加一个填充的矩形
+	void addSolidRect(wyRect r, wyColor4B color) {
+		addQuad(r.x, r.y, r.x + r.width, r.y, r.x + r.width, r.y + r.height, r.x, r.y + r.height, color);
+	}
+
+	/**
+	 * \if English
+	 * Add a circle outline
+	 *
+	 * @param centerX x of center
+	 * @param centerY y of center
+	 * @param r radius
+	 * @param segments number of segments
+	 * @param color color
+	 * \else
+	 * 添加一个圆的轮廓
+	 *
+	 * @param centerX 圆心x位置
+	 * @param centerY 圆心y位置
+	 * @param r 半径
+	 * @param segments 圆周分段数，分段越多越近似圆形
+	 * @param color 颜色
+	 * \endif
+	 */
+	void addCircle(float centerX, float centerY, float r, int segments, wyColor4B color) {
+		float step = 2 * M_PI / segments;
+		float px = centerX + r;
+		float py = centerY;
+		for(int i = 1; i <= segments; i++) {
+			float x = centerX + r * cosf(step * i);
+			float y = centerY + r * sinf(step * i);
+			addLine(px, py, x, y, color);
+			px = x;
+			py = y;
+		}
+	}
+
+	/// 添加一个填充的圆, 参数同\c addCircle
+	void addSolidCircle(float centerX, float centerY, float r, int segments, wyColor4B color) {
+		float step = 2 * M_PI / segments;
+		float px = centerX + r;
+		float py = centerY;
+		for(int i = 1; i <= segments; i++) {
+			float x = centerX + r * cosf(step * i);
+			float y = centerY + r * sinf(step * i);
+			addTriangle(centerX, centerY, px, py, x, y, color);
+			px = x;
+			py = y;
+		}
+	}
+
+	/**
+	 * \if English
+	 * Add a dashed path
+	 *
+	 * @param points even positions are x, odd positions are y
+	 * @param length length of points, it is number of points multiplied by 2
+	 * @param dashLength length of a dash and of a gap
+	 * @param color color
+	 * \else
+	 * 添加一条虚线路径
+	 *
+	 * @param points 偶数位置是x坐标，奇数位置是y坐标
+	 * @param length points长度，是点数乘以2，注意不是点数
+	 * @param dashLength 虚线和间隔的长度
+	 * @param color 颜色
+	 * \endif
+	 */
+	void addDashPath(const float* points, int length, float dashLength, wyColor4B color) {
+		if(dashLength <= 0) {
+			addPoly(points, length, false, color);
+			return;
+		}
+
+		// phase carries over corners so dashes keep their rhythm
+		float phase = 0;
+		bool on = true;
+		int n = length / 2;
+		for(int i = 0; i + 1 < n; i++) {
+			float x1 = points[i * 2];
+			float y1 = points[i * 2 + 1];
+			float dx = points[i * 2 + 2] - x1;
+			float dy = points[i * 2 + 3] - y1;
+			float len = sqrtf(dx * dx + dy * dy);
+			if(len <= 0)
+				continue;
+			float t = 0;
+			while(t < len) {
+				float end = t + dashLength - phase;
+				if(end > len)
+					end = len;
+				if(on)
+					addLine(x1 + dx * t / len, y1 + dy * t / len, x1 + dx * end / len, y1 + dy * end / len, color);
+				phase += end - t;
+				if(phase >= dashLength) {
+					phase = 0;
+					on = !on;
+				}
+				t = end;
+			}
+		}
+	}
+
+	/// 添加一条虚线
+	void addDashLine(float x1, float y1, float x2, float y2, float dashLength, wyColor4B color) {
+		float p[] = { x1, y1, x2, y2 };
+		addDashPath(p, 4, dashLength, color);
+	}
+
+	/// 添加一条粗线, 由两个三角形组成
+	void addThickLine(float x1, float y1, float x2, float y2, float width, wyColor4B color) {
+		float dx = x2 - x1;
+		float dy = y2 - y1;
+		float len = sqrtf(dx * dx + dy * dy);
+		if(len <= 0)
+			return;
+		float nx = -dy / len * width / 2;
+		float ny = dx / len * width / 2;
+		addQuad(x1 + nx, y1 + ny, x1 - nx, y1 - ny, x2 - nx, y2 - ny, x2 + nx, y2 + ny, color);
+	}
+
+	/**
+	 * \if English
+	 * Add a thick polyline or polygon outline, joins are mitered
+	 *
+	 * @param points even positions are x, odd positions are y
+	 * @param length length of points, it is number of points multiplied by 2
+	 * @param width line width
+	 * @param close true to connect last point to first
+	 * @param color color
+	 * \else
+	 * 添加一条粗折线或者多边形轮廓, 折角使用斜接
+	 *
+	 * @param points 偶数位置是x坐标，奇数位置是y坐标
+	 * @param length points长度，是点数乘以2，注意不是点数
+	 * @param width 线宽
+	 * @param close 是否闭合
+	 * @param color 颜色
+	 * \endif
+	 */
+	void addThickPath(const float* points, int length, float width, bool close, wyColor4B color) {
+		int n = length / 2;
+		if(n < 2)
+			return;
+		if(close && n < 3)
+			close = false;
+
+		// offset of each point to both sides, mitered between adjacent segment normals
+		float half = width / 2;
+		float* offsets = (float*)malloc(n * 2 * sizeof(float));
+		for(int i = 0; i < n; i++) {
+			int prev = i > 0 ? i - 1 : (close ? n - 1 : -1);
+			int next = i + 1 < n ? i + 1 : (close ? 0 : -1);
+			float n1x = 0, n1y = 0, n2x = 0, n2y = 0;
+			if(prev >= 0) {
+				float dx = points[i * 2] - points[prev * 2];
+				float dy = points[i * 2 + 1] - points[prev * 2 + 1];
+				float len = sqrtf(dx * dx + dy * dy);
+				if(len > 0) {
+					n1x = -dy / len;
+					n1y = dx / len;
+				}
+			}
+			if(next >= 0) {
+				float dx = points[next * 2] - points[i * 2];
+				float dy = points[next * 2 + 1] - points[i * 2 + 1];
+				float len = sqrtf(dx * dx + dy * dy);
+				if(len > 0) {
+					n2x = -dy / len;
+					n2y = dx / len;
+				}
+			}
+			if(prev < 0) {
+				n1x = n2x;
+				n1y = n2y;
+			}
+			if(next < 0) {
+				n2x = n1x;
+				n2y = n1y;
+			}
+
+			// miter direction is sum of normals, length is 1 / cos(half angle)
+			float mx = n1x + n2x;
+			float my = n1y + n2y;
+			float mlen = sqrtf(mx * mx + my * my);
+			float scale = 0;
+			if(mlen > 0) {
+				mx /= mlen;
+				my /= mlen;
+				float cosHalf = mx * n1x + my * n1y;
+				scale = cosHalf > 1.f / WY_PRIMITIVE_MITER_LIMIT ? 1 / cosHalf : WY_PRIMITIVE_MITER_LIMIT;
+			}
+			offsets[i * 2] = mx * scale * half;
+			offsets[i * 2 + 1] = my * scale * half;
+		}
+
+		int segments = close ? n : n - 1;
+		for(int i = 0; i < segments; i++) {
+			int j = (i + 1) % n;
+			float x1 = points[i * 2];
+			float y1 = points[i * 2 + 1];
+			float x2 = points[j * 2];
+			float y2 = points[j * 2 + 1];
+			addQuad(x1 + offsets[i * 2], y1 + offsets[i * 2 + 1],
+					x1 - offsets[i * 2], y1 - offsets[i * 2 + 1],
+					x2 - offsets[j * 2], y2 - offsets[j * 2 + 1],
+					x2 + offsets[j * 2], y2 + offsets[j * 2 + 1],
+					color);
+		}
+		free(offsets);
+	}
+
+	/// 添加一个粗线矩形轮廓
+	void addThickRect(wyRect r, float width, wyColor4B color) {
+		float p[] = {
+			r.x, r.y,
+			r.x + r.width, r.y,
+			r.x + r.width, r.y + r.height,
+			r.x, r.y + r.height
+		};
+		addThickPath(p, 8, width, true, color);
+	}
+
+	/// 得到三角形顶点数
+	int getTriangleVertexCount() { return m_triangles.count; }
+
+	/// 得到线段顶点数
+	int getLineVertexCount() { return m_lines.count; }
+};
+
+#endif // __wyPrimitiveBatch_h__
@@ -0,0 +1,708 @@
+/*
+ * Copyright (c) 2010 WiYun Inc.
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __wyShaderCache_h__
+#define __wyShaderCache_h__
+
+/*
+ * The engine library renders with OpenGL ES 1.x. Define WY_GLES2 to 1 and link GLESv2 and EGL
+ * to build the shader pipeline, it is only usable in an OpenGL ES 2.0 context.
+ */
+#if WY_GLES2
+
+#if ANDROID
+	#include <GLES2/gl2.h>
+	#include <GLES2/gl2ext.h>
+	#include <EGL/egl.h>
+#elif IOS
+	#import <OpenGLES/ES2/gl.h>
+	#import <OpenGLES/ES2/glext.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "wyObject.h"
+#include "wyTypes.h"
+#include "wyDirector.h"
+#include "wyMurmurHash.h"
+#include "wyUtils.h"
+#include "wyLog.h"
+
+/// 程序二进制缓存文件的魔数
+#define WY_SHADER_CACHE_MAGIC 0x48535957
+
+/// 程序二进制缓存文件的版本
+#define WY_SHADER_CACHE_VERSION 1
+
+/// 位置属性的位置, vec2或vec4
+#define WY_ATTRIB_POSITION 0
+
+/// 颜色属性的位置, 4个归一化的无符号字节
+#define WY_ATTRIB_COLOR 1
+
+/// 贴图坐标属性的位置, vec2
+#define WY_ATTRIB_TEXCOORD 2
+
+/**
+ * @typedef wyShaderKind
+ *
+ * 内置的着色器程序
+ */
+typedef enum {
+	/// 贴图乘以顶点颜色和tint, 用于sprite, atlas和粒子
+	SHADER_TEXTURED,
+
+	/// 只有顶点颜色和tint, 用于图元和颜色层
+	SHADER_COLORED,
+
+	/// 贴图只提供alpha, 颜色来自顶点颜色和tint, 用于A8格式的文字贴图
+	SHADER_TEXTURED_A8,
+
+	/// 贴图乘以tint, 没有顶点颜色, 用于网格特效
+	SHADER_GRID,
+
+	/// 内置程序数
+	SHADER_COUNT
+} wyShaderKind;
+
+/**
+ * @struct wyShaderProgram
+ *
+ * 一个编译好的程序和它缓存的uniform
+ */
+typedef struct wyShaderProgram {
+	/// 程序名, 0表示还没有创建
+	GLuint program;
+
+	/// 模型视图投影矩阵的位置
+	GLint uMVP;
+
+	/// tint颜色的位置
+	GLint uTint;
+
+	/// 贴图采样器的位置, 没有贴图时是-1
+	GLint uTexture;
+
+	/// 上次上传的矩阵序号
+	int mvpSerial;
+
+	/// 上次上传的tint
+	GLfloat tint[4];
+} wyShaderProgram;
+
+/**
+ * @struct wyShaderBinary
+ *
+ * 一个程序的二进制数据
+ */
+typedef struct wyShaderBinary {
+	/// 驱动相关的二进制格式
+	GLenum format;
+
+	/// 数据长度, 0表示没有
+	GLsizei length;
+
+	/// 数据
+	void* data;
+} wyShaderBinary;
+
+/**
+ * @class wyShaderCache
+ *
+ * \if English
+ * Optional OpenGL ES 2.0 pipeline. It has a small set of built in programs for textured, colored,
+ * A8 text and grid drawing, with fixed attribute locations \c WY_ATTRIB_POSITION, \c WY_ATTRIB_COLOR
+ * and \c WY_ATTRIB_TEXCOORD. Tint and alpha of a whole draw are a uniform multiplied into vertex color,
+ * so fading a node doesn't rewrite its vertices. Matrix and tint uniforms are uploaded only when they
+ * changed for the program in use.
+ *
+ * Programs are compiled lazily. If a cache directory is set and driver supports
+ * \c GL_OES_get_program_binary, linked binaries are saved and reloaded on next start, which skips
+ * compiling and linking. Binaries are keyed by renderer, driver version and shader sources, and a
+ * binary refused by driver falls back to compiling. Programs are recreated after OpenGL context
+ * is lost.
+ *
+ * Only available when built with \c WY_GLES2.
+ * \else
+ * 可选的OpenGL ES 2.0管线. 它包含一小组内置程序, 用于贴图, 纯色, A8文字和网格的绘制, 属性位置固定为
+ * \c WY_ATTRIB_POSITION, \c WY_ATTRIB_COLOR和\c WY_ATTRIB_TEXCOORD. 整个绘制的tint和alpha是一个乘到顶点
+ * 颜色上的uniform, 因此节点渐变不需要改写顶点. 矩阵和tint只有在当前程序的值改变时才上传.
+ *
+ * 程序在需要时才编译. 如果设置了缓存目录并且驱动支持\c GL_OES_get_program_binary, 链接好的二进制会被保存,
+ * 下次启动时直接载入, 跳过编译和链接. 二进制以渲染器, 驱动版本和着色器源码为键, 驱动拒绝的二进制会退回
+ * 到编译. OpenGL上下文丢失后程序会被重新创建.
+ *
+ * 只有定义了\c WY_GLES2才可用.
+ * \endif
+ */
+class wyShaderCache : public wyObject {
+private:
+	/// 内置程序
+	wyShaderProgram m_programs[SHADER_COUNT];
+
+	/// 从缓存文件载入或者从驱动取得的二进制
+	wyShaderBinary m_binaries[SHADER_COUNT];
+
+	/// 当前使用的程序, -1表示未知
+	int m_current;
+
+	/// 矩阵序号, 每次设置矩阵加1
+	int m_mvpSerial;
+
+	/// 当前矩阵
+	GLfloat m_mvp[16];
+
+	/// 缓存目录, NULL表示不缓存二进制
+	const char* m_directory;
+
+	/// true表示驱动支持程序二进制
+	bool m_binarySupported;
+
+	/// true表示二进制缓存文件已经读过
+	bool m_binariesLoaded;
+
+	/// true表示有新的二进制需要保存
+	bool m_binariesDirty;
+
+	/// 程序二进制的键
+	uint64_t m_key;
+
+	/// 编译的程序数
+	int m_compileCount;
+
+	/// 从二进制载入的程序数
+	int m_binaryLoadCount;
+
+	/// 跳过的uniform上传数
+	int m_elidedUniforms;
+
+	PFNGLGETPROGRAMBINARYOESPROC m_getProgramBinary;
+	PFNGLPROGRAMBINARYOESPROC m_programBinary;
+
+private:
+	wyShaderCache() :
+			m_current(-1),
+			m_mvpSerial(1),
+			m_directory(NULL),
+			m_binarySupported(false),
+			m_binariesLoaded(false),
+			m_binariesDirty(false),
+			m_key(0),
+			m_compileCount(0),
+			m_binaryLoadCount(0),
+			m_elidedUniforms(0),
+			m_getProgramBinary(NULL),
+			m_programBinary(NULL) {
+		memset(m_programs, 0, sizeof(m_programs));
+		memset(m_binaries, 0, sizeof(m_binaries));
+		memset(m_mvp, 0, sizeof(m_mvp));
+		m_mvp[0] = m_mvp[5] = m_mvp[10] = m_mvp[15] = 1;
+
+		wyDirectorLifecycleListener l;
+		memset(&l, 0, sizeof(wyDirectorLifecycleListener));
+		l.onSurfaceCreated = onSurfaceCreated;
+		wyDirector::getInstance()->addLifecycleListener(&l, this);
+	}
+
+	static void onSurfaceCreated(void* data) {
+		// program names are invalid in new context, don't delete them
+		wyShaderCache* cache = (wyShaderCache*)data;
+		memset(cache->m_programs, 0, sizeof(cache->m_programs));
+		cache->m_current = -1;
+	}
+
+	static const char* vertexSource(wyShaderKind kind) {
+		switch(kind) {
+			case SHADER_COLORED:
+				return "uniform mat4 u_mvp;\n"
+					"uniform vec4 u_tint;\n"
+					"attribute vec4 a_position;\n"
+					"attribute vec4 a_color;\n"
+					"varying lowp vec4 v_color;\n"
+					"void main() {\n"
+					"	v_color = a_color * u_tint;\n"
+					"	gl_Position = u_mvp * a_position;\n"
+					"}\n";
+			case SHADER_GRID:
+				return "uniform mat4 u_mvp;\n"
+					"attribute vec4 a_position;\n"
+					"attribute vec2 a_texCoord;\n"
+					"varying mediump vec2 v_texCoord;\n"
+					"void main() {\n"
+					"	v_texCoord = a_texCoord;\n"
+					"	gl_Position = u_mvp * a_position;\n"
+					"}\n";
+			default:
+				return "uniform mat4 u_mvp;\n"
+					"uniform vec4 u_tint;\n"
+					"attribute vec4 a_position;\n"
+					"attribute vec4 a_color;\n"
+					"attribute vec2 a_texCoord;\n"
+					"varying lowp vec4 v_color;\n"
+					"varying mediump vec2 v_texCoord;\n"
+					"void main() {\n"
+					"	v_color = a_color * u_tint;\n"
+					"	v_texCoord = a_texCoord;\n"
+					"	gl_Position = u_mvp * a_position;\n"
+					"}\n";
+		}
+	}
+
+	static const char* fragmentSource(wyShaderKind kind) {
+		switch(kind) {
+			case SHADER_COLORED:
+				return "varying lowp vec4 v_color;\n"
+					"void main() {\n"
+					"	gl_FragColor = v_color;\n"
+					"}\n";
+			case SHADER_TEXTURED_A8:
+				return "uniform sampler2D u_texture;\n"
+					"varying lowp vec4 v_color;\n"
+					"varying mediump vec2 v_texCoord;\n"
+					"void main() {\n"
+					"	gl_FragColor = vec4(v_color.rgb, v_color.a * texture2D(u_texture, v_texCoord).a);\n"
+					"}\n";
+			case SHADER_GRID:
+				return "uniform sampler2D u_texture;\n"
+					"uniform lowp vec4 u_tint;\n"
+					"varying mediump vec2 v_texCoord;\n"
+					"void main() {\n"
+					"	gl_FragColor = texture2D(u_texture, v_texCoord) * u_tint;\n"
+					"}\n";
+			default:
+				return "uniform sampler2D u_texture;\n"
+					"varying lowp vec4 v_color;\n"
+					"varying mediump vec2 v_texCoord;\n"
+					"void main() {\n"
+					"	gl_FragColor = texture2D(u_texture, v_texCoord) * v_color;\n"
+					"}\n";
+		}
+	}
+
+	static GLuint compileShader(GLenum type, const char* source) {
+		GLuint shader = glCreateShader(type);
+		glShaderSource(shader, 1, &source, NULL);
+		glCompileShader(shader);
+		GLint ok = 0;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+		if(!ok) {
+			char log[512];
+			glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+			LOGE("wyShaderCache: compile failed: %s", log);
+			glDeleteShader(shader);
+			return 0;
+		}
+		return shader;
+	}
+
+	/// 检查驱动对程序二进制的支持, 计算二进制的键
+	void checkBinarySupport() {
+		const char* ext = (const char*)glGetString(GL_EXTENSIONS);
+		GLint formats = 0;
+		if(ext && strstr(ext, "GL_OES_get_program_binary"))
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &formats);
+#if ANDROID
+		if(formats > 0) {
+			m_getProgramBinary = (PFNGLGETPROGRAMBINARYOESPROC)eglGetProcAddress("glGetProgramBinaryOES");
+			m_programBinary = (PFNGLPROGRAMBINARYOESPROC)eglGetProcAddress("glProgramBinaryOES");
+		}
+#endif
+		m_binarySupported = m_getProgramBinary != NULL && m_programBinary != NULL;
+
+		// binaries are only valid for same driver and same sources
+		const char* parts[] = {
+			(const char*)glGetString(GL_RENDERER),
+			(const char*)glGetString(GL_VERSION)
+		};
+		m_key = WY_SHADER_CACHE_VERSION;
+		for(int i = 0; i < 2; i++) {
+			if(parts[i])
+				m_key = m_key * 31 + wyMurmurHash::hash64(parts[i], strlen(parts[i]));
+		}
+		for(int i = 0; i < SHADER_COUNT; i++) {
+			const char* vs = vertexSource((wyShaderKind)i);
+			const char* fs = fragmentSource((wyShaderKind)i);
+			m_key = m_key * 31 + wyMurmurHash::hash64(vs, strlen(vs));
+			m_key = m_key * 31 + wyMurmurHash::hash64(fs, strlen(fs));
+		}
+	}
+
+	char* cachePath() {
+		int len = strlen(m_directory) + 16;
+		char* path = (char*)malloc(len);
+		snprintf(path, len, "%s/shaders.bin", m_directory);
+		return path;
+	}
+
+	void freeBinaries() {
+		for(int i = 0; i < SHADER_COUNT; i++) {
+			if(m_binaries[i].data)
+				free(m_binaries[i].data);
+		}
+		memset(m_binaries, 0, sizeof(m_binaries));
+	}
+
+	/// 读取二进制缓存文件, 键不符的文件被忽略
+	void loadBinaries() {
+		m_binariesLoaded = true;
+		if(!m_directory || !m_binarySupported)
+			return;
+
+		char* path = cachePath();
+		FILE* f = fopen(path, "rb");
+		free(path);
+		if(!f)
+			return;
+
+		uint32_t header[4];
+		uint64_t key;
+		bool ok = fread(header, sizeof(header), 1, f) == 1 && fread(&key, sizeof(key), 1, f) == 1 &&
+				header[0] == WY_SHADER_CACHE_MAGIC && header[1] == WY_SHADER_CACHE_VERSION &&
+				header[2] == SHADER_COUNT && key == m_key;
+		for(int i = 0; ok && i < SHADER_COUNT; i++) {
+			uint32_t entry[2];
+			ok = fread(entry, sizeof(entry), 1, f) == 1;
+			if(ok && entry[1] > 0) {
+				m_binaries[i].format = entry[0];
+				m_binaries[i].length = entry[1];
+				m_binaries[i].data = malloc(entry[1]);
+				ok = m_binaries[i].data && fread(m_binaries[i].data, entry[1], 1, f) == 1;
+			}
+		}
+		fclose(f);
+		if(!ok)
+			freeBinaries();
+	}
+
+	/// 从二进制创建程序, 失败返回0
+	GLuint programFromBinary(wyShaderKind kind) {
+		wyShaderBinary* b = &m_binaries[kind];
+		if(!m_binarySupported || b->length <= 0)
+			return 0;
+
+		GLuint program = glCreateProgram();
+		m_programBinary(program, b->format, b->data, b->length);
+		GLint ok = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &ok);
+		if(!ok) {
+			// driver refused it, compile again and replace binary
+			glDeleteProgram(program);
+			free(b->data);
+			memset(b, 0, sizeof(wyShaderBinary));
+			return 0;
+		}
+		m_binaryLoadCount++;
+		return program;
+	}
+
+	/// 编译并链接程序, 如果支持则取得二进制
+	GLuint programFromSource(wyShaderKind kind) {
+		GLuint vs = compileShader(GL_VERTEX_SHADER, vertexSource(kind));
+		GLuint fs = compileShader(GL_FRAGMENT_SHADER, fragmentSource(kind));
+		if(!vs || !fs) {
+			if(vs)
+				glDeleteShader(vs);
+			if(fs)
+				glDeleteShader(fs);
+			return 0;
+		}
+
+		GLuint program = glCreateProgram();
+		glAttachShader(program, vs);
+		glAttachShader(program, fs);
+		glBindAttribLocation(program, WY_ATTRIB_POSITION, "a_position");
+		glBindAttribLocation(program, WY_ATTRIB_COLOR, "a_color");
+		glBindAttribLocation(program, WY_ATTRIB_TEXCOORD, "a_texCoord");
+		glLinkProgram(program);
+		glDeleteShader(vs);
+		glDeleteShader(fs);
+
+		GLint ok = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &ok);
+		if(!ok) {
+			char log[512];
+			glGetProgramInfoLog(program, sizeof(log), NULL, log);
+			LOGE("wyShaderCache: link failed: %s", log);
+			glDeleteProgram(program);
+			return 0;
+		}
+		m_compileCount++;
+
+		if(m_binarySupported && m_directory) {
+			GLint length = 0;
+			glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH_OES, &length);
+			if(length > 0) {
+				wyShaderBinary* b = &m_binaries[kind];
+				if(b->data)
+					free(b->data);
+				b->data = malloc(length);
+				b->length = 0;
+				if(b->data) {
+					m_getProgramBinary(program, length, &b->length, &b->format, b->data);
+					m_binariesDirty |= b->length > 0;
+				}
+			}
+		}
+		return program;
+	}
+
+	/// 确保程序已经创建
+	wyShaderProgram* ensure(wyShaderKind kind) {
+		wyShaderProgram* p = &m_programs[kind];
+		if(p->program != 0)
+			return p;
+
+		if(!m_binariesLoaded) {
+			checkBinarySupport();
+			loadBinaries();
+		}
+
+		GLuint program = programFromBinary(kind);
+		if(program == 0)
+			program = programFromSource(kind);
+		if(program == 0)
+			return NULL;
+
+		p->program = program;
+		p->uMVP = glGetUniformLocation(program, "u_mvp");
+		p->uTint = glGetUniformLocation(program, "u_tint");
+		p->uTexture = glGetUniformLocation(program, "u_texture");
+		p->mvpSerial = 0;
+
+		// sampler always reads unit 0, uniforms start as zero so tint starts as white
+		glUseProgram(program);
+		m_current = kind;
+		if(p->uTexture >= 0)
+			glUniform1i(p->uTexture, 0);
+		glUniform4f(p->uTint, 1, 1, 1, 1);
+		p->tint[0] = p->tint[1] = p->tint[2] = p->tint[3] = 1;
+		return p;
+	}
+
+public:
+	/**
+	 * 获得\link wyShaderCache wyShaderCache\endlink单例
+	 *
+	 * @return \link wyShaderCache wyShaderCache\endlink
+	 */
+	static wyShaderCache* getInstance() {
+		static wyShaderCache* s_instance = NULL;
+		if(s_instance == NULL)
+			s_instance = new wyShaderCache();
+		return s_instance;
+	}
+
+	virtual ~wyShaderCache() {
+		freeBinaries();
+		if(m_directory)
+			free((void*)m_directory);
+	}
+
+	/**
+	 * \if English
+	 * Set directory of program binary cache, must be called before first program is used
+	 *
+	 * @param dir writable directory, such as cache directory of application. NULL disables binaries
+	 * \else
+	 * 设置程序二进制缓存的目录, 必须在第一个程序被使用前调用
+	 *
+	 * @param dir 可写的目录, 比如应用的缓存目录. NULL表示不使用二进制
+	 * \endif
+	 */
+	void setDirectory(const char* dir) {
+		if(m_directory)
+			free((void*)m_directory);
+		m_directory = NULL;
+		if(dir) {
+			mkdir(dir, 0755);
+			m_directory = wyUtils::copy(dir);
+		}
+	}
+
+	/**
+	 * \if English
+	 * Create all built in programs and save new binaries, must be called in OpenGL thread. Call it
+	 * at startup so that no program is compiled in the middle of a scene.
+	 * \else
+	 * 创建所有内置程序并保存新的二进制, 必须在OpenGL线程中调用. 在启动时调用, 这样不会在场景中间编译程序.
+	 * \endif
+	 */
+	void preload() {
+		for(int i = 0; i < SHADER_COUNT; i++)
+			ensure((wyShaderKind)i);
+		saveBinaries();
+	}
+
+	/**
+	 * \if English
+	 * Write binaries to cache file if any program was compiled since last save
+	 *
+	 * @return true if file is written
+	 * \else
+	 * 如果上次保存后编译了程序, 则把二进制写入缓存文件
+	 *
+	 * @return true表示写入了文件
+	 * \endif
+	 */
+	bool saveBinaries() {
+		if(!m_binariesDirty || !m_directory)
+			return false;
+
+		// write to a temp file and rename, so a half written file is never loaded
+		char* path = cachePath();
+		int len = strlen(path) + 5;
+		char* tmp = (char*)malloc(len);
+		snprintf(tmp, len, "%s.tmp", path);
+
+		bool ok = false;
+		FILE* f = fopen(tmp, "wb");
+		if(f) {
+			uint32_t header[4] = { WY_SHADER_CACHE_MAGIC, WY_SHADER_CACHE_VERSION, SHADER_COUNT, 0 };
+			ok = fwrite(header, sizeof(header), 1, f) == 1 && fwrite(&m_key, sizeof(m_key), 1, f) == 1;
+			for(int i = 0; ok && i < SHADER_COUNT; i++) {
+				uint32_t entry[2] = { m_binaries[i].format, (uint32_t)m_binaries[i].length };
+				ok = fwrite(entry, sizeof(entry), 1, f) == 1;
+				if(ok && entry[1] > 0)
+					ok = fwrite(m_binaries[i].data, entry[1], 1, f) == 1;
+			}
+			ok = fclose(f) == 0 && ok;
+			ok = ok && rename(tmp, path) == 0;
+			if(!ok)
+				unlink(tmp);
+		}
+
+		free(tmp);
+		free(path);
+		if(ok)
+			m_binariesDirty = false;
+		return ok;
+	}
+
+	/**
+	 * \if English
+	 * Use a built in program, current matrix is uploaded if program hasn't seen it
+	 *
+	 * @param kind program
+	 * @return false if program can't be created
+	 * \else
+	 * 使用一个内置程序, 如果程序还没有当前矩阵则上传
+	 *
+	 * @param kind 程序
+	 * @return false表示程序无法创建
+	 * \endif
+	 */
+	bool use(wyShaderKind kind) {
+		wyShaderProgram* p = ensure(kind);
+		if(p == NULL)
+			return false;
+		if(m_current != kind) {
+			glUseProgram(p->program);
+			m_current = kind;
+		}
+		if(p->mvpSerial != m_mvpSerial) {
+			glUniformMatrix4fv(p->uMVP, 1, GL_FALSE, m_mvp);
+			p->mvpSerial = m_mvpSerial;
+		} else {
+			m_elidedUniforms++;
+		}
+		return true;
+	}
+
+	/**
+	 * \if English
+	 * Set model view projection matrix, it is uploaded to current program now and to others when
+	 * they are used
+	 *
+	 * @param m column major 4x4 matrix
+	 * \else
+	 * 设置模型视图投影矩阵, 立即上传到当前程序, 其它程序在使用时上传
+	 *
+	 * @param m 列优先的4x4矩阵
+	 * \endif
+	 */
+	void setMatrix(const GLfloat* m) {
+		if(memcmp(m, m_mvp, sizeof(m_mvp)) == 0) {
+			m_elidedUniforms++;
+			return;
+		}
+		memcpy(m_mvp, m, sizeof(m_mvp));
+		m_mvpSerial++;
+		if(m_current >= 0 && m_programs[m_current].program != 0) {
+			glUniformMatrix4fv(m_programs[m_current].uMVP, 1, GL_FALSE, m_mvp);
+			m_programs[m_current].mvpSerial = m_mvpSerial;
+		}
+	}
+
+	/**
+	 * \if English
+	 * Set tint of current program, it multiplies vertex color, or texture color for grid program.
+	 * Engine blends with \c GL_SRC_ALPHA, so color is not premultiplied. Multiply color by alpha only for
+	 * content drawn with premultiplied blending. A program starts with white tint.
+	 * \else
+	 * 设置当前程序的tint, 它乘到顶点颜色上, 网格程序则乘到贴图颜色上. 引擎使用\c GL_SRC_ALPHA混合, 因此颜色
+	 * 不需要预乘alpha. 只有使用预乘混合的内容才需要把颜色乘以alpha. 程序创建时tint是白色.
+	 * \endif
+	 */
+	void setTint(GLfloat r, GLfloat g, GLfloat b, GLfloat a) {
+		if(m_current < 0)
+			return;
+		wyShaderProgram* p = &m_programs[m_current];
+		if(p->tint[0] == r && p->tint[1] == g && p->tint[2] == b && p->tint[3] == a) {
+			m_elidedUniforms++;
+			return;
+		}
+		p->tint[0] = r;
+		p->tint[1] = g;
+		p->tint[2] = b;
+		p->tint[3] = a;
+		glUniform4f(p->uTint, r, g, b, a);
+	}
+
+	/// 以节点颜色和alpha设置tint
+	void setTint(wyColor3B color, int alpha) {
+		setTint(color.r / 255.f, color.g / 255.f, color.b / 255.f, alpha / 255.f);
+	}
+
+	/// 得到程序名, 程序会被创建
+	GLuint getProgram(wyShaderKind kind) {
+		wyShaderProgram* p = ensure(kind);
+		return p ? p->program : 0;
+	}
+
+	/// 驱动是否支持程序二进制
+	bool isBinarySupported() { return m_binarySupported; }
+
+	/// 得到编译的程序数
+	int getCompileCount() { return m_compileCount; }
+
+	/// 得到从二进制载入的程序数
+	int getBinaryLoadCount() { return m_binaryLoadCount; }
+
+	/// 得到跳过的uniform上传数
+	int getElidedUniforms() { return m_elidedUniforms; }
+};
+
+#endif // WY_GLES2
+
+#endif // __wyShaderCache_h__
@@ -0,0 +1,538 @@
+/*
+ * Copyright (c) 2010 WiYun Inc.
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __wyStreamBuffer_h__
+#define __wyStreamBuffer_h__
+
+#if ANDROID
+	#include <GLES/gl.h>
+#elif IOS
+	#import <OpenGLES/ES1/gl.h>
+	#import <OpenGLES/ES1/glext.h>
+#endif
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wyObject.h"
+#include "wyTypes.h"
+#include "wyTexture2D.h"
+#include "wyDirector.h"
+#include "wyGLState.h"
+
+/// 流式顶点缓冲的缺省字节数
+#define WY_STREAM_BUFFER_DEFAULT_SIZE (256 * 1024)
+
+/**
+ * @struct wyStreamVertex
+ *
+ * 流式缓冲中的顶点, 2D位置, 贴图坐标和颜色, 共20字节
+ */
+typedef struct wyStreamVertex {
+	/// 位置
+	GLfloat x, y;
+
+	/// 贴图坐标
+	GLfloat u, v;
+
+	/// 颜色
+	GLubyte r, g, b, a;
+} wyStreamVertex;
+
+/**
+ * @class wyStreamBuffer
+ *
+ * \if English
+ * Per frame streaming vertex buffer for immediate mode draws. Small draws such as a texture, a line
+ * or a rectangle are appended to a pending batch, which is drawn only when primitive mode, texture,
+ * blend function or line width changes, or when \c end is called. Hundreds of tiny draws of same
+ * texture become one \c glDrawArrays.
+ *
+ * Batches are written into one VBO as a ring, each batch goes after previous one so GPU never waits
+ * for a region in use. When ring is full the buffer is orphaned and writing starts again from the
+ * beginning, so old content stays valid for pending draws.
+ *
+ * Engine nodes draw with their own arrays, so appends must be bracketed by \c begin and \c end in
+ * a \c draw method, and nothing else may draw in between. Nested \c begin is allowed, only the
+ * outermost \c end flushes.
+ * \else
+ * 立即模式绘制使用的每帧流式顶点缓冲. 比如一张贴图, 一条线或者一个矩形这样的小绘制被追加到待绘制批次中,
+ * 只有当图元类型, 贴图, 混合函数或线宽改变, 或者调用\c end时才真正绘制. 几百次同一贴图的小绘制变成一次
+ * \c glDrawArrays.
+ *
+ * 批次以环形方式写入一个VBO, 每个批次写在前一个之后, 因此GPU不会等待正在使用的区域. 环写满时丢弃旧存储
+ * 并从头开始写, 旧的内容对尚未完成的绘制仍然有效.
+ *
+ * 引擎节点用它们自己的数组绘制, 因此追加必须在一个\c draw方法中被\c begin和\c end包围, 并且其间不能有其它
+ * 绘制. 可以嵌套\c begin, 只有最外层的\c end才会提交.
+ * \endif
+ */
+class wyStreamBuffer : public wyObject {
+private:
+	/// 顶点缓冲
+	GLuint m_vbo;
+
+	/// 创建\c m_vbo时的surface代数
+	int m_generation;
+
+	/// 环的字节数
+	int m_size;
+
+	/// 环中下一次写入的偏移
+	int m_offset;
+
+	/// 待绘制的顶点
+	wyStreamVertex* m_pending;
+
+	/// 待绘制的顶点数
+	int m_pendingCount;
+
+	/// \c m_pending能容纳的顶点数
+	int m_pendingCapacity;
+
+	/// 当前批次的图元类型
+	GLenum m_mode;
+
+	/// 当前批次的贴图, 0表示没有贴图
+	GLuint m_texture;
+
+	/// 当前批次的混合函数
+	wyBlendFunc m_blendFunc;
+
+	/// 当前批次的线宽
+	GLfloat m_lineWidth;
+
+	/// 已经设置给OpenGL的线宽, 引擎缺省是1
+	GLfloat m_glLineWidth;
+
+	/// begin嵌套深度
+	int m_depth;
+
+	/// 绘制次数
+	int m_drawCount;
+
+	/// 追加次数
+	int m_appendCount;
+
+	/// 丢弃旧存储的次数
+	int m_orphanCount;
+
+private:
+	wyStreamBuffer() :
+			m_vbo(0),
+			m_generation(0),
+			m_size(WY_STREAM_BUFFER_DEFAULT_SIZE),
+			m_offset(0),
+			m_pending(NULL),
+			m_pendingCount(0),
+			m_pendingCapacity(0),
+			m_mode(GL_TRIANGLES),
+			m_texture(0),
+			m_blendFunc(wybfDefault),
+			m_lineWidth(1),
+			m_glLineWidth(1),
+			m_depth(0),
+			m_drawCount(0),
+			m_appendCount(0),
+			m_orphanCount(0) {
+	}
+
+	/// 把OpenGL线宽恢复为引擎缺省的1
+	void restoreLineWidth() {
+		if(m_glLineWidth != 1) {
+			glLineWidth(1);
+			m_glLineWidth = 1;
+		}
+	}
+
+	static int* surfaceGeneration() {
+		static int s_generation = 0;
+		static bool s_listening = false;
+		if(!s_listening) {
+			wyDirectorLifecycleListener l;
+			memset(&l, 0, sizeof(wyDirectorLifecycleListener));
+			l.onSurfaceCreated = onSurfaceCreated;
+			wyDirector::getInstance()->addLifecycleListener(&l, NULL);
+			s_listening = true;
+		}
+		return &s_generation;
+	}
+
+	static void onSurfaceCreated(void* data) {
+		(*surfaceGeneration())++;
+	}
+
+	void ensureBuffer() {
+		int generation = *surfaceGeneration();
+		if(m_vbo != 0 && generation == m_generation)
+			return;
+
+		// old name is invalid after context loss, don't delete it
+		glGenBuffers(1, &m_vbo);
+		wyGLState* gl = wyGLState::getInstance();
+		gl->bindBuffer(GL_ARRAY_BUFFER, m_vbo);
+		glBufferData(GL_ARRAY_BUFFER, m_size, NULL, GL_DYNAMIC_DRAW);
+		m_generation = generation;
+		m_offset = 0;
+	}
+
+	/// 为追加的顶点预留空间, 批次状态改变时先提交
+	wyStreamVertex* reserve(GLenum mode, GLuint texture, int count) {
+		if(m_pendingCount > 0 && (mode != m_mode || texture != m_texture))
+			flush();
+		m_mode = mode;
+		m_texture = texture;
+
+		// a batch never exceeds ring
+		int max = m_size / sizeof(wyStreamVertex);
+		if(m_pendingCount + count > max)
+			flush();
+		if(count > max)
+			return NULL;
+
+		if(m_pendingCount + count > m_pendingCapacity) {
+			int capacity = m_pendingCapacity * 2;
+			if(capacity < m_pendingCount + count)
+				capacity = m_pendingCount + count;
+			m_pending = (wyStreamVertex*)realloc(m_pending, capacity * sizeof(wyStreamVertex));
+			m_pendingCapacity = capacity;
+		}
+		wyStreamVertex* v = m_pending + m_pendingCount;
+		m_pendingCount += count;
+		m_appendCount++;
+		return v;
+	}
+
+	static void setVertex(wyStreamVertex* v, float x, float y, float u, float tv, wyColor4B c) {
+		v->x = x;
+		v->y = y;
+		v->u = u;
+		v->v = tv;
+		v->r = c.r;
+		v->g = c.g;
+		v->b = c.b;
+		v->a = c.a;
+	}
+
+public:
+	/**
+	 * 获得\link wyStreamBuffer wyStreamBuffer\endlink单例
+	 *
+	 * @return \link wyStreamBuffer wyStreamBuffer\endlink
+	 */
+	static wyStreamBuffer* getInstance() {
+		static wyStreamBuffer* s_instance = NULL;
+		if(s_instance == NULL)
+			s_instance = new wyStreamBuffer();
+		return s_instance;
+	}
+
+	virtual ~wyStreamBuffer() {
+		if(m_vbo != 0 && m_generation == *surfaceGeneration()) {
+			wyGLState::getInstance()->forgetBuffer(m_vbo);
+			glDeleteBuffers(1, &m_vbo);
+		}
+		if(m_pending)
+			free(m_pending);
+	}
+
+	/**
+	 * \if English
+	 * Set ring size in bytes, takes effect when buffer is created next time
+	 * \else
+	 * 设置环的字节数, 下次创建缓冲时生效
+	 * \endif
+	 */
+	void setSize(int size) {
+		if(m_depth > 0)
+			return;
+		m_size = size;
+		if(m_vbo != 0 && m_generation == *surfaceGeneration()) {
+			wyGLState::getInstance()->forgetBuffer(m_vbo);
+			glDeleteBuffers(1, &m_vbo);
+		}
+		m_vbo = 0;
+	}
+
+	/**
+	 * \if English
+	 * Start appending, must be called in OpenGL thread. States are cached by
+	 * \link wyGLState wyGLState\endlink until outermost \c end.
+	 * \else
+	 * 开始追加, 必须在OpenGL线程中调用. 直到最外层的\c end, 状态由\link wyGLState wyGLState\endlink缓存.
+	 * \endif
+	 */
+	void begin() {
+		if(m_depth++ == 0) {
+			wyGLState::getInstance()->begin();
+			m_blendFunc = wybfDefault;
+			m_lineWidth = 1;
+		}
+	}
+
+	/**
+	 * \if English
+	 * End appending, outermost \c end draws pending batch and restores states, including
+	 * \c GL_BLEND and line width
+	 * \else
+	 * 结束追加, 最外层的\c end绘制待绘制的批次并恢复状态, 包括\c GL_BLEND和线宽
+	 * \endif
+	 */
+	void end() {
+		if(m_depth <= 0)
+			return;
+		if(--m_depth == 0) {
+			flush();
+			restoreLineWidth();
+			wyGLState::getInstance()->end();
+		}
+	}
+
+	/**
+	 * \if English
+	 * Draw pending batch now
+	 * \else
+	 * 立即绘制待绘制的批次
+	 * \endif
+	 */
+	void flush() {
+		if(m_pendingCount == 0)
+			return;
+
+		// outside of begin and end, states are restored right after drawing
+		wyGLState* gl = wyGLState::getInstance();
+		gl->begin();
+		ensureBuffer();
+		gl->bindBuffer(GL_ARRAY_BUFFER, m_vbo);
+
+		// wrap around, orphan storage so draws still reading old content are not stalled
+		int bytes = m_pendingCount * sizeof(wyStreamVertex);
+		if(m_offset + bytes > m_size) {
+			glBufferData(GL_ARRAY_BUFFER, m_size, NULL, GL_DYNAMIC_DRAW);
+			m_offset = 0;
+			m_orphanCount++;
+		}
+		glBufferSubData(GL_ARRAY_BUFFER, m_offset, bytes, m_pending);
+
+		gl->enableClientState(GL_VERTEX_ARRAY);
+		gl->enableClientState(GL_COLOR_ARRAY);
+		glVertexPointer(2, GL_FLOAT, sizeof(wyStreamVertex), (const GLvoid*)(m_offset + offsetof(wyStreamVertex, x)));
+		glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(wyStreamVertex), (const GLvoid*)(m_offset + offsetof(wyStreamVertex, r)));
+		if(m_texture != 0) {
+			gl->enable(GL_TEXTURE_2D);
+			gl->bindTexture(m_texture);
+			gl->enableClientState(GL_TEXTURE_COORD_ARRAY);
+			glTexCoordPointer(2, GL_FLOAT, sizeof(wyStreamVertex), (const GLvoid*)(m_offset + offsetof(wyStreamVertex, u)));
+		} else {
+			gl->disable(GL_TEXTURE_2D);
+			gl->disableClientState(GL_TEXTURE_COORD_ARRAY);
+		}
+		gl->enable(GL_BLEND);
+		gl->blendFunc(m_blendFunc.src, m_blendFunc.dst);
+		if(m_glLineWidth != m_lineWidth) {
+			glLineWidth(m_lineWidth);
+			m_glLineWidth = m_lineWidth;
+		}
+
+		glDrawArrays(m_mode, 0, m_pendingCount);
+		m_drawCount++;
+
+		m_offset += bytes;
+		m_pendingCount = 0;
+		if(m_depth == 0)
+			restoreLineWidth();
+		gl->end();
+	}
+
+	/**
+	 * \if English
+	 * Set blend function of following appends, pending batch is drawn if it changes
+	 * \else
+	 * 设置之后追加的内容的混合函数, 如果改变则先绘制待绘制的批次
+	 * \endif
+	 */
+	void setBlendFunc(wyBlendFunc func) {
+		if(func.src == m_blendFunc.src && func.dst == m_blendFunc.dst)
+			return;
+		flush();
+		m_blendFunc = func;
+	}
+
+	/**
+	 * \if English
+	 * Set line width of following line appends, pending batch is drawn if it changes. Width is given
+	 * to OpenGL when a batch is drawn and set back to 1 by outermost \c end, or right after the draw
+	 * outside of \c begin and \c end.
+	 * \else
+	 * 设置之后追加的线的宽度, 如果改变则先绘制待绘制的批次. 线宽在绘制批次时才设置给OpenGL, 由最外层的\c end
+	 * 恢复为1, 在\c begin和\c end之外则绘制后立即恢复.
+	 * \endif
+	 */
+	void setLineWidth(GLfloat width) {
+		if(width == m_lineWidth)
+			return;
+		flush();
+		m_lineWidth = width;
+	}
+
+	/**
+	 * \if English
+	 * Append vertices
+	 *
+	 * @param mode primitive mode, batches only join for \c GL_TRIANGLES, \c GL_LINES and \c GL_POINTS
+	 * @param texture OpenGL texture name, 0 for untextured
+	 * @param vertices vertices
+	 * @param count number of vertices
+	 * \else
+	 * 追加顶点
+	 *
+	 * @param mode 图元类型, 只有\c GL_TRIANGLES, \c GL_LINES和\c GL_POINTS可以合并批次
+	 * @param texture OpenGL贴图名, 0表示没有贴图
+	 * @param vertices 顶点
+	 * @param count 顶点数
+	 * \endif
+	 */
+	void append(GLenum mode, GLuint texture, const wyStreamVertex* vertices, int count) {
+		wyStreamVertex* v = reserve(mode, texture, count);
+		if(v == NULL)
+			return;
+		memcpy(v, vertices, count * sizeof(wyStreamVertex));
+
+		// strips and fans can't be joined with next append
+		if(mode != GL_TRIANGLES && mode != GL_LINES && mode != GL_POINTS)
+			flush();
+	}
+
+	/**
+	 * \if English
+	 * Append a textured quad, as two triangles
+	 *
+	 * @param tex texture
+	 * @param texRect area of texture in pixels, origin is left top
+	 * @param dst destination rectangle
+	 * @param color vertex color
+	 * \else
+	 * 追加一个有贴图的矩形, 作为两个三角形
+	 *
+	 * @param tex 贴图
+	 * @param texRect 贴图区域, 单位为像素, 原点在左上角
+	 * @param dst 目标矩形
+	 * @param color 顶点颜色
+	 * \endif
+	 */
+	void appendTexture(wyTexture2D* tex, wyRect texRect, wyRect dst, wyColor4B color) {
+		wyStreamVertex* v = reserve(GL_TRIANGLES, tex->getTexture(), 6);
+		if(v == NULL)
+			return;
+		float left = texRect.x / tex->getWidth() * tex->getWidthScale();
+		float right = (texRect.x + texRect.width) / tex->getWidth() * tex->getWidthScale();
+		float top = texRect.y / tex->getHeight() * tex->getHeightScale();
+		float bottom = (texRect.y + texRect.height) / tex->getHeight() * tex->getHeightScale();
+		float x1 = dst.x + dst.width;
+		float y1 = dst.y + dst.height;
+		setVertex(v, dst.x, dst.y, left, bottom, color);
+		setVertex(v + 1, x1, dst.y, right, bottom, color);
+		setVertex(v + 2, dst.x, y1, left, top, color);
+		setVertex(v + 3, dst.x, y1, left, top, color);
+		setVertex(v + 4, x1, dst.y, right, bottom, color);
+		setVertex(v + 5, x1, y1, right, top, color);
+	}
+
+	/**
+	 * \if English
+	 * Append a textured quad with atlas style coordinates, as two triangles
+	 *
+	 * @param texture OpenGL texture name
+	 * @param quadT texture coordinates
+	 * @param quadV vertices, z is ignored
+	 * @param color vertex color
+	 * \else
+	 * 以atlas格式的坐标追加一个有贴图的矩形, 作为两个三角形
+	 *
+	 * @param texture OpenGL贴图名
+	 * @param quadT 贴图坐标
+	 * @param quadV 顶点, 忽略z坐标
+	 * @param color 顶点颜色
+	 * \endif
+	 */
+	void appendQuad(GLuint texture, wyQuad2D& quadT, wyQuad3D& quadV, wyColor4B color) {
+		wyStreamVertex* v = reserve(GL_TRIANGLES, texture, 6);
+		if(v == NULL)
+			return;
+		setVertex(v, quadV.bl_x, quadV.bl_y, quadT.bl_x, quadT.bl_y, color);
+		setVertex(v + 1, quadV.br_x, quadV.br_y, quadT.br_x, quadT.br_y, color);
+		setVertex(v + 2, quadV.tl_x, quadV.tl_y, quadT.tl_x, quadT.tl_y, color);
+		v[3] = v[2];
+		v[4] = v[1];
+		setVertex(v + 5, quadV.tr_x, quadV.tr_y, quadT.tr_x, quadT.tr_y, color);
+	}
+
+	/**
+	 * \if English
+	 * Append an untextured line segment
+	 * \else
+	 * 追加一条没有贴图的线段
+	 * \endif
+	 */
+	void appendLine(float x1, float y1, float x2, float y2, wyColor4B color) {
+		wyStreamVertex* v = reserve(GL_LINES, 0, 2);
+		if(v == NULL)
+			return;
+		setVertex(v, x1, y1, 0, 0, color);
+		setVertex(v + 1, x2, y2, 0, 0, color);
+	}
+
+	/**
+	 * \if English
+	 * Append an untextured triangle
+	 * \else
+	 * 追加一个没有贴图的三角形
+	 * \endif
+	 */
+	void appendTriangle(float x1, float y1, float x2, float y2, float x3, float y3, wyColor4B color) {
+		wyStreamVertex* v = reserve(GL_TRIANGLES, 0, 3);
+		if(v == NULL)
+			return;
+		setVertex(v, x1, y1, 0, 0, color);
+		setVertex(v + 1, x2, y2, 0, 0, color);
+		setVertex(v + 2, x3, y3, 0, 0, color);
+	}
+
+	/// 得到一次追加最多能容纳的顶点数, 更多的顶点需要分段追加
+	int getMaxAppendVertices() { return m_size / sizeof(wyStreamVertex); }
+
+	/// 得到绘制次数
+	int getDrawCount() { return m_drawCount; }
+
+	/// 得到追加次数
+	int getAppendCount() { return m_appendCount; }
+
+	/// 得到丢弃旧存储的次数
+	int getOrphanCount() { return m_orphanCount; }
+
+	/// 清空计数
+	void resetCounters() {
+		m_drawCount = 0;
+		m_appendCount = 0;
+		m_orphanCount = 0;
+	}
+};
+
+#endif // __wyStreamBuffer_h__
@@ -0,0 +1,448 @@
+/*
+ * Copyright (c) 2010 WiYun Inc.
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __wyTextureBudget_h__
+#define __wyTextureBudget_h__
+
+#include <stdlib.h>
+#include <stddef.h>
+#include "wyObject.h"
+#include "wyArray.h"
+#include "wyNode.h"
+#include "wyTexture2D.h"
+#include "wyTextureManager.h"
+#include "wyScheduler.h"
+#include "wyTargetSelector.h"
+#include "wyLog.h"
+
+/// 缺省的贴图内存预算, 单位字节
+#define WY_TEXTURE_BUDGET_DEFAULT_BYTES (24 * 1024 * 1024)
+
+/// 缺省的最少空闲帧数, 贴图在这么多帧没有被使用后才可能被回收
+#define WY_TEXTURE_BUDGET_DEFAULT_IDLE_FRAMES 60
+
+/**
+ * @struct wyBudgetedTexture
+ *
+ * 被预算管理的贴图的记录
+ */
+typedef struct wyBudgetedTexture {
+	/// 贴图
+	wyTexture2D* tex;
+
+	/// 使用贴图的节点, 节点在运行并且可见时认为贴图被使用. 可以为NULL
+	wyNode* node;
+
+	/// 估计的显存占用, 单位字节
+	size_t bytes;
+
+	/// 因为补齐到2的幂而浪费的字节数
+	size_t wasted;
+
+	/// 最后一次被使用的帧号
+	int lastUsedFrame;
+
+	/// true表示贴图当前在显存中
+	bool resident;
+} wyBudgetedTexture;
+
+/**
+ * @class wyTextureBudget
+ *
+ * \if English
+ * Enforces a budget of texture memory. \link wyTextureManager wyTextureManager\endlink keeps every
+ * texture until it is removed explicitly, so a game which goes through many scenes keeps growing.
+ * Tracked textures get an estimated GPU size (pixel format x padded POT size). When resident bytes
+ * exceed budget, textures not used in recent frames are evicted in least recently used order with
+ * \c wyTextureManager::removeTexture, which keeps the handle and source of texture. If an evicted
+ * texture is accessed again, texture manager reloads it from its recorded source transparently.
+ *
+ * A texture is used in a frame if \c touch is called for it, or if node passed to \c track is
+ * running and visible.
+ * \else
+ * 限制贴图内存的预算. \link wyTextureManager wyTextureManager\endlink会保留所有贴图直到被显式删除,
+ * 因此经过很多场景的游戏内存会持续增长. 被跟踪的贴图会得到一个估计的显存大小(贴图格式乘以补齐后的2的幂
+ * 尺寸). 当在显存中的字节数超过预算时, 最近没有使用的贴图按最近最少使用的顺序通过\c wyTextureManager::removeTexture
+ * 回收, 这个方法会保留贴图的句柄和来源. 如果被回收的贴图又被访问, 贴图管理器会透明的从记录的来源重新载入.
+ *
+ * 如果对贴图调用了\c touch, 或者传给\c track的节点正在运行并且可见, 则认为贴图在这一帧被使用.
+ * \endif
+ */
+class wyTextureBudget : public wyObject {
+private:
+	/// 被跟踪的贴图, 元素是\link wyBudgetedTexture wyBudgetedTexture\endlink
+	wyArray* m_textures;
+
+	/// 预算, 单位字节
+	size_t m_budget;
+
+	/// 在显存中的贴图的估计字节数
+	size_t m_residentBytes;
+
+	/// 在显存中的贴图因为补齐浪费的字节数
+	size_t m_wastedBytes;
+
+	/// 最少空闲帧数
+	int m_minIdleFrames;
+
+	/// 当前帧号
+	int m_frame;
+
+	/// 回收的次数
+	int m_evictions;
+
+	/// 被回收后又被使用的次数
+	int m_reloads;
+
+	/// 每帧检查的定时器
+	wyTimer* m_timer;
+
+private:
+	wyTextureBudget() :
+			m_textures(wyArrayNew(32)),
+			m_budget(WY_TEXTURE_BUDGET_DEFAULT_BYTES),
+			m_residentBytes(0),
+			m_wastedBytes(0),
+			m_minIdleFrames(WY_TEXTURE_BUDGET_DEFAULT_IDLE_FRAMES),
+			m_frame(0),
+			m_evictions(0),
+			m_reloads(0),
+			m_timer(NULL) {
+	}
+
+	wyBudgetedTexture* find(wyTexture2D* tex) {
+		for(int i = 0; i < m_textures->num; i++) {
+			wyBudgetedTexture* bt = (wyBudgetedTexture*)wyArrayGet(m_textures, i);
+			if(bt->tex == tex)
+				return bt;
+		}
+		return NULL;
+	}
+
+	void markUsed(wyBudgetedTexture* bt) {
+		bt->lastUsedFrame = m_frame;
+		if(!bt->resident) {
+			bt->resident = true;
+			m_residentBytes += bt->bytes;
+			m_wastedBytes += bt->wasted;
+			m_reloads++;
+		}
+	}
+
+	void evict(wyBudgetedTexture* bt) {
+		wyTextureManager::getInstance()->removeTexture(bt->tex, false);
+		bt->resident = false;
+		m_residentBytes -= bt->bytes;
+		m_wastedBytes -= bt->wasted;
+		m_evictions++;
+	}
+
+	void enforce() {
+		while(m_residentBytes > m_budget) {
+			// find least recently used texture which is idle long enough
+			wyBudgetedTexture* lru = NULL;
+			for(int i = 0; i < m_textures->num; i++) {
+				wyBudgetedTexture* bt = (wyBudgetedTexture*)wyArrayGet(m_textures, i);
+				if(!bt->resident || m_frame - bt->lastUsedFrame < m_minIdleFrames)
+					continue;
+				if(lru == NULL || bt->lastUsedFrame < lru->lastUsedFrame)
+					lru = bt;
+			}
+			if(lru == NULL)
+				break;
+			evict(lru);
+		}
+	}
+
+public:
+	/**
+	 * \if English
+	 * Estimate GPU bytes of a texture
+	 *
+	 * @param tex texture, its pixel size is padded POT size
+	 * @param format pixel format of texture
+	 * @return estimated bytes
+	 * \else
+	 * 估计贴图占用的显存字节数
+	 *
+	 * @param tex 贴图, 它的像素尺寸是补齐后的2的幂尺寸
+	 * @param format 贴图格式
+	 * @return 估计的字节数
+	 * \endif
+	 */
+	static size_t estimateBytes(wyTexture2D* tex, wyTexturePixelFormat format) {
+		size_t pixels = (size_t)tex->getPixelWidth() * tex->getPixelHeight();
+		if(tex->getSource() == SOURCE_PVR)
+			return pixels / 2;
+
+		switch(format) {
+			case WY_TEXTURE_PIXEL_FORMAT_RGBA8888:
+				return pixels * 4;
+			case WY_TEXTURE_PIXEL_FORMAT_A8:
+				return pixels;
+			default:
+				return pixels * 2;
+		}
+	}
+
+	/**
+	 * \if English
+	 * Estimate bytes wasted by padding texture to power of two. Content size of texture is
+	 * its pixel size multiplied by width and height scale.
+	 *
+	 * @param tex texture
+	 * @param format pixel format of texture
+	 * @return estimated wasted bytes
+	 * \else
+	 * 估计贴图补齐到2的幂浪费的字节数. 贴图内容的大小是像素大小乘以宽度和高度比例.
+	 *
+	 * @param tex 贴图
+	 * @param format 贴图格式
+	 * @return 估计浪费的字节数
+	 * \endif
+	 */
+	static size_t estimateWastedBytes(wyTexture2D* tex, wyTexturePixelFormat format) {
+		int pw = tex->getPixelWidth();
+		int ph = tex->getPixelHeight();
+		int w = (int)(pw * tex->getWidthScale() + 0.5f);
+		int h = (int)(ph * tex->getHeightScale() + 0.5f);
+		if(pw <= 0 || ph <= 0 || (w >= pw && h >= ph))
+			return 0;
+		double usedRatio = (double)w * h / ((double)pw * ph);
+		return (size_t)(estimateBytes(tex, format) * (1 - usedRatio));
+	}
+
+	/**
+	 * \if English
+	 * Get singleton
+	 * \else
+	 * 得到单例
+	 * \endif
+	 */
+	static wyTextureBudget* getInstance() {
+		static wyTextureBudget* s_instance = NULL;
+		if(s_instance == NULL)
+			s_instance = new wyTextureBudget();
+		return s_instance;
+	}
+
+	virtual ~wyTextureBudget() {
+		stop();
+		while(m_textures->num > 0)
+			untrack(((wyBudgetedTexture*)wyArrayGet(m_textures, 0))->tex);
+		wyArrayDestroy(m_textures);
+	}
+
+	/// @see wyObject::onTargetSelectorInvoked
+	virtual void onTargetSelectorInvoked(wyTargetSelector* ts) {
+		m_frame++;
+		for(int i = 0; i < m_textures->num; i++) {
+			wyBudgetedTexture* bt = (wyBudgetedTexture*)wyArrayGet(m_textures, i);
+			if(bt->node && bt->node->isRunning() && bt->node->isVisible())
+				markUsed(bt);
+		}
+		enforce();
+	}
+
+	/**
+	 * \if English
+	 * Start checking budget every frame
+	 * \else
+	 * 开始每帧检查预算
+	 * \endif
+	 */
+	void start() {
+		if(m_timer)
+			return;
+		m_timer = wyTimer::make(wyTargetSelector::make(this, 0, NULL));
+		m_timer->retain();
+		wyScheduler::getInstance()->scheduleLocked(m_timer);
+	}
+
+	/**
+	 * \if English
+	 * Stop checking budget
+	 * \else
+	 * 停止检查预算
+	 * \endif
+	 */
+	void stop() {
+		if(m_timer) {
+			wyScheduler::getInstance()->unscheduleLocked(m_timer);
+			m_timer->release();
+			m_timer = NULL;
+		}
+	}
+
+	/**
+	 * \if English
+	 * Track a texture. Texture created by \c wyTexture2D::makeGL is ignored because
+	 * it can't be reloaded.
+	 *
+	 * @param tex texture
+	 * @param node node using this texture, can be NULL. If not NULL, texture is used
+	 * 		in every frame when node is running and visible
+	 * @param format pixel format of texture, default is current default format of texture manager
+	 * \else
+	 * 跟踪一个贴图. 通过\c wyTexture2D::makeGL创建的贴图会被忽略, 因为它无法被重新载入.
+	 *
+	 * @param tex 贴图
+	 * @param node 使用这个贴图的节点, 可以为NULL. 如果不为NULL, 节点运行并且可见的每一帧都认为
+	 * 		贴图被使用
+	 * @param format 贴图格式, 缺省是贴图管理器当前的缺省格式
+	 * \endif
+	 */
+	void track(wyTexture2D* tex, wyNode* node = NULL, wyTexturePixelFormat format = wyTextureManager::getInstance()->getTexturePixelFormat()) {
+		if(tex->getSource() == SOURCE_OPENGL || find(tex) != NULL)
+			return;
+
+		wyBudgetedTexture* bt = (wyBudgetedTexture*)malloc(sizeof(wyBudgetedTexture));
+		bt->tex = tex;
+		bt->node = node;
+		bt->bytes = estimateBytes(tex, format);
+		bt->wasted = estimateWastedBytes(tex, format);
+		bt->lastUsedFrame = m_frame;
+		bt->resident = true;
+		tex->retain();
+		wyObjectRetain(node);
+		wyArrayPush(m_textures, bt);
+		m_residentBytes += bt->bytes;
+		m_wastedBytes += bt->wasted;
+	}
+
+	/**
+	 * \if English
+	 * Stop tracking a texture, texture is not removed
+	 *
+	 * @param tex texture
+	 * \else
+	 * 停止跟踪一个贴图, 贴图不会被删除
+	 *
+	 * @param tex 贴图
+	 * \endif
+	 */
+	void untrack(wyTexture2D* tex) {
+		for(int i = 0; i < m_textures->num; i++) {
+			wyBudgetedTexture* bt = (wyBudgetedTexture*)wyArrayGet(m_textures, i);
+			if(bt->tex == tex) {
+				if(bt->resident) {
+					m_residentBytes -= bt->bytes;
+					m_wastedBytes -= bt->wasted;
+				}
+				wyArrayDeleteIndex(m_textures, i);
+				wyObjectRelease(bt->node);
+				bt->tex->release();
+				free(bt);
+				return;
+			}
+		}
+	}
+
+	/**
+	 * \if English
+	 * Mark a texture as used in current frame. If texture was evicted, it will be
+	 * reloaded by texture manager when it is drawn.
+	 *
+	 * @param tex texture
+	 * \else
+	 * 标记贴图在当前帧被使用. 如果贴图已被回收, 它在绘制时会被贴图管理器重新载入.
+	 *
+	 * @param tex 贴图
+	 * \endif
+	 */
+	void touch(wyTexture2D* tex) {
+		wyBudgetedTexture* bt = find(tex);
+		if(bt)
+			markUsed(bt);
+	}
+
+	/**
+	 * \if English
+	 * Evict all idle textures now regardless of budget, for example when a level is finished
+	 * \else
+	 * 不管预算立即回收所有空闲的贴图, 比如在一关结束时
+	 * \endif
+	 */
+	void trim() {
+		for(int i = 0; i < m_textures->num; i++) {
+			wyBudgetedTexture* bt = (wyBudgetedTexture*)wyArrayGet(m_textures, i);
+			if(bt->resident && m_frame - bt->lastUsedFrame >= m_minIdleFrames)
+				evict(bt);
+		}
+	}
+
+	/**
+	 * \if English
+	 * Set budget
+	 *
+	 * @param bytes budget in bytes
+	 * \else
+	 * 设置预算
+	 *
+	 * @param bytes 预算, 单位字节
+	 * \endif
+	 */
+	void setBudget(size_t bytes) { m_budget = bytes; }
+
+	/// 得到预算, 单位字节
+	size_t getBudget() { return m_budget; }
+
+	/// 设置最少空闲帧数, 贴图在这么多帧没有被使用后才可能被回收
+	void setMinIdleFrames(int frames) { m_minIdleFrames = frames; }
+
+	/// 得到最少空闲帧数
+	int getMinIdleFrames() { return m_minIdleFrames; }
+
+	/// 得到在显存中的贴图的估计字节数
+	size_t getResidentBytes() { return m_residentBytes; }
+
+	/// 得到在显存中的贴图因为补齐到2的幂浪费的字节数
+	size_t getWastedBytes() { return m_wastedBytes; }
+
+	/**
+	 * \if English
+	 * Get bytes wasted by padding a tracked texture to power of two
+	 *
+	 * @param tex texture
+	 * @return wasted bytes, 0 if texture is not tracked
+	 * \else
+	 * 得到一个被跟踪的贴图因为补齐到2的幂浪费的字节数
+	 *
+	 * @param tex 贴图
+	 * @return 浪费的字节数, 如果贴图没有被跟踪返回0
+	 * \endif
+	 */
+	size_t getWastedBytes(wyTexture2D* tex) {
+		wyBudgetedTexture* bt = find(tex);
+		return bt ? bt->wasted : 0;
+	}
+
+	/// 得到回收的次数
+	int getEvictionCount() { return m_evictions; }
+
+	/// 得到被回收后又被使用的次数
+	int getReloadCount() { return m_reloads; }
+
+	/// 得到被跟踪的贴图数
+	int getTrackedCount() { return m_textures->num; }
+};
+
+#endif // __wyTextureBudget_h__
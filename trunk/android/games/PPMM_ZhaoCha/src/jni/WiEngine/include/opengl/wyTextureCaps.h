@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2010 WiYun Inc.
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __wyTextureCaps_h__
+#define __wyTextureCaps_h__
+
+#include "wyDirector.h"
+#include "wyUtils.h"
+
+/**
+ * @class wyTextureCaps
+ *
+ * \if English
+ * Texture capabilities of current OpenGL driver. \c wyGLTexture2D::initSize always rounds texture
+ * size up to power of two, so a 480x320 image occupies a 512x512 texture. When driver supports
+ * non power of two textures, textures uploaded by helpers such as \link wyPixelCache wyPixelCache\endlink
+ * use exact image size with clamp to edge wrapping, and power of two is kept as fallback.
+ * \else
+ * 当前OpenGL驱动的贴图能力. \c wyGLTexture2D::initSize总是把贴图大小向上取整到2的幂, 因此一个
+ * 480x320的图片会占用512x512的贴图. 当驱动支持非2的幂贴图时, 通过\link wyPixelCache wyPixelCache\endlink
+ * 等工具上传的贴图使用图片的实际大小和clamp to edge的包裹方式, 2的幂作为后备方案.
+ * \endif
+ */
+class wyTextureCaps {
+private:
+	/// 是否已经检查过扩展
+	bool m_checked;
+
+	/// 是否支持非2的幂贴图
+	bool m_npot;
+
+	/// 是否允许使用非2的幂贴图
+	bool m_npotEnabled;
+
+private:
+	wyTextureCaps() :
+			m_checked(false),
+			m_npot(false),
+			m_npotEnabled(true) {
+	}
+
+public:
+	/**
+	 * \if English
+	 * Get singleton
+	 * \else
+	 * 得到单例
+	 * \endif
+	 */
+	static wyTextureCaps* getInstance() {
+		static wyTextureCaps s_instance;
+		return &s_instance;
+	}
+
+	/**
+	 * \if English
+	 * Does driver support non power of two textures. OpenGL surface must be created
+	 * before first call, extensions are checked only once.
+	 *
+	 * @return true if any npot extension is supported and npot is not disabled
+	 * \else
+	 * 驱动是否支持非2的幂贴图. 第一次调用前OpenGL surface必须已经创建, 扩展只检查一次.
+	 *
+	 * @return true表示支持某个npot扩展并且没有禁用npot
+	 * \endif
+	 */
+	bool isNPOTSupported() {
+		if(!m_checked) {
+			wyDirector* d = wyDirector::getInstance();
+			m_npot = d->isExtensionSupported("GL_OES_texture_npot") ||
+					d->isExtensionSupported("GL_ARB_texture_non_power_of_two") ||
+					d->isExtensionSupported("GL_IMG_texture_npot") ||
+					d->isExtensionSupported("GL_APPLE_texture_2D_limited_npot");
+			m_checked = true;
+		}
+		return m_npot && m_npotEnabled;
+	}
+
+	/**
+	 * \if English
+	 * Enable or disable npot textures, for example to compare memory usage
+	 *
+	 * @param enabled false forces power of two textures
+	 * \else
+	 * 启用或禁用非2的幂贴图, 比如用来对比内存占用
+	 *
+	 * @param enabled false表示强制使用2的幂贴图
+	 * \endif
+	 */
+	void setNPOTEnabled(bool enabled) { m_npotEnabled = enabled; }
+
+	/**
+	 * \if English
+	 * Get size of texture allocated for an image
+	 *
+	 * @param width width of image
+	 * @param height height of image
+	 * @param texWidth returns width of texture
+	 * @param texHeight returns height of texture
+	 * \else
+	 * 得到为一个图片分配的贴图大小
+	 *
+	 * @param width 图片宽度
+	 * @param height 图片高度
+	 * @param texWidth 返回贴图宽度
+	 * @param texHeight 返回贴图高度
+	 * \endif
+	 */
+	void textureSize(int width, int height, int* texWidth, int* texHeight) {
+		if(isNPOTSupported()) {
+			*texWidth = width;
+			*texHeight = height;
+		} else {
+			*texWidth = wyUtils::getNextPOT(width);
+			*texHeight = wyUtils::getNextPOT(height);
+		}
+	}
+
+	/**
+	 * \if English
+	 * Get bytes wasted by padding an image to texture size
+	 *
+	 * @param width width of image
+	 * @param height height of image
+	 * @param texWidth width of texture
+	 * @param texHeight height of texture
+	 * @param bpp bytes per pixel
+	 * @return wasted bytes
+	 * \else
+	 * 得到把图片补齐到贴图大小浪费的字节数
+	 *
+	 * @param width 图片宽度
+	 * @param height 图片高度
+	 * @param texWidth 贴图宽度
+	 * @param texHeight 贴图高度
+	 * @param bpp 每个像素的字节数
+	 * @return 浪费的字节数
+	 * \endif
+	 */
+	static size_t wastedBytes(int width, int height, int texWidth, int texHeight, int bpp) {
+		return ((size_t)texWidth * texHeight - (size_t)width * height) * bpp;
+	}
+};
+
+#endif // __wyTextureCaps_h__
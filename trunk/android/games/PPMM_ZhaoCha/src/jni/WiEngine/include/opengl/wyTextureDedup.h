@@ -0,0 +1,468 @@
+/*
+ * Copyright (c) 2010 WiYun Inc.
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __wyTextureDedup_h__
+#define __wyTextureDedup_h__
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "wyObject.h"
+#include "wyHashSet.h"
+#include "wyTexture2D.h"
+#include "wyTextureManager.h"
+#include "wyPixelConvert.h"
+#include "wyUtils.h"
+#include "wyGlobal.h"
+#include "wyMurmurHash.h"
+#include "wyLog.h"
+
+/**
+ * @typedef wyTextureAliasKind
+ *
+ * 贴图的来源类型
+ */
+typedef enum {
+	/// 资源id
+	TEXTURE_ALIAS_RESOURCE,
+
+	/// assets路径
+	TEXTURE_ALIAS_ASSET,
+
+	/// 文件系统路径
+	TEXTURE_ALIAS_FILE,
+
+	/// 内存文件系统中的名字
+	TEXTURE_ALIAS_MEMORY
+} wyTextureAliasKind;
+
+/**
+ * @class wyTextureDedup
+ *
+ * \if English
+ * Deduplicates textures by content. \link wyTextureManager wyTextureManager\endlink keys textures by
+ * resource id, path string or MD5 of data, so a same image reachable through an asset path, a file
+ * path and a memory file system name is decoded and uploaded once for each. Textures created through
+ * this class are keyed by a 64 bit MurmurHash of encoded bytes, which is much faster than MD5, and
+ * every alias maps to one shared \link wyTexture2D wyTexture2D\endlink. Same bytes decoded at
+ * different scale, because of a different density, are different textures. Once an alias is resolved,
+ * it is not read again.
+ *
+ * Content hashing costs one read of encoded bytes per new alias, it can be disabled with
+ * \c setEnabled, then textures are created by \link wyTexture2D wyTexture2D\endlink directly.
+ * \else
+ * 按内容对贴图去重. \link wyTextureManager wyTextureManager\endlink以资源id, 路径字符串或者数据的MD5作为
+ * 贴图的键值, 因此一个可以通过assets路径, 文件路径和内存文件系统名字访问的图片, 每种方式都会被解码和上传
+ * 一次. 通过这个类创建的贴图以编码数据的64位MurmurHash为键值, 比MD5快得多, 所有别名都映射到同一个共享的
+ * \link wyTexture2D wyTexture2D\endlink. 同样的数据因为density不同以不同比例解码时, 是不同的贴图. 一个别名
+ * 被解析后, 不会再被读取.
+ *
+ * 对每个新的别名, 内容哈希需要读取一次编码数据, 可以通过\c setEnabled禁用, 此时贴图直接通过
+ * \link wyTexture2D wyTexture2D\endlink创建.
+ * \endif
+ */
+class wyTextureDedup : public wyObject {
+private:
+	/// 一份内容对应的贴图
+	typedef struct wyContentEntry {
+		/// 编码数据的哈希
+		uint64_t hash;
+
+		/// 编码数据的长度
+		int length;
+
+		/// 贴图格式
+		wyTexturePixelFormat format;
+
+		/// 解码时的缩放比例, 同样的数据以不同比例解码得到不同大小的贴图
+		float scale;
+
+		/// 共享的贴图, 已经被retain
+		wyTexture2D* tex;
+
+		/// 当前场景中被别名命中的次数
+		int sceneHits;
+	} wyContentEntry;
+
+	/// 一个别名
+	typedef struct wyAliasEntry {
+		/// 来源类型
+		wyTextureAliasKind kind;
+
+		/// 路径或名字, 资源id时为NULL
+		const char* name;
+
+		/// 资源id
+		int resId;
+
+		/// 贴图格式
+		wyTexturePixelFormat format;
+
+		/// 图片的density, 已经把0解析为缺省值, 资源id时为0, 因为资源的density由所在目录决定
+		float inDensity;
+
+		/// 对应的内容
+		wyContentEntry* content;
+	} wyAliasEntry;
+
+	/// 内容哈希表
+	wyHashSet* m_contents;
+
+	/// 别名哈希表
+	wyHashSet* m_aliases;
+
+	/// 是否启用内容哈希
+	bool m_enabled;
+
+	/// 当前场景中避免的重复编码字节数
+	size_t m_sceneDuplicateBytes;
+
+	/// 总共避免的重复编码字节数
+	size_t m_totalDuplicateBytes;
+
+	/// 总共避免的重复贴图字节数
+	size_t m_totalDuplicateTextureBytes;
+
+private:
+	wyTextureDedup() :
+			m_contents(wyHashSetNew(64, contentEquals, insertEntry)),
+			m_aliases(wyHashSetNew(64, aliasEquals, insertEntry)),
+			m_enabled(true),
+			m_sceneDuplicateBytes(0),
+			m_totalDuplicateBytes(0),
+			m_totalDuplicateTextureBytes(0) {
+	}
+
+	/// 哈希表插入时总是调用转换函数, 插入的已经是分配好的条目, 直接使用
+	static void* insertEntry(void* ptr, void* data) {
+		return ptr;
+	}
+
+	static int contentEquals(void* ptr, void* elt) {
+		wyContentEntry* a = (wyContentEntry*)ptr;
+		wyContentEntry* b = (wyContentEntry*)elt;
+		return a->hash == b->hash && a->length == b->length && a->format == b->format && a->scale == b->scale;
+	}
+
+	static int aliasEquals(void* ptr, void* elt) {
+		wyAliasEntry* a = (wyAliasEntry*)ptr;
+		wyAliasEntry* b = (wyAliasEntry*)elt;
+		if(a->kind != b->kind || a->format != b->format || a->inDensity != b->inDensity)
+			return false;
+		return a->kind == TEXTURE_ALIAS_RESOURCE ? a->resId == b->resId : !strcmp(a->name, b->name);
+	}
+
+	static unsigned int aliasHash(wyAliasEntry* a) {
+		uint32_t h = 2166136261u ^ (a->kind * 31 + a->format);
+		h = (h ^ (uint32_t)(a->inDensity * 1000)) * 16777619u;
+		if(a->kind == TEXTURE_ALIAS_RESOURCE) {
+			h = (h ^ a->resId) * 16777619u;
+		} else {
+			for(const char* p = a->name; *p; p++)
+				h = (h ^ (uint8_t)*p) * 16777619u;
+		}
+		return h;
+	}
+
+	static bool releaseAlias(void* elt, void* data) {
+		wyAliasEntry* a = (wyAliasEntry*)elt;
+		if(data == NULL || a->content == data) {
+			if(a->name)
+				free((void*)a->name);
+			free(a);
+			return false;
+		}
+		return true;
+	}
+
+	static bool releaseContent(void* elt, void* data) {
+		wyContentEntry* c = (wyContentEntry*)elt;
+		if(data == NULL || c->tex == data) {
+			wyObjectRelease(c->tex);
+			free(c);
+			return false;
+		}
+		return true;
+	}
+
+	static bool addSceneTextureBytes(void* elt, void* data) {
+		wyContentEntry* c = (wyContentEntry*)elt;
+		if(c->sceneHits > 0) {
+			*(size_t*)data += (size_t)c->sceneHits * c->tex->getPixelWidth() * c->tex->getPixelHeight() * wyPixelConvert::bytesPerPixel(c->format);
+			c->sceneHits = 0;
+		}
+		return true;
+	}
+
+	/// 和引擎一样, 只有密度适配模式才按图片和屏幕的density缩放贴图
+	static float textureScale(float inDensity) {
+		return wyGlobal::scaleMode == SCALE_MODE_BY_DENSITY ? wyGlobal::density / inDensity : 1.f;
+	}
+
+	/// 载入别名的编码数据, 返回的数据需要释放时\c owned为true, \c scale返回解码时的缩放比例
+	static const char* loadEncoded(wyAliasEntry* a, int* length, bool* owned, float* scale) {
+		*owned = true;
+		*scale = a->kind == TEXTURE_ALIAS_RESOURCE ? 1.f : textureScale(a->inDensity);
+		switch(a->kind) {
+			case TEXTURE_ALIAS_RESOURCE:
+			{
+				// resource density comes from its folder
+				float resDensity = 0;
+				const char* data = wyUtils::loadRaw(a->resId, length, &resDensity);
+				if(resDensity > 0)
+					*scale = textureScale(resDensity);
+				return data;
+			}
+			case TEXTURE_ALIAS_ASSET:
+				return wyUtils::loadRaw(a->name, false, length);
+			case TEXTURE_ALIAS_FILE:
+				return wyUtils::loadRaw(a->name, true, length);
+			default:
+			{
+				const char* buffer = NULL;
+				*owned = false;
+				return wyUtils::getFile(a->name, &buffer, length) ? buffer : NULL;
+			}
+		}
+	}
+
+	/// 通过引擎创建贴图
+	static wyTexture2D* create(wyAliasEntry* a, bool png, float inDensity) {
+		switch(a->kind) {
+			case TEXTURE_ALIAS_RESOURCE:
+				return png ? wyTexture2D::makePNG(a->resId, a->format) : wyTexture2D::makeJPG(a->resId, a->format);
+			case TEXTURE_ALIAS_ASSET:
+				return png ? wyTexture2D::makePNG(a->name, a->format, inDensity) : wyTexture2D::makeJPG(a->name, a->format, inDensity);
+			case TEXTURE_ALIAS_FILE:
+				return png ? wyTexture2D::makeFilePNG(a->name, a->format, inDensity) : wyTexture2D::makeFileJPG(a->name, a->format, inDensity);
+			default:
+				return png ? wyTexture2D::makeMemoryPNG(a->name, a->format, inDensity) : wyTexture2D::makeMemoryJPG(a->name, a->format, inDensity);
+		}
+	}
+
+	wyTexture2D* make(wyTextureAliasKind kind, const char* name, int resId, bool png, wyTexturePixelFormat format, float inDensity) {
+		wyAliasEntry key;
+		key.kind = kind;
+		key.name = name;
+		key.resId = resId;
+		key.format = format;
+		key.inDensity = kind == TEXTURE_ALIAS_RESOURCE ? 0 : (inDensity == 0 ? wyGlobal::defaultInDensity : inDensity);
+		key.content = NULL;
+		if(!m_enabled)
+			return create(&key, png, inDensity);
+
+		// known alias
+		unsigned int ah = aliasHash(&key);
+		wyAliasEntry* alias = (wyAliasEntry*)wyHashSetFind(m_aliases, ah, &key);
+		if(alias != NULL)
+			return alias->content->tex;
+
+		// hash encoded bytes
+		int length = 0;
+		bool owned;
+		wyContentEntry ck;
+		const char* data = loadEncoded(&key, &length, &owned, &ck.scale);
+		if(data == NULL)
+			return create(&key, png, inDensity);
+		ck.hash = hash(data, length);
+		ck.length = length;
+		ck.format = format;
+		if(owned)
+			free((void*)data);
+
+		wyContentEntry* content = (wyContentEntry*)wyHashSetFind(m_contents, (unsigned int)ck.hash, &ck);
+		if(content != NULL) {
+			content->sceneHits++;
+			m_sceneDuplicateBytes += length;
+			m_totalDuplicateBytes += length;
+		} else {
+			wyTexture2D* tex = create(&key, png, inDensity);
+			if(tex == NULL)
+				return NULL;
+			content = (wyContentEntry*)malloc(sizeof(wyContentEntry));
+			*content = ck;
+			content->tex = tex;
+			content->sceneHits = 0;
+			wyObjectRetain(tex);
+			wyHashSetInsert(m_contents, (unsigned int)ck.hash, content, NULL);
+		}
+
+		alias = (wyAliasEntry*)malloc(sizeof(wyAliasEntry));
+		*alias = key;
+		alias->name = name == NULL ? NULL : wyUtils::copy(name);
+		alias->content = content;
+		wyHashSetInsert(m_aliases, ah, alias, NULL);
+		return content->tex;
+	}
+
+public:
+	/**
+	 * \if English
+	 * Get singleton
+	 * \else
+	 * 得到单例
+	 * \endif
+	 */
+	static wyTextureDedup* getInstance() {
+		static wyTextureDedup* s_instance = NULL;
+		if(s_instance == NULL)
+			s_instance = new wyTextureDedup();
+		return s_instance;
+	}
+
+	/**
+	 * \if English
+	 * 64 bit MurmurHash2 of a block of data, see \link wyMurmurHash wyMurmurHash\endlink::hash64
+	 * \else
+	 * 一块数据的64位MurmurHash2, 参见\link wyMurmurHash wyMurmurHash\endlink::hash64
+	 * \endif
+	 */
+	static uint64_t hash(const void* data, int length) { return wyMurmurHash::hash64(data, length); }
+
+	/**
+	 * \if English
+	 * Enable or disable content hashing, it is enabled by default. Resolved aliases are kept.
+	 * \else
+	 * 启用或禁用内容哈希, 缺省是启用的. 已经解析的别名会被保留.
+	 * \endif
+	 */
+	void setEnabled(bool enabled) { m_enabled = enabled; }
+
+	/// 是否启用内容哈希
+	bool isEnabled() { return m_enabled; }
+
+	/// 从资源id创建JPG贴图, 参见\c wyTexture2D::makeJPG
+	wyTexture2D* makeJPG(int resId, wyTexturePixelFormat format) {
+		return make(TEXTURE_ALIAS_RESOURCE, NULL, resId, false, format, 0);
+	}
+
+	/// 从assets路径创建JPG贴图, 参见\c wyTexture2D::makeJPG
+	wyTexture2D* makeJPG(const char* assetPath, wyTexturePixelFormat format, float inDensity = 0) {
+		return make(TEXTURE_ALIAS_ASSET, assetPath, 0, false, format, inDensity);
+	}
+
+	/// 从内存文件系统创建JPG贴图, 参见\c wyTexture2D::makeMemoryJPG
+	wyTexture2D* makeMemoryJPG(const char* mfsName, wyTexturePixelFormat format, float inDensity = 0) {
+		return make(TEXTURE_ALIAS_MEMORY, mfsName, 0, false, format, inDensity);
+	}
+
+	/// 从文件系统路径创建JPG贴图, 参见\c wyTexture2D::makeFileJPG
+	wyTexture2D* makeFileJPG(const char* fsPath, wyTexturePixelFormat format, float inDensity = 0) {
+		return make(TEXTURE_ALIAS_FILE, fsPath, 0, false, format, inDensity);
+	}
+
+	/// 从资源id创建PNG贴图, 参见\c wyTexture2D::makePNG
+	wyTexture2D* makePNG(int resId, wyTexturePixelFormat format) {
+		return make(TEXTURE_ALIAS_RESOURCE, NULL, resId, true, format, 0);
+	}
+
+	/// 从assets路径创建PNG贴图, 参见\c wyTexture2D::makePNG
+	wyTexture2D* makePNG(const char* assetPath, wyTexturePixelFormat format, float inDensity = 0) {
+		return make(TEXTURE_ALIAS_ASSET, assetPath, 0, true, format, inDensity);
+	}
+
+	/// 从内存文件系统创建PNG贴图, 参见\c wyTexture2D::makeMemoryPNG
+	wyTexture2D* makeMemoryPNG(const char* mfsName, wyTexturePixelFormat format, float inDensity = 0) {
+		return make(TEXTURE_ALIAS_MEMORY, mfsName, 0, true, format, inDensity);
+	}
+
+	/// 从文件系统路径创建PNG贴图, 参见\c wyTexture2D::makeFilePNG
+	wyTexture2D* makeFilePNG(const char* fsPath, wyTexturePixelFormat format, float inDensity = 0) {
+		return make(TEXTURE_ALIAS_FILE, fsPath, 0, true, format, inDensity);
+	}
+
+	/**
+	 * \if English
+	 * Forget a shared texture and all its aliases, so it can be removed from
+	 * \link wyTextureManager wyTextureManager\endlink
+	 *
+	 * @param tex shared texture
+	 * \else
+	 * 忘记一个共享贴图和它的所有别名, 使它可以从\link wyTextureManager wyTextureManager\endlink中删除
+	 *
+	 * @param tex 共享贴图
+	 * \endif
+	 */
+	void forget(wyTexture2D* tex) {
+		wyContentEntry* content = NULL;
+		for(int i = 0; i < m_contents->size && content == NULL; i++) {
+			for(wyHashSetBin* bin = m_contents->table[i]; bin != NULL; bin = bin->next) {
+				if(((wyContentEntry*)bin->elt)->tex == tex) {
+					content = (wyContentEntry*)bin->elt;
+					break;
+				}
+			}
+		}
+		if(content == NULL)
+			return;
+		wyHashSetFilter(m_aliases, releaseAlias, content);
+		wyHashSetFilter(m_contents, releaseContent, tex);
+	}
+
+	/**
+	 * \if English
+	 * Forget all shared textures and aliases
+	 * \else
+	 * 忘记所有共享贴图和别名
+	 * \endif
+	 */
+	void clear() {
+		wyHashSetFilter(m_aliases, releaseAlias, NULL);
+		wyHashSetFilter(m_contents, releaseContent, NULL);
+	}
+
+	/**
+	 * \if English
+	 * Log duplicate bytes avoided since last report and reset scene counters. Call it when a scene
+	 * finishes loading. It must be called in OpenGL thread because texture size is queried.
+	 *
+	 * @param sceneName name of scene, for log only
+	 * @return texture bytes avoided in this scene
+	 * \else
+	 * 打印上次报告以来避免的重复字节数, 并且重置场景计数. 在一个场景载入完成后调用. 因为需要查询贴图
+	 * 大小, 必须在OpenGL线程中调用.
+	 *
+	 * @param sceneName 场景名称, 只用于日志
+	 * @return 这个场景中避免的贴图字节数
+	 * \endif
+	 */
+	size_t reportScene(const char* sceneName) {
+		size_t textureBytes = 0;
+		wyHashSetEach(m_contents, addSceneTextureBytes, &textureBytes);
+		m_totalDuplicateTextureBytes += textureBytes;
+		if(m_sceneDuplicateBytes > 0)
+			LOGD("wyTextureDedup: %s avoided %d encoded bytes, %d texture bytes, %d aliases resolved",
+					sceneName ? sceneName : "scene", (int)m_sceneDuplicateBytes, (int)textureBytes, m_aliases->entries);
+		m_sceneDuplicateBytes = 0;
+		return textureBytes;
+	}
+
+	/// 得到总共避免的重复编码字节数
+	size_t getDuplicateBytes() { return m_totalDuplicateBytes; }
+
+	/// 得到总共避免的重复贴图字节数, 在\c reportScene中累加
+	size_t getDuplicateTextureBytes() { return m_totalDuplicateTextureBytes; }
+
+	/// 得到共享贴图数
+	int getTextureCount() { return m_contents->entries; }
+};
+
+#endif // __wyTextureDedup_h__
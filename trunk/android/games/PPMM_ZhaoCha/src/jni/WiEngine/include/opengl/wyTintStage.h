@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2010 WiYun Inc.
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __wyTintStage_h__
+#define __wyTintStage_h__
+
+#if ANDROID
+	#include <GLES/gl.h>
+#elif IOS
+	#import <OpenGLES/ES1/gl.h>
+	#import <OpenGLES/ES1/glext.h>
+#endif
+#include <string.h>
+#include "wyObject.h"
+#include "wyTypes.h"
+#include "wyDirector.h"
+#include "wyGLState.h"
+
+/// tint可以嵌套的层数
+#define WY_TINT_STAGE_MAX_DEPTH 8
+
+/**
+ * @class wyTintStage
+ *
+ * \if English
+ * Multiplies everything drawn between \c begin and \c end by a constant color, in O(1) no matter how
+ * many vertices are drawn. \link wyTextureAtlas wyTextureAtlas\endlink::setColor and \c reduceAlpha
+ * rewrite color of every quad, so fading a big atlas node costs thousands of vertex writes per frame.
+ *
+ * Fixed pipeline has no uniforms, so the color is put in \c GL_TEXTURE_ENV_COLOR of texture unit 1 whose
+ * combiner modulates result of unit 0 by \c GL_CONSTANT. Unit 1 samples a 1x1 white texture so that it
+ * is always complete. Engine nodes only use unit 0, so any node, including prebuilt atlas, tile map and
+ * particle nodes, can be drawn inside. Stages can nest, nested colors are multiplied.
+ *
+ * Unit 1 is taken while a stage is active, so content which needs two texture units is drawn without
+ * the stage, such as single draw path of \link wyMultiSpriteBatchNode wyMultiSpriteBatchNode\endlink.
+ * \else
+ * 把\c begin和\c end之间绘制的所有内容乘以一个常量颜色, 不论绘制多少顶点开销都是O(1).
+ * \link wyTextureAtlas wyTextureAtlas\endlink::setColor和\c reduceAlpha会改写每个矩形的颜色, 因此渐变一个
+ * 很大的atlas节点每帧需要写几千个顶点.
+ *
+ * 固定管线没有uniform, 因此颜色放在贴图单元1的\c GL_TEXTURE_ENV_COLOR中, 单元1的组合器用\c GL_CONSTANT乘以
+ * 单元0的结果. 单元1采样一个1x1的白色贴图, 这样它总是完整的. 引擎节点只使用单元0, 因此任何节点, 包括预编译
+ * 的atlas, 地图和粒子节点, 都可以在其中绘制. 可以嵌套, 嵌套的颜色会相乘.
+ *
+ * 激活时单元1被占用, 因此需要两个贴图单元的内容要在没有tint的情况下绘制, 比如
+ * \link wyMultiSpriteBatchNode wyMultiSpriteBatchNode\endlink的一次绘制方式.
+ * \endif
+ */
+class wyTintStage : public wyObject {
+private:
+	/// 白色贴图
+	GLuint m_white;
+
+	/// 当前嵌套深度
+	int m_depth;
+
+	/// 每层累积的颜色
+	GLfloat m_colors[WY_TINT_STAGE_MAX_DEPTH][4];
+
+private:
+	wyTintStage() :
+			m_white(0),
+			m_depth(0) {
+		wyDirectorLifecycleListener l;
+		memset(&l, 0, sizeof(wyDirectorLifecycleListener));
+		l.onSurfaceCreated = onSurfaceCreated;
+		wyDirector::getInstance()->addLifecycleListener(&l, this);
+	}
+
+	static void onSurfaceCreated(void* data) {
+		// texture name is invalid in new context, don't delete it
+		wyTintStage* stage = (wyTintStage*)data;
+		stage->m_white = 0;
+		stage->m_depth = 0;
+	}
+
+	void ensureWhite() {
+		if(m_white != 0)
+			return;
+		static const GLubyte white[4] = { 255, 255, 255, 255 };
+		glGenTextures(1, &m_white);
+		wyGLState::getInstance()->bindTexture(m_white);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+	}
+
+public:
+	/**
+	 * 获得\link wyTintStage wyTintStage\endlink单例
+	 *
+	 * @return \link wyTintStage wyTintStage\endlink
+	 */
+	static wyTintStage* getInstance() {
+		static wyTintStage* s_instance = NULL;
+		if(s_instance == NULL)
+			s_instance = new wyTintStage();
+		return s_instance;
+	}
+
+	virtual ~wyTintStage() {
+	}
+
+	/**
+	 * \if English
+	 * Start tinting, must be called in OpenGL thread and paired with \c end
+	 *
+	 * @param color tint color, alpha multiplies alpha of drawn content
+	 * \else
+	 * 开始tint, 必须在OpenGL线程中调用, 并且和\c end配对
+	 *
+	 * @param color tint颜色, alpha乘到绘制内容的alpha上
+	 * \endif
+	 */
+	void begin(wyColor4B color) {
+		GLfloat* c = m_colors[m_depth < WY_TINT_STAGE_MAX_DEPTH ? m_depth : WY_TINT_STAGE_MAX_DEPTH - 1];
+		c[0] = color.r / 255.f;
+		c[1] = color.g / 255.f;
+		c[2] = color.b / 255.f;
+		c[3] = color.a / 255.f;
+		if(m_depth > 0 && m_depth < WY_TINT_STAGE_MAX_DEPTH) {
+			for(int i = 0; i < 4; i++)
+				c[i] *= m_colors[m_depth - 1][i];
+		}
+		m_depth++;
+
+		wyGLState* gl = wyGLState::getInstance();
+		gl->activeTexture(GL_TEXTURE1);
+		if(m_depth == 1) {
+			ensureWhite();
+			gl->bindTexture(m_white);
+			gl->enable(GL_TEXTURE_2D);
+			glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE);
+			glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_RGB, GL_MODULATE);
+			glTexEnvi(GL_TEXTURE_ENV, GL_SRC0_RGB, GL_PREVIOUS);
+			glTexEnvi(GL_TEXTURE_ENV, GL_OPERAND0_RGB, GL_SRC_COLOR);
+			glTexEnvi(GL_TEXTURE_ENV, GL_SRC1_RGB, GL_CONSTANT);
+			glTexEnvi(GL_TEXTURE_ENV, GL_OPERAND1_RGB, GL_SRC_COLOR);
+			glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_ALPHA, GL_MODULATE);
+			glTexEnvi(GL_TEXTURE_ENV, GL_SRC0_ALPHA, GL_PREVIOUS);
+			glTexEnvi(GL_TEXTURE_ENV, GL_OPERAND0_ALPHA, GL_SRC_ALPHA);
+			glTexEnvi(GL_TEXTURE_ENV, GL_SRC1_ALPHA, GL_CONSTANT);
+			glTexEnvi(GL_TEXTURE_ENV, GL_OPERAND1_ALPHA, GL_SRC_ALPHA);
+		}
+		glTexEnvfv(GL_TEXTURE_ENV, GL_TEXTURE_ENV_COLOR, c);
+
+		// engine binds textures to active unit, give unit 0 back
+		gl->activeTexture(GL_TEXTURE0);
+	}
+
+	/**
+	 * \if English
+	 * End tinting, color of outer stage is restored, or unit 1 is disabled at outermost stage
+	 * \else
+	 * 结束tint, 恢复外层的颜色, 如果是最外层则关闭单元1
+	 * \endif
+	 */
+	void end() {
+		if(m_depth <= 0)
+			return;
+		m_depth--;
+
+		wyGLState* gl = wyGLState::getInstance();
+		gl->activeTexture(GL_TEXTURE1);
+		if(m_depth > 0) {
+			int top = m_depth < WY_TINT_STAGE_MAX_DEPTH ? m_depth - 1 : WY_TINT_STAGE_MAX_DEPTH - 1;
+			glTexEnvfv(GL_TEXTURE_ENV, GL_TEXTURE_ENV_COLOR, m_colors[top]);
+		} else {
+			glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+			gl->disable(GL_TEXTURE_2D);
+		}
+		gl->activeTexture(GL_TEXTURE0);
+	}
+
+	/// 是否正在tint
+	bool isActive() { return m_depth > 0; }
+};
+
+#endif // __wyTintStage_h__
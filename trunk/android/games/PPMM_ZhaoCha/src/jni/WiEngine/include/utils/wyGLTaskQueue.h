@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2010 WiYun Inc.
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __wyGLTaskQueue_h__
+#define __wyGLTaskQueue_h__
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "wyObject.h"
+#include "wyArray.h"
+#include "wyRunnable.h"
+#include "wyScheduler.h"
+#include "wyTargetSelector.h"
+#include "wyLatencyTracker.h"
+#include "wyLog.h"
+
+/// 缺省的每帧时间预算, 单位毫秒
+#define WY_GL_TASK_DEFAULT_BUDGET 4.f
+
+/**
+ * @enum wyGLTaskPriority
+ *
+ * OpenGL线程任务的优先级, 数值越大越先执行
+ */
+typedef enum {
+	/// 低优先级, 比如预载入的资源
+	GL_TASK_PRIORITY_LOW = 0,
+
+	/// 普通优先级
+	GL_TASK_PRIORITY_NORMAL = 50,
+
+	/// 高优先级, 比如当前场景马上要显示的贴图
+	GL_TASK_PRIORITY_HIGH = 100
+} wyGLTaskPriority;
+
+/**
+ * @class wyGLTaskQueue
+ *
+ * \if English
+ * Prioritised queue of work which must run in OpenGL thread, such as texture uploads, buffer
+ * builds and label rasterisations. Unlike \c wyUtils::runOnGLThread, which runs every queued
+ * runnable in next frame, this queue only runs tasks until a per-frame time budget is consumed
+ * and carries the rest to later frames, so large batches of work are spread over frames instead
+ * of producing one long hitch. At least one task runs per frame so queue always makes progress.
+ * Tasks with higher priority run first, tasks with same priority run in posting order.
+ * \else
+ * 需要在OpenGL线程中执行的工作的优先级队列, 比如贴图上传, 缓冲区构建, 标签光栅化. 和\c wyUtils::runOnGLThread
+ * 在下一帧执行所有任务不同, 这个队列每帧只执行任务直到用完时间预算, 剩下的任务留到之后的帧, 因此大量工作
+ * 会被分散到多帧中而不是造成一次长时间卡顿. 每帧至少执行一个任务, 所以队列总是能前进. 优先级高的任务先执行,
+ * 优先级相同的按提交顺序执行.
+ * \endif
+ */
+class wyGLTaskQueue : public wyObject {
+private:
+	/// 队列中的任务
+	typedef struct wyGLTask {
+		/// 要执行的runnable
+		wyRunnable* runnable;
+
+		/// 优先级
+		int priority;
+	} wyGLTask;
+
+	/// 按优先级从高到低排列的任务
+	wyArray* m_tasks;
+
+	/// 保护任务队列的锁
+	pthread_mutex_t m_mutex;
+
+	/// 每帧的时间预算, 单位微秒
+	int64_t m_budget;
+
+	/// 每帧驱动队列的定时器, 在OpenGL线程中创建
+	wyTimer* m_timer;
+
+	/// 上一帧执行的任务数
+	int m_lastFrameTasks;
+
+	/// 上一帧执行任务花费的时间, 单位微秒
+	int64_t m_lastFrameTime;
+
+	/// 因为预算用完而有任务留到下一帧的帧数
+	int m_deferredFrames;
+
+	/// 已经执行的任务总数
+	int m_totalTasks;
+
+private:
+	wyGLTaskQueue() :
+			m_tasks(wyArrayNew(16)),
+			m_budget((int64_t)(WY_GL_TASK_DEFAULT_BUDGET * 1000)),
+			m_timer(NULL),
+			m_lastFrameTasks(0),
+			m_lastFrameTime(0),
+			m_deferredFrames(0),
+			m_totalTasks(0) {
+		pthread_mutex_init(&m_mutex, NULL);
+
+		// refcount and autorelease pool are not thread safe, timer is made here instead of in postLocked
+		m_timer = wyTimer::make(wyTargetSelector::make(this, 0, NULL));
+		m_timer->retain();
+		wyScheduler::getInstance()->scheduleLocked(m_timer);
+	}
+
+	wyGLTask* popTask() {
+		pthread_mutex_lock(&m_mutex);
+		wyGLTask* task = m_tasks->num > 0 ? (wyGLTask*)wyArrayDeleteIndex(m_tasks, 0) : NULL;
+		pthread_mutex_unlock(&m_mutex);
+		return task;
+	}
+
+	void runTask(wyGLTask* task) {
+		task->runnable->run();
+		task->runnable->release();
+		free(task);
+		m_totalTasks++;
+	}
+
+public:
+	/**
+	 * \if English
+	 * Get singleton, first call must be in OpenGL thread because it schedules the timer driving queue
+	 * \else
+	 * 得到单例, 第一次调用必须在OpenGL线程中, 因为它会添加驱动队列的定时器
+	 * \endif
+	 */
+	static wyGLTaskQueue* getInstance() {
+		static wyGLTaskQueue* s_instance = NULL;
+		if(s_instance == NULL)
+			s_instance = new wyGLTaskQueue();
+		return s_instance;
+	}
+
+	virtual ~wyGLTaskQueue() {
+		if(m_timer) {
+			wyScheduler::getInstance()->unscheduleLocked(m_timer);
+			m_timer->release();
+		}
+		for(int i = 0; i < m_tasks->num; i++) {
+			wyGLTask* task = (wyGLTask*)wyArrayGet(m_tasks, i);
+			task->runnable->release();
+			free(task);
+		}
+		wyArrayDestroy(m_tasks);
+		pthread_mutex_destroy(&m_mutex);
+	}
+
+	/// @see wyObject::onTargetSelectorInvoked
+	virtual void onTargetSelectorInvoked(wyTargetSelector* ts) {
+		int64_t start = wyLatencyTracker::currentTimeMicros();
+		int64_t elapsed = 0;
+		int count = 0;
+		wyGLTask* task;
+		while((count == 0 || elapsed < m_budget) && (task = popTask()) != NULL) {
+			runTask(task);
+			count++;
+			elapsed = wyLatencyTracker::currentTimeMicros() - start;
+		}
+
+		m_lastFrameTasks = count;
+		m_lastFrameTime = elapsed;
+		if(count > 0 && getPendingCount() > 0)
+			m_deferredFrames++;
+	}
+
+	/**
+	 * \if English
+	 * Post a task, this method is thread safe. Refcount of runnable is not touched here, because
+	 * refcount is not atomic and this may be called in a worker thread. Caller hands its reference
+	 * over to queue and must not release it, queue releases it in OpenGL thread after it runs.
+	 *
+	 * @param runnable task to run in OpenGL thread, one reference of it is taken over by queue
+	 * @param priority priority of task, bigger value runs first
+	 * \else
+	 * 提交一个任务, 此方法是线程安全的. 这里不改变runnable的引用计数, 因为引用计数不是原子的, 而这个方法
+	 * 可能在工作线程中调用. 调用者把自己的引用交给队列, 不能再release它, 队列在OpenGL线程中执行后释放它.
+	 *
+	 * @param runnable 要在OpenGL线程中执行的任务, 它的一个引用被队列接管
+	 * @param priority 任务的优先级, 值越大越先执行
+	 * \endif
+	 */
+	void postLocked(wyRunnable* runnable, int priority = GL_TASK_PRIORITY_NORMAL) {
+		wyGLTask* task = (wyGLTask*)malloc(sizeof(wyGLTask));
+		task->runnable = runnable;
+		task->priority = priority;
+
+		pthread_mutex_lock(&m_mutex);
+
+		// insert after last task whose priority is not lower, keep fifo in same priority
+		int index = m_tasks->num;
+		while(index > 0 && ((wyGLTask*)wyArrayGet(m_tasks, index - 1))->priority < priority)
+			index--;
+		wyArrayInsert(m_tasks, task, index);
+		pthread_mutex_unlock(&m_mutex);
+	}
+
+	/**
+	 * \if English
+	 * Run all pending tasks immediately regardless of budget, must be called in OpenGL thread.
+	 * It is useful before showing a scene which needs all its resources.
+	 * \else
+	 * 忽略预算立即执行所有待处理的任务, 必须在OpenGL线程中调用. 在显示一个需要所有资源的
+	 * 场景之前可以调用.
+	 * \endif
+	 */
+	void flush() {
+		wyGLTask* task;
+		while((task = popTask()) != NULL)
+			runTask(task);
+	}
+
+	/**
+	 * \if English
+	 * Set time budget per frame
+	 *
+	 * @param ms budget in milliseconds
+	 * \else
+	 * 设置每帧的时间预算
+	 *
+	 * @param ms 时间预算, 单位毫秒
+	 * \endif
+	 */
+	void setBudget(float ms) { m_budget = ms > 0 ? (int64_t)(ms * 1000) : 0; }
+
+	/// 得到每帧的时间预算, 单位毫秒
+	float getBudget() { return m_budget / 1000.f; }
+
+	/// 得到待处理的任务数
+	int getPendingCount() {
+		pthread_mutex_lock(&m_mutex);
+		int count = m_tasks->num;
+		pthread_mutex_unlock(&m_mutex);
+		return count;
+	}
+
+	/// 得到上一帧执行的任务数
+	int getLastFrameTasks() { return m_lastFrameTasks; }
+
+	/// 得到上一帧执行任务花费的时间, 单位毫秒
+	float getLastFrameTime() { return m_lastFrameTime / 1000.f; }
+
+	/// 得到因为预算用完而有任务留到下一帧的帧数
+	int getDeferredFrames() { return m_deferredFrames; }
+
+	/// 得到已经执行的任务总数
+	int getTotalTasks() { return m_totalTasks; }
+};
+
+#endif // __wyGLTaskQueue_h__
@@ -0,0 +1,549 @@
+/*
+ * Copyright (c) 2010 WiYun Inc.
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __wyImageScaler_h__
+#define __wyImageScaler_h__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wyTexture2D.h"
+#include "wyUtils.h"
+#include "wyLog.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	#include <arm_neon.h>
+	#define WY_IMAGE_SCALER_NEON 1
+#elif defined(__SSE2__)
+	#include <emmintrin.h>
+	#define WY_IMAGE_SCALER_SSE2 1
+#endif
+
+/*
+ * Define WY_JPEG_SCALED_DECODE to 1 and put libjpeg headers on include path to let
+ * jpeg images be decoded directly at 1/2, 1/4 or 1/8 scale in DCT domain
+ */
+#if WY_JPEG_SCALED_DECODE
+	#include <stdio.h>
+	#include <setjmp.h>
+	extern "C" {
+		#include "jpeglib.h"
+	}
+#endif
+
+/**
+ * @class wyImageScaler
+ *
+ * \if English
+ * Decodes images directly at a smaller size. \c wyUtils::loadJPG and \c wyUtils::loadPNG decode
+ * full resolution and then rescale it when density of asset differs from screen. This class
+ * decodes jpeg at 1/2, 1/4 or 1/8 scale with DCT scaling of libjpeg when target is smaller (only
+ * if built with \c WY_JPEG_SCALED_DECODE), then shrinks the residual with exact 2x2 box filter,
+ * which uses NEON or SSE2, and a final area average resampler. Less pixels are decoded and
+ * transient memory is much smaller.
+ * \else
+ * 直接以较小的尺寸解码图片. \c wyUtils::loadJPG和\c wyUtils::loadPNG在资源密度和屏幕不同时
+ * 先以完整分辨率解码再缩放. 这个类在目标更小时用libjpeg的DCT缩放以1/2, 1/4或1/8比例解码jpeg(仅当
+ * 以\c WY_JPEG_SCALED_DECODE编译时), 剩余的缩放先用精确的2x2盒式滤波缩小, 这一步使用NEON或SSE2,
+ * 最后用面积平均重采样. 需要解码的像素更少, 临时内存也小得多.
+ * \endif
+ */
+class wyImageScaler {
+private:
+#if WY_JPEG_SCALED_DECODE
+	/// libjpeg错误处理, 出错时跳回解码函数
+	typedef struct wyJPEGError {
+		struct jpeg_error_mgr pub;
+		jmp_buf jmp;
+	} wyJPEGError;
+
+	static void onJPEGError(j_common_ptr cinfo) {
+		longjmp(((wyJPEGError*)cinfo->err)->jmp, 1);
+	}
+
+	static void initSource(j_decompress_ptr cinfo) {
+	}
+
+	static boolean fillInputBuffer(j_decompress_ptr cinfo) {
+		// data is exhausted, insert a fake EOI marker
+		static const JOCTET eoi[2] = { 0xFF, JPEG_EOI };
+		cinfo->src->next_input_byte = eoi;
+		cinfo->src->bytes_in_buffer = 2;
+		return TRUE;
+	}
+
+	static void skipInputData(j_decompress_ptr cinfo, long count) {
+		if(count <= 0)
+			return;
+		if((size_t)count > cinfo->src->bytes_in_buffer) {
+			fillInputBuffer(cinfo);
+		} else {
+			cinfo->src->next_input_byte += count;
+			cinfo->src->bytes_in_buffer -= count;
+		}
+	}
+
+	static void termSource(j_decompress_ptr cinfo) {
+	}
+
+	/// 以1/denom的比例解码内存中的jpeg数据, 返回RGBA8888像素, \c srcW和\c srcH返回原始尺寸
+	static char* decodeJPEG(const char* data, int length, int denom, int* srcW, int* srcH, int* w, int* h) {
+		struct jpeg_decompress_struct cinfo;
+		wyJPEGError err;
+		struct jpeg_source_mgr src;
+		char* volatile pixels = NULL;
+
+		cinfo.err = jpeg_std_error(&err.pub);
+		err.pub.error_exit = onJPEGError;
+		if(setjmp(err.jmp)) {
+			jpeg_destroy_decompress(&cinfo);
+			if(pixels)
+				free(pixels);
+			return NULL;
+		}
+
+		jpeg_create_decompress(&cinfo);
+		src.init_source = initSource;
+		src.fill_input_buffer = fillInputBuffer;
+		src.skip_input_data = skipInputData;
+		src.resync_to_restart = jpeg_resync_to_restart;
+		src.term_source = termSource;
+		src.next_input_byte = (const JOCTET*)data;
+		src.bytes_in_buffer = length;
+		cinfo.src = &src;
+
+		jpeg_read_header(&cinfo, TRUE);
+		cinfo.scale_num = 1;
+		cinfo.scale_denom = denom;
+		cinfo.out_color_space = JCS_RGB;
+		cinfo.dct_method = JDCT_IFAST;
+		jpeg_start_decompress(&cinfo);
+
+		int ow = cinfo.output_width;
+		int oh = cinfo.output_height;
+		pixels = (char*)malloc((size_t)ow * oh * 4);
+		if(pixels == NULL) {
+			LOGE("wyImageScaler: failed to allocate %dx%d pixels", ow, oh);
+			jpeg_destroy_decompress(&cinfo);
+			return NULL;
+		}
+		while(cinfo.output_scanline < cinfo.output_height) {
+			// read rgb into start of rgba row, then expand backward in place
+			uint8_t* row = (uint8_t*)pixels + (size_t)cinfo.output_scanline * ow * 4;
+			JSAMPROW rows[1] = { row };
+			jpeg_read_scanlines(&cinfo, rows, 1);
+			for(int x = ow - 1; x >= 0; x--) {
+				row[x * 4 + 3] = 0xFF;
+				row[x * 4 + 2] = row[x * 3 + 2];
+				row[x * 4 + 1] = row[x * 3 + 1];
+				row[x * 4] = row[x * 3];
+			}
+		}
+
+		jpeg_finish_decompress(&cinfo);
+		jpeg_destroy_decompress(&cinfo);
+		*srcW = cinfo.image_width;
+		*srcH = cinfo.image_height;
+		*w = ow;
+		*h = oh;
+		return pixels;
+	}
+#endif
+
+	/// 精确的2x2盒式滤波, 每次处理两行, 返回处理的目标像素数
+	static int halveRowSIMD(const uint8_t* r0, const uint8_t* r1, int dstW, uint8_t* dst) {
+#if WY_IMAGE_SCALER_SSE2
+		int n = dstW & ~1;
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i two = _mm_set1_epi16(2);
+		for(int x = 0; x < n; x += 2) {
+			__m128i a = _mm_loadu_si128((const __m128i*)(r0 + x * 8));
+			__m128i b = _mm_loadu_si128((const __m128i*)(r1 + x * 8));
+			__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+			__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+			lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+			hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+			__m128i sum = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(lo, hi), two), 2);
+			_mm_storel_epi64((__m128i*)(dst + x * 4), _mm_packus_epi16(sum, sum));
+		}
+		return n;
+#elif WY_IMAGE_SCALER_NEON
+		int n = dstW & ~7;
+		for(int x = 0; x < n; x += 8) {
+			uint8x16x4_t a = vld4q_u8(r0 + x * 8);
+			uint8x16x4_t b = vld4q_u8(r1 + x * 8);
+			uint8x8x4_t o;
+			for(int c = 0; c < 4; c++)
+				o.val[c] = vrshrn_n_u16(vaddq_u16(vpaddlq_u8(a.val[c]), vpaddlq_u8(b.val[c])), 2);
+			vst4_u8(dst + x * 4, o);
+		}
+		return n;
+#else
+		return 0;
+#endif
+	}
+
+	/// 面积平均得到一个目标像素, 它覆盖单位区间[lo, hi), 每个源像素宽\c unit个单位, 结果按\c divisor四舍五入.
+	/// 浮点除法对不超过8192的除数是精确的
+	static void averagePixel(const uint8_t* s, int lo, int hi, int unit, int divisor, uint8_t* out) {
+#if WY_IMAGE_SCALER_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		__m128i acc = zero;
+		for(int i = lo / unit; i * unit < hi; i++) {
+			int a = i * unit, b = a + unit;
+			int ov = (b < hi ? b : hi) - (a > lo ? a : lo);
+			int32_t px;
+			memcpy(&px, s + i * 4, 4);
+			__m128i p = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(px), zero), zero);
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(p, _mm_set1_epi32(ov)));
+		}
+		__m128 f = _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(acc), _mm_set1_ps(divisor / 2 + 0.5f)), _mm_set1_ps(1.f / divisor));
+		__m128i q = _mm_cvttps_epi32(f);
+		q = _mm_packs_epi32(q, q);
+		int32_t result = _mm_cvtsi128_si32(_mm_packus_epi16(q, q));
+		memcpy(out, &result, 4);
+#elif WY_IMAGE_SCALER_NEON
+		uint32x4_t acc = vdupq_n_u32(0);
+		for(int i = lo / unit; i * unit < hi; i++) {
+			int a = i * unit, b = a + unit;
+			int ov = (b < hi ? b : hi) - (a > lo ? a : lo);
+			uint32_t px;
+			memcpy(&px, s + i * 4, 4);
+			uint16x4_t p = vget_low_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(px))));
+			acc = vmlal_n_u16(acc, p, (uint16_t)ov);
+		}
+		float32x4_t f = vmulq_n_f32(vaddq_f32(vcvtq_f32_u32(acc), vdupq_n_f32(divisor / 2 + 0.5f)), 1.f / divisor);
+		uint16x4_t q = vmovn_u32(vcvtq_u32_f32(f));
+		uint32_t result = vget_lane_u32(vreinterpret_u32_u8(vmovn_u16(vcombine_u16(q, q))), 0);
+		memcpy(out, &result, 4);
+#else
+		uint32_t acc[4] = { 0, 0, 0, 0 };
+		for(int i = lo / unit; i * unit < hi; i++) {
+			int a = i * unit, b = a + unit;
+			uint32_t ov = (b < hi ? b : hi) - (a > lo ? a : lo);
+			for(int c = 0; c < 4; c++)
+				acc[c] += s[i * 4 + c] * ov;
+		}
+		for(int c = 0; c < 4; c++)
+			out[c] = (acc[c] + divisor / 2) / divisor;
+#endif
+	}
+
+	/// 把一行按权重\c ov累加到\c acc, 返回处理的字节数
+	static int accumulateRowSIMD(const uint8_t* row, int ov, int len, uint32_t* acc) {
+#if WY_IMAGE_SCALER_SSE2
+		int n = len & ~15;
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i w = _mm_set1_epi32(ov);
+		for(int k = 0; k < n; k += 16) {
+			__m128i x = _mm_loadu_si128((const __m128i*)(row + k));
+			__m128i lo = _mm_unpacklo_epi8(x, zero);
+			__m128i hi = _mm_unpackhi_epi8(x, zero);
+			__m128i* a = (__m128i*)(acc + k);
+			_mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), _mm_madd_epi16(_mm_unpacklo_epi16(lo, zero), w)));
+			_mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_madd_epi16(_mm_unpackhi_epi16(lo, zero), w)));
+			_mm_storeu_si128(a + 2, _mm_add_epi32(_mm_loadu_si128(a + 2), _mm_madd_epi16(_mm_unpacklo_epi16(hi, zero), w)));
+			_mm_storeu_si128(a + 3, _mm_add_epi32(_mm_loadu_si128(a + 3), _mm_madd_epi16(_mm_unpackhi_epi16(hi, zero), w)));
+		}
+		return n;
+#elif WY_IMAGE_SCALER_NEON
+		int n = len & ~7;
+		for(int k = 0; k < n; k += 8) {
+			uint16x8_t x = vmovl_u8(vld1_u8(row + k));
+			vst1q_u32(acc + k, vmlal_n_u16(vld1q_u32(acc + k), vget_low_u16(x), (uint16_t)ov));
+			vst1q_u32(acc + k + 4, vmlal_n_u16(vld1q_u32(acc + k + 4), vget_high_u16(x), (uint16_t)ov));
+		}
+		return n;
+#else
+		return 0;
+#endif
+	}
+
+	/// 把累加值按\c divisor四舍五入写入目标行, 返回处理的字节数
+	static int divideRowSIMD(const uint32_t* acc, int divisor, int len, uint8_t* dst) {
+#if WY_IMAGE_SCALER_SSE2
+		int n = len & ~15;
+		const __m128 bias = _mm_set1_ps(divisor / 2 + 0.5f);
+		const __m128 inv = _mm_set1_ps(1.f / divisor);
+		for(int k = 0; k < n; k += 16) {
+			__m128i q[4];
+			for(int i = 0; i < 4; i++) {
+				__m128 f = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(acc + k + i * 4)));
+				q[i] = _mm_cvttps_epi32(_mm_mul_ps(_mm_add_ps(f, bias), inv));
+			}
+			__m128i r = _mm_packus_epi16(_mm_packs_epi32(q[0], q[1]), _mm_packs_epi32(q[2], q[3]));
+			_mm_storeu_si128((__m128i*)(dst + k), r);
+		}
+		return n;
+#elif WY_IMAGE_SCALER_NEON
+		int n = len & ~7;
+		const float32x4_t bias = vdupq_n_f32(divisor / 2 + 0.5f);
+		const float inv = 1.f / divisor;
+		for(int k = 0; k < n; k += 8) {
+			uint32x4_t lo = vcvtq_u32_f32(vmulq_n_f32(vaddq_f32(vcvtq_f32_u32(vld1q_u32(acc + k)), bias), inv));
+			uint32x4_t hi = vcvtq_u32_f32(vmulq_n_f32(vaddq_f32(vcvtq_f32_u32(vld1q_u32(acc + k + 4)), bias), inv));
+			vst1_u8(dst + k, vmovn_u16(vcombine_u16(vmovn_u32(lo), vmovn_u32(hi))));
+		}
+		return n;
+#else
+		return 0;
+#endif
+	}
+
+public:
+	/**
+	 * \if English
+	 * Choose denominator of DCT scaling for a scale, the biggest one in 1, 2, 4, 8 which
+	 * doesn't make image smaller than target
+	 *
+	 * @param scale target scale, less than 1 means shrinking
+	 * @return denominator
+	 * \else
+	 * 为一个缩放比例选择DCT缩放的分母, 即1, 2, 4, 8中不会使图片小于目标的最大值
+	 *
+	 * @param scale 目标缩放比例, 小于1表示缩小
+	 * @return 分母
+	 * \endif
+	 */
+	static int chooseDCTDenom(float scale) {
+		int denom = 1;
+		while(denom < 8 && scale * denom * 2 <= 1.f + 1e-4f)
+			denom *= 2;
+		return denom;
+	}
+
+	/**
+	 * \if English
+	 * Shrink an image to half size with exact 2x2 box filter. Odd last column or row is dropped.
+	 *
+	 * @param rgba source pixels in RGBA8888 format
+	 * @param w width of source
+	 * @param h height of source
+	 * @param outW returns width of result
+	 * @param outH returns height of result
+	 * @return new pixels, caller should free it
+	 * \else
+	 * 用精确的2x2盒式滤波把图片缩小一半. 奇数的最后一列或一行被丢弃.
+	 *
+	 * @param rgba RGBA8888格式的源像素
+	 * @param w 源宽度
+	 * @param h 源高度
+	 * @param outW 返回结果的宽度
+	 * @param outH 返回结果的高度
+	 * @return 新的像素, 调用者负责释放
+	 * \endif
+	 */
+	static char* halve(const char* rgba, int w, int h, int* outW, int* outH) {
+		int dw = w / 2, dh = h / 2;
+		uint8_t* dst = (uint8_t*)malloc((size_t)dw * dh * 4);
+		for(int y = 0; y < dh; y++) {
+			const uint8_t* r0 = (const uint8_t*)rgba + (size_t)y * 2 * w * 4;
+			const uint8_t* r1 = r0 + (size_t)w * 4;
+			uint8_t* d = dst + (size_t)y * dw * 4;
+			for(int x = halveRowSIMD(r0, r1, dw, d); x < dw; x++) {
+				for(int c = 0; c < 4; c++)
+					d[x * 4 + c] = (r0[x * 8 + c] + r0[x * 8 + 4 + c] + r1[x * 8 + c] + r1[x * 8 + 4 + c] + 2) >> 2;
+			}
+		}
+		*outW = dw;
+		*outH = dh;
+		return (char*)dst;
+	}
+
+	/**
+	 * \if English
+	 * Shrink an image to any smaller size with area averaging, every source pixel contributes
+	 * by its exact overlapped area. Both passes use NEON or SSE2 when available. Sizes must be less
+	 * than 32768.
+	 *
+	 * @param rgba source pixels in RGBA8888 format
+	 * @param w width of source
+	 * @param h height of source
+	 * @param dstW width of result, not bigger than \c w
+	 * @param dstH height of result, not bigger than \c h
+	 * @return new pixels, caller should free it
+	 * \else
+	 * 用面积平均把图片缩小到任意较小的尺寸, 每个源像素按精确的重叠面积参与计算. 两个方向都在可用时使用
+	 * NEON或SSE2. 尺寸必须小于32768.
+	 *
+	 * @param rgba RGBA8888格式的源像素
+	 * @param w 源宽度
+	 * @param h 源高度
+	 * @param dstW 结果宽度, 不大于\c w
+	 * @param dstH 结果高度, 不大于\c h
+	 * @return 新的像素, 调用者负责释放
+	 * \endif
+	 */
+	static char* areaAverage(const char* rgba, int w, int h, int dstW, int dstH) {
+		const uint8_t* src = (const uint8_t*)rgba;
+
+		// horizontal pass, in units where source pixel is dstW wide and target pixel is w wide
+		uint8_t* tmp = (uint8_t*)malloc((size_t)dstW * h * 4);
+		for(int y = 0; y < h; y++) {
+			const uint8_t* s = src + (size_t)y * w * 4;
+			uint8_t* t = tmp + (size_t)y * dstW * 4;
+			for(int x = 0; x < dstW; x++)
+				averagePixel(s, x * w, x * w + w, dstW, w, t + x * 4);
+		}
+
+		// vertical pass on whole rows
+		uint8_t* dst = (uint8_t*)malloc((size_t)dstW * dstH * 4);
+		uint32_t* acc = (uint32_t*)malloc((size_t)dstW * 4 * sizeof(uint32_t));
+		int rowLen = dstW * 4;
+		for(int y = 0; y < dstH; y++) {
+			memset(acc, 0, rowLen * sizeof(uint32_t));
+			int lo = y * h, hi = lo + h;
+			for(int j = lo / dstH; j * dstH < hi; j++) {
+				int a = j * dstH, b = a + dstH;
+				uint32_t ov = (b < hi ? b : hi) - (a > lo ? a : lo);
+				const uint8_t* t = tmp + (size_t)j * rowLen;
+				for(int k = accumulateRowSIMD(t, ov, rowLen, acc); k < rowLen; k++)
+					acc[k] += t[k] * ov;
+			}
+			uint8_t* d = dst + (size_t)y * rowLen;
+			for(int k = divideRowSIMD(acc, h, rowLen, d); k < rowLen; k++)
+				d[k] = (acc[k] + h / 2) / h;
+		}
+
+		free(acc);
+		free(tmp);
+		return (char*)dst;
+	}
+
+	/**
+	 * \if English
+	 * Shrink an image, halving repeatedly while target is at most half, then area averaging
+	 * the residual. Source pixels are released.
+	 *
+	 * @param rgba source pixels in RGBA8888 format, released by this method
+	 * @param w width of source, returns width of result
+	 * @param h height of source, returns height of result
+	 * @param dstW width of result
+	 * @param dstH height of result
+	 * @return new pixels, caller should free it
+	 * \else
+	 * 缩小图片, 目标不超过一半时反复减半, 剩余部分用面积平均. 源像素会被释放.
+	 *
+	 * @param rgba RGBA8888格式的源像素, 由这个方法释放
+	 * @param w 源宽度, 返回结果的宽度
+	 * @param h 源高度, 返回结果的高度
+	 * @param dstW 结果宽度
+	 * @param dstH 结果高度
+	 * @return 新的像素, 调用者负责释放
+	 * \endif
+	 */
+	static char* shrink(char* rgba, int* w, int* h, int dstW, int dstH) {
+		while(*w >= dstW * 2 && *h >= dstH * 2) {
+			char* half = halve(rgba, *w, *h, w, h);
+			free(rgba);
+			rgba = half;
+		}
+		if(*w != dstW || *h != dstH) {
+			char* result = areaAverage(rgba, *w, *h, MIN(dstW, *w), MIN(dstH, *h));
+			free(rgba);
+			rgba = result;
+			*w = MIN(dstW, *w);
+			*h = MIN(dstH, *h);
+		}
+		return rgba;
+	}
+
+	/**
+	 * \if English
+	 * Load a JPG image at a scale. If scale is bigger than 1, it falls back to \c wyUtils::loadJPG.
+	 *
+	 * @param path assets path or file system path
+	 * @param isFile true means \c path is file system path
+	 * @param scaleX horizontal scale, such as screen density divided by asset density
+	 * @param scaleY vertical scale
+	 * @param w returns width of result
+	 * @param h returns height of result
+	 * @return pixels in RGBA8888 format, caller should free it. NULL if failed
+	 * \else
+	 * 以一个缩放比例载入JPG图片. 如果比例大于1, 退回到\c wyUtils::loadJPG.
+	 *
+	 * @param path assets路径或文件系统路径
+	 * @param isFile true表示\c path是文件系统路径
+	 * @param scaleX 水平缩放比例, 比如屏幕密度除以资源密度
+	 * @param scaleY 垂直缩放比例
+	 * @param w 返回结果的宽度
+	 * @param h 返回结果的高度
+	 * @return RGBA8888格式的像素, 调用者负责释放. 失败返回NULL
+	 * \endif
+	 */
+	static char* loadJPG(const char* path, bool isFile, float scaleX, float scaleY, int* w, int* h) {
+		if(scaleX > 1.f || scaleY > 1.f)
+			return wyUtils::loadJPG(path, isFile, w, h, false, scaleX, scaleY);
+
+		// file is read once, original size comes from the decode itself
+		int length = 0;
+		char* data = wyUtils::loadRaw(path, isFile, &length);
+		if(data == NULL)
+			return NULL;
+
+		int srcW = 0, srcH = 0;
+		char* pixels = NULL;
+#if WY_JPEG_SCALED_DECODE
+		pixels = decodeJPEG(data, length, chooseDCTDenom(MAX(scaleX, scaleY)), &srcW, &srcH, w, h);
+#endif
+		if(pixels == NULL) {
+			pixels = wyUtils::loadJPG(data, length, w, h, false, 1.f, 1.f);
+			srcW = *w;
+			srcH = *h;
+		}
+		free(data);
+		if(pixels == NULL)
+			return NULL;
+
+		// target size is computed from original size
+		int dstW = MAX(1, (int)(srcW * scaleX + 0.5f));
+		int dstH = MAX(1, (int)(srcH * scaleY + 0.5f));
+		return shrink(pixels, w, h, dstW, dstH);
+	}
+
+	/**
+	 * \if English
+	 * Load a PNG image at a scale. PNG has no DCT domain, so it is decoded at full size and
+	 * shrunk by box filter and area average. If scale is bigger than 1, it falls back to
+	 * \c wyUtils::loadPNG.
+	 *
+	 * @see loadJPG
+	 * \else
+	 * 以一个缩放比例载入PNG图片. PNG没有DCT域, 所以以完整尺寸解码后用盒式滤波和面积平均缩小.
+	 * 如果比例大于1, 退回到\c wyUtils::loadPNG.
+	 *
+	 * @see loadJPG
+	 * \endif
+	 */
+	static char* loadPNG(const char* path, bool isFile, float scaleX, float scaleY, int* w, int* h) {
+		if(scaleX > 1.f || scaleY > 1.f)
+			return wyUtils::loadPNG(path, isFile, w, h, false, scaleX, scaleY);
+
+		char* pixels = wyUtils::loadPNG(path, isFile, w, h, false, 1.f, 1.f);
+		if(pixels == NULL)
+			return NULL;
+		int dstW = MAX(1, (int)(*w * scaleX + 0.5f));
+		int dstH = MAX(1, (int)(*h * scaleY + 0.5f));
+		return shrink(pixels, w, h, dstW, dstH);
+	}
+};
+
+#endif // __wyImageScaler_h__
@@ -0,0 +1,368 @@
+/*
+ * Copyright (c) 2010 WiYun Inc.
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __wyLatencyTracker_h__
+#define __wyLatencyTracker_h__
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "wyObject.h"
+#include "wyLog.h"
+
+/// 直方图桶数, 第i个桶记录[2^(i-1), 2^i)毫秒的样本, 最后一个桶记录更大的样本
+#define WY_LATENCY_BUCKETS 12
+
+/// 最多同时追踪的尚未显示的事件数
+#define WY_LATENCY_MAX_PENDING 32
+
+/**
+ * @typedef wyLatencyStage
+ *
+ * \if English
+ * Stages of input latency
+ * \else
+ * 输入延迟的各个阶段
+ * \endif
+ */
+typedef enum {
+	/// 从平台事件产生到放入队列
+	LATENCY_INGRESS_TO_QUEUE,
+
+	/// 从放入队列到被派发
+	LATENCY_QUEUE_TO_DISPATCH,
+
+	/// 从被派发到反映该事件的帧被提交
+	LATENCY_DISPATCH_TO_SWAP,
+
+	/// 从平台事件产生到反映该事件的帧被提交
+	LATENCY_TOTAL,
+
+	LATENCY_STAGE_COUNT
+} wyLatencyStage;
+
+/**
+ * @struct wyLatencyHistogram
+ *
+ * \if English
+ * Latency histogram of one stage, in microseconds
+ * \else
+ * 一个阶段的延迟直方图, 单位微秒
+ * \endif
+ */
+typedef struct wyLatencyHistogram {
+	/// 样本数
+	int count;
+
+	/// 最小值
+	int64_t min;
+
+	/// 最大值
+	int64_t max;
+
+	/// 总和
+	int64_t sum;
+
+	/// 各个桶的样本数
+	int buckets[WY_LATENCY_BUCKETS];
+} wyLatencyHistogram;
+
+/**
+ * @class wyLatencyTracker
+ *
+ * \if English
+ * Measure how long an input event waits between platform ingress and the frame that
+ * reflects it. Timestamps are taken at platform ingress (event time), when event is queued,
+ * when it is dispatched, and at the next frame, which starts after the frame in which the
+ * event was dispatched is swapped. Results are aggregated into per-stage histograms.
+ *
+ * Frames are counted by \c onFrame, which \link wyEventRing wyEventRing\endlink calls in its per
+ * frame callback right before it drains events. So the frame boundary never depends on the order
+ * in which scheduler runs timers.
+ * \else
+ * 测量输入事件从平台产生到反映它的帧之间等待的时间. 在平台产生(事件时间), 放入队列, 被派发,
+ * 以及下一帧时记录时间戳, 下一帧开始时派发该事件的那一帧已经被提交. 结果按阶段汇总为直方图.
+ *
+ * 帧由\c onFrame计数, \link wyEventRing wyEventRing\endlink在每帧的回调中处理事件之前调用它. 因此帧的
+ * 边界不依赖于调度器执行定时器的顺序.
+ * \endif
+ */
+class wyLatencyTracker : public wyObject {
+protected:
+	/// 各阶段的直方图
+	wyLatencyHistogram m_histograms[LATENCY_STAGE_COUNT];
+
+	/// 已派发但还未显示的事件的平台时间
+	int64_t m_pendingIngress[WY_LATENCY_MAX_PENDING];
+
+	/// 已派发但还未显示的事件的派发时间
+	int64_t m_pendingDispatch[WY_LATENCY_MAX_PENDING];
+
+	/// 已派发但还未显示的事件的派发帧号
+	int m_pendingFrame[WY_LATENCY_MAX_PENDING];
+
+	/// 已派发但还未显示的事件数
+	int m_pendingCount;
+
+	/// 帧号
+	int m_frame;
+
+	/// true表示正在追踪
+	bool m_enabled;
+
+protected:
+	wyLatencyTracker() :
+			m_pendingCount(0),
+			m_frame(0),
+			m_enabled(false) {
+		reset();
+	}
+
+	static int bucketOf(int64_t us) {
+		int64_t ms = us / 1000;
+		int i = 0;
+		while(ms > 0 && i < WY_LATENCY_BUCKETS - 1) {
+			ms >>= 1;
+			i++;
+		}
+		return i;
+	}
+
+	/**
+	 * \if English
+	 * Resolve events dispatched in previous frames, their frames are already swapped
+	 * \else
+	 * 结算之前帧中派发的事件, 这些帧已经被提交
+	 * \endif
+	 */
+	void resolvePending() {
+		int64_t now = currentTimeMicros();
+		int kept = 0;
+		for(int i = 0; i < m_pendingCount; i++) {
+			if(m_pendingFrame[i] < m_frame) {
+				record(LATENCY_DISPATCH_TO_SWAP, now - m_pendingDispatch[i]);
+				if(m_pendingIngress[i] > 0)
+					record(LATENCY_TOTAL, now - m_pendingIngress[i]);
+			} else {
+				m_pendingIngress[kept] = m_pendingIngress[i];
+				m_pendingDispatch[kept] = m_pendingDispatch[i];
+				m_pendingFrame[kept] = m_pendingFrame[i];
+				kept++;
+			}
+		}
+		m_pendingCount = kept;
+	}
+
+public:
+	/**
+	 * \if English
+	 * Get singleton
+	 * \else
+	 * 得到单例
+	 * \endif
+	 */
+	static wyLatencyTracker* getInstance() {
+		static wyLatencyTracker* s_instance = new wyLatencyTracker();
+		return s_instance;
+	}
+
+	virtual ~wyLatencyTracker() {
+	}
+
+	/**
+	 * \if English
+	 * Current time in microseconds of monotonic clock, it has the same base as uptimeMillis of
+	 * Android, which is the base of event time
+	 * \else
+	 * 单调时钟的当前时间, 单位微秒, 和Android的uptimeMillis起点相同, 事件时间也是以它为起点
+	 * \endif
+	 */
+	static int64_t currentTimeMicros() {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	}
+
+	/**
+	 * \if English
+	 * Mark start of a new frame, events dispatched in previous frames are resolved. It must be called
+	 * once per frame on GL thread before events of the frame are dispatched, \link wyEventRing wyEventRing\endlink
+	 * does it when it drains automatically.
+	 * \else
+	 * 标记新的一帧开始, 结算之前帧中派发的事件. 必须在OpenGL线程中每帧调用一次, 并且在这一帧的事件派发之前,
+	 * \link wyEventRing wyEventRing\endlink自动处理事件时会调用它.
+	 * \endif
+	 */
+	void onFrame() {
+		if(!m_enabled)
+			return;
+		m_frame++;
+		resolvePending();
+	}
+
+	/**
+	 * \if English
+	 * Enable or disable tracking
+	 * \else
+	 * 打开或关闭追踪
+	 * \endif
+	 */
+	void setEnabled(bool flag) {
+		m_enabled = flag;
+		if(!flag)
+			m_pendingCount = 0;
+	}
+
+	/// 是否正在追踪
+	bool isEnabled() { return m_enabled; }
+
+	/**
+	 * \if English
+	 * Record a sample of a stage
+	 *
+	 * @param stage \link wyLatencyStage wyLatencyStage\endlink
+	 * @param us latency in microseconds
+	 * \else
+	 * 记录一个阶段的样本
+	 *
+	 * @param stage \link wyLatencyStage wyLatencyStage\endlink
+	 * @param us 延迟, 单位微秒
+	 * \endif
+	 */
+	void record(wyLatencyStage stage, int64_t us) {
+		if(us < 0)
+			us = 0;
+		wyLatencyHistogram* h = &m_histograms[stage];
+		if(h->count == 0 || us < h->min)
+			h->min = us;
+		if(us > h->max)
+			h->max = us;
+		h->sum += us;
+		h->count++;
+		h->buckets[bucketOf(us)]++;
+	}
+
+	/**
+	 * \if English
+	 * Notify that an event is dispatched on GL thread
+	 *
+	 * @param ingressTime platform event time in microseconds, 0 if unknown
+	 * @param queueTime time when event was queued in microseconds
+	 * \else
+	 * 通知一个事件在OpenGL线程中被派发
+	 *
+	 * @param ingressTime 平台事件时间, 单位微秒, 未知时为0
+	 * @param queueTime 事件放入队列的时间, 单位微秒
+	 * \endif
+	 */
+	void onDispatched(int64_t ingressTime, int64_t queueTime) {
+		if(!m_enabled)
+			return;
+
+		int64_t now = currentTimeMicros();
+		if(ingressTime > 0)
+			record(LATENCY_INGRESS_TO_QUEUE, queueTime - ingressTime);
+		record(LATENCY_QUEUE_TO_DISPATCH, now - queueTime);
+
+		if(m_pendingCount < WY_LATENCY_MAX_PENDING) {
+			m_pendingIngress[m_pendingCount] = ingressTime;
+			m_pendingDispatch[m_pendingCount] = now;
+			m_pendingFrame[m_pendingCount] = m_frame;
+			m_pendingCount++;
+		}
+	}
+
+	/**
+	 * \if English
+	 * Get histogram of a stage
+	 *
+	 * @param stage \link wyLatencyStage wyLatencyStage\endlink
+	 * @return histogram
+	 * \else
+	 * 得到一个阶段的直方图
+	 *
+	 * @param stage \link wyLatencyStage wyLatencyStage\endlink
+	 * @return 直方图
+	 * \endif
+	 */
+	const wyLatencyHistogram* getHistogram(wyLatencyStage stage) { return &m_histograms[stage]; }
+
+	/**
+	 * \if English
+	 * Estimate a percentile of a stage from histogram, upper bound of the bucket is returned
+	 *
+	 * @param stage \link wyLatencyStage wyLatencyStage\endlink
+	 * @param p percentile, from 0 to 1
+	 * @return latency in milliseconds
+	 * \else
+	 * 根据直方图估计一个阶段的百分位数, 返回所在桶的上限
+	 *
+	 * @param stage \link wyLatencyStage wyLatencyStage\endlink
+	 * @param p 百分位, 从0到1
+	 * @return 延迟, 单位毫秒
+	 * \endif
+	 */
+	int getPercentile(wyLatencyStage stage, float p) {
+		wyLatencyHistogram* h = &m_histograms[stage];
+		int target = (int)(h->count * p + 0.5f);
+		int acc = 0;
+		for(int i = 0; i < WY_LATENCY_BUCKETS; i++) {
+			acc += h->buckets[i];
+			if(acc >= target && acc > 0)
+				return i == WY_LATENCY_BUCKETS - 1 ? (int)(h->max / 1000) : (1 << i);
+		}
+		return 0;
+	}
+
+	/**
+	 * \if English
+	 * Clear all samples
+	 * \else
+	 * 清除所有样本
+	 * \endif
+	 */
+	void reset() {
+		memset(m_histograms, 0, sizeof(m_histograms));
+		m_pendingCount = 0;
+	}
+
+	/**
+	 * \if English
+	 * Output histograms to log, in the same way as \c wyOutputTime
+	 * \else
+	 * 在log中输出直方图, 和\c wyOutputTime的方式相同
+	 * \endif
+	 */
+	void output() {
+		static const char* names[] = { "ingress->queue", "queue->dispatch", "dispatch->swap", "total" };
+		for(int i = 0; i < LATENCY_STAGE_COUNT; i++) {
+			wyLatencyHistogram* h = &m_histograms[i];
+			if(h->count == 0)
+				continue;
+
+			LOGD("latency %s: count %d, min %.2fms, avg %.2fms, max %.2fms, p50 <=%dms, p95 <=%dms",
+					names[i], h->count, h->min / 1000.f, h->sum / 1000.f / h->count, h->max / 1000.f,
+					getPercentile((wyLatencyStage)i, 0.5f), getPercentile((wyLatencyStage)i, 0.95f));
+		}
+	}
+};
+
+#endif // __wyLatencyTracker_h__
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2010 WiYun Inc.
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __wyMurmurHash_h__
+#define __wyMurmurHash_h__
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @class wyMurmurHash
+ *
+ * \if English
+ * MurmurHash2, a fast non-cryptographic hash for content keys and cache validation. Use \link wyMD5 wyMD5\endlink
+ * when a stable digest string is needed.
+ * \else
+ * MurmurHash2, 用于内容键和缓存校验的快速非加密哈希. 需要稳定的摘要字符串时使用\link wyMD5 wyMD5\endlink.
+ * \endif
+ */
+class wyMurmurHash {
+public:
+	/**
+	 * \if English
+	 * 64 bit MurmurHash2 of a block of data
+	 *
+	 * @param data data
+	 * @param length length of data in bytes
+	 * @return hash value
+	 * \else
+	 * 一块数据的64位MurmurHash2
+	 *
+	 * @param data 数据
+	 * @param length 数据长度, 单位字节
+	 * @return 哈希值
+	 * \endif
+	 */
+	static uint64_t hash64(const void* data, int length) {
+		const uint64_t m = 0xc6a4a7935bd1e995ULL;
+		const int r = 47;
+		uint64_t h = 0x9747b28c ^ (length * m);
+		const uint8_t* p = (const uint8_t*)data;
+		const uint8_t* end = p + (length & ~7);
+		for(; p < end; p += 8) {
+			uint64_t k;
+			memcpy(&k, p, 8);
+			k *= m;
+			k ^= k >> r;
+			k *= m;
+			h ^= k;
+			h *= m;
+		}
+		switch(length & 7) {
+			case 7: h ^= (uint64_t)p[6] << 48;
+			case 6: h ^= (uint64_t)p[5] << 40;
+			case 5: h ^= (uint64_t)p[4] << 32;
+			case 4: h ^= (uint64_t)p[3] << 24;
+			case 3: h ^= (uint64_t)p[2] << 16;
+			case 2: h ^= (uint64_t)p[1] << 8;
+			case 1: h ^= (uint64_t)p[0];
+				h *= m;
+		}
+		h ^= h >> r;
+		h *= m;
+		h ^= h >> r;
+		return h;
+	}
+};
+
+#endif // __wyMurmurHash_h__
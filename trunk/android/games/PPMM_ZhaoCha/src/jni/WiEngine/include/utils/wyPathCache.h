@@ -0,0 +1,436 @@
+/*
+ * Copyright (c) 2010 WiYun Inc.
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __wyPathCache_h__
+#define __wyPathCache_h__
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "wyObject.h"
+#include "wyTypes.h"
+#include "wyPrimitives.h"
+#include "wyUtils.h"
+
+/// 缺省的曲线采样段数
+#define WY_PATH_CACHE_DEFAULT_SEGMENTS 64
+
+/**
+ * @class wyPathCache
+ *
+ * \if English
+ * Arc-length table of a curve. The curve is sampled once when the cache is created,
+ * then the cumulative length of every sample is recorded, so a point at a given distance
+ * can be found with a binary search instead of evaluating the curve polynomial. Because
+ * samples are indexed by length, a node driven by this cache moves at constant speed.
+ * One cache can be shared by several actions and primitive drawing, it is reference counted.
+ * \else
+ * 曲线的弧长表. 创建时对曲线做一次采样, 记录每个采样点的累计长度, 之后根据距离查找
+ * 曲线上的点只需要二分查找, 不需要再计算曲线多项式. 由于按照长度索引, 使用这个缓存移动的
+ * 节点是匀速的. 缓存是引用计数的, 同一个缓存可以被多个动作以及曲线绘制共享.
+ * \endif
+ */
+class wyPathCache : public wyObject {
+protected:
+	/**
+	 * \if English
+	 * sampled points, even index is x and odd index is y
+	 * \else
+	 * 采样点, 偶数位置是x坐标, 奇数位置是y坐标
+	 * \endif
+	 */
+	float* m_points;
+
+	/**
+	 * \if English
+	 * cumulative length from first point to every sampled point
+	 * \else
+	 * 从起点到每个采样点的累计长度
+	 * \endif
+	 */
+	float* m_lengths;
+
+	/**
+	 * \if English
+	 * count of sampled points
+	 * \else
+	 * 采样点数
+	 * \endif
+	 */
+	int m_pointCount;
+
+protected:
+	/**
+	 * \if English
+	 * allocate buffer for sampled points
+	 *
+	 * @param count point count
+	 * \else
+	 * 分配采样点缓冲区
+	 *
+	 * @param count 点数
+	 * \endif
+	 */
+	void allocate(int count) {
+		m_pointCount = count;
+		m_points = (float*)malloc(count * 2 * sizeof(float));
+		m_lengths = (float*)malloc(count * sizeof(float));
+	}
+
+	/**
+	 * \if English
+	 * fill cumulative length table after points are sampled
+	 * \else
+	 * 采样完成后计算累计长度表
+	 * \endif
+	 */
+	void buildLengths() {
+		m_lengths[0] = 0;
+		for(int i = 1; i < m_pointCount; i++) {
+			float dx = m_points[i * 2] - m_points[i * 2 - 2];
+			float dy = m_points[i * 2 + 1] - m_points[i * 2 - 1];
+			m_lengths[i] = m_lengths[i - 1] + sqrtf(dx * dx + dy * dy);
+		}
+	}
+
+	/**
+	 * \if English
+	 * find the segment which contains a distance
+	 *
+	 * @param d distance from start point, must be in [0, length]
+	 * @return index of segment start point
+	 * \else
+	 * 查找包含某个距离的线段
+	 *
+	 * @param d 距离起点的长度, 必须在[0, length]之间
+	 * @return 线段起点的索引
+	 * \endif
+	 */
+	int segmentAt(float d) {
+		int low = 0;
+		int high = m_pointCount - 1;
+		while(high - low > 1) {
+			int mid = (low + high) >> 1;
+			if(m_lengths[mid] <= d)
+				low = mid;
+			else
+				high = mid;
+		}
+		return low;
+	}
+
+	/**
+	 * \if English
+	 * clamp distance into valid range
+	 * \else
+	 * 把距离限制在有效范围内
+	 * \endif
+	 */
+	float clampDistance(float d) {
+		float len = getLength();
+		return d < 0 ? 0 : (d > len ? len : d);
+	}
+
+	/**
+	 * \if English
+	 * quadratic or cubic bezier value at t
+	 * \else
+	 * 计算二次或三次贝塞尔曲线在t位置的值
+	 * \endif
+	 */
+	static float bezierValue(bool cubic, float a, float b, float c, float d, float t) {
+		float it = 1 - t;
+		if(cubic)
+			return it * it * it * a + 3 * t * it * it * b + 3 * t * t * it * c + t * t * t * d;
+		else
+			return it * it * a + 2 * t * it * b + t * t * d;
+	}
+
+public:
+	/**
+	 * \if English
+	 * Static factory method
+	 *
+	 * @param c \link wyBezierConfig wyBezierConfig\endlink
+	 * @param segments segment count of sampling, more segments means more precise
+	 * \else
+	 * 静态构造方法
+	 *
+	 * @param c \link wyBezierConfig wyBezierConfig\endlink
+	 * @param segments 采样段数, 越多越精确
+	 * \endif
+	 */
+	static wyPathCache* make(wyBezierConfig& c, int segments = WY_PATH_CACHE_DEFAULT_SEGMENTS) {
+		wyPathCache* cache = new wyPathCache(c, segments);
+		return (wyPathCache*)cache->autoRelease();
+	}
+
+	/**
+	 * \if English
+	 * Static factory method
+	 *
+	 * @param c \link wyLagrangeConfig wyLagrangeConfig\endlink
+	 * @param segments segment count of sampling, more segments means more precise
+	 * \else
+	 * 静态构造方法
+	 *
+	 * @param c \link wyLagrangeConfig wyLagrangeConfig\endlink
+	 * @param segments 采样段数, 越多越精确
+	 * \endif
+	 */
+	static wyPathCache* make(wyLagrangeConfig& c, int segments = WY_PATH_CACHE_DEFAULT_SEGMENTS) {
+		wyPathCache* cache = new wyPathCache(c, segments);
+		return (wyPathCache*)cache->autoRelease();
+	}
+
+	/**
+	 * \if English
+	 * Static factory method
+	 *
+	 * @param c \link wyHypotrochoidConfig wyHypotrochoidConfig\endlink
+	 * @param segments segment count of sampling, more segments means more precise
+	 * \else
+	 * 静态构造方法
+	 *
+	 * @param c \link wyHypotrochoidConfig wyHypotrochoidConfig\endlink
+	 * @param segments 采样段数, 越多越精确
+	 * \endif
+	 */
+	static wyPathCache* make(wyHypotrochoidConfig& c, int segments = WY_PATH_CACHE_DEFAULT_SEGMENTS) {
+		wyPathCache* cache = new wyPathCache(c, segments);
+		return (wyPathCache*)cache->autoRelease();
+	}
+
+	/**
+	 * \if English
+	 * Static factory method, create cache from a polyline, such as points of
+	 * \link wyMoveByPath wyMoveByPath\endlink
+	 *
+	 * @param points path points, even index is x and odd index is y
+	 * @param length length of points, it is point count multiplied by 2
+	 * \else
+	 * 静态构造方法, 从一条折线创建缓存, 比如\link wyMoveByPath wyMoveByPath\endlink的路径点
+	 *
+	 * @param points 路径点, 偶数位置是x坐标, 奇数位置是y坐标
+	 * @param length points的长度, 是点数乘以2
+	 * \endif
+	 */
+	static wyPathCache* make(float* points, int length) {
+		wyPathCache* cache = new wyPathCache(points, length);
+		return (wyPathCache*)cache->autoRelease();
+	}
+
+	wyPathCache(wyBezierConfig& c, int segments) :
+			m_points(NULL),
+			m_lengths(NULL),
+			m_pointCount(0) {
+		segments = MAX(1, segments);
+		allocate(segments + 1);
+		for(int i = 0; i <= segments; i++) {
+			float t = (float)i / segments;
+			m_points[i * 2] = bezierValue(c.cubic, c.startX, c.cp1X, c.cp2X, c.endX, t);
+			m_points[i * 2 + 1] = bezierValue(c.cubic, c.startY, c.cp1Y, c.cp2Y, c.endY, t);
+		}
+		buildLengths();
+	}
+
+	wyPathCache(wyLagrangeConfig& c, int segments) :
+			m_points(NULL),
+			m_lengths(NULL),
+			m_pointCount(0) {
+		segments = MAX(1, segments);
+		allocate(segments + 1);
+		for(int i = 0; i <= segments; i++) {
+			wyPoint p = wylcPointAt(c, (float)i / segments);
+			m_points[i * 2] = p.x;
+			m_points[i * 2 + 1] = p.y;
+		}
+		buildLengths();
+	}
+
+	wyPathCache(wyHypotrochoidConfig& c, int segments) :
+			m_points(NULL),
+			m_lengths(NULL),
+			m_pointCount(0) {
+		segments = MAX(1, segments);
+		allocate(segments + 1);
+		for(int i = 0; i <= segments; i++) {
+			wyPoint p = wyhcPointAt(c, (float)i / segments);
+			m_points[i * 2] = p.x;
+			m_points[i * 2 + 1] = p.y;
+		}
+		buildLengths();
+	}
+
+	wyPathCache(float* points, int length) :
+			m_points(NULL),
+			m_lengths(NULL),
+			m_pointCount(0) {
+		int count = MAX(1, length / 2);
+		allocate(count);
+		if(length >= 2)
+			memcpy(m_points, points, count * 2 * sizeof(float));
+		else
+			m_points[0] = m_points[1] = 0;
+		buildLengths();
+	}
+
+	virtual ~wyPathCache() {
+		free(m_points);
+		free(m_lengths);
+	}
+
+	/**
+	 * \if English
+	 * Get total length of curve
+	 *
+	 * @return total length
+	 * \else
+	 * 得到曲线总长度
+	 *
+	 * @return 曲线总长度
+	 * \endif
+	 */
+	float getLength() { return m_lengths[m_pointCount - 1]; }
+
+	/**
+	 * \if English
+	 * Get point at a distance from start point
+	 *
+	 * @param d distance from start point, it will be clamped to [0, length]
+	 * @return point at that distance
+	 * \else
+	 * 得到距离起点一定长度的点
+	 *
+	 * @param d 距离起点的长度, 会被限制在[0, 曲线长度]之间
+	 * @return 曲线上的点
+	 * \endif
+	 */
+	wyPoint pointAtDistance(float d) {
+		if(m_pointCount < 2)
+			return wyp(m_points[0], m_points[1]);
+
+		d = clampDistance(d);
+		int i = segmentAt(d);
+		float segLen = m_lengths[i + 1] - m_lengths[i];
+		float f = segLen > 0 ? (d - m_lengths[i]) / segLen : 0;
+		return wyp(m_points[i * 2] + (m_points[i * 2 + 2] - m_points[i * 2]) * f,
+				m_points[i * 2 + 1] + (m_points[i * 2 + 3] - m_points[i * 2 + 1]) * f);
+	}
+
+	/**
+	 * \if English
+	 * Get point by percentage of total length, so uniform percentage means uniform speed
+	 *
+	 * @param p percentage, from 0 to 1
+	 * @return point on curve
+	 * \else
+	 * 根据长度百分比得到曲线上的点, 匀速变化的百分比对应匀速运动
+	 *
+	 * @param p 百分比, 从0到1
+	 * @return 曲线上的点
+	 * \endif
+	 */
+	wyPoint pointAtPercent(float p) { return pointAtDistance(p * getLength()); }
+
+	/**
+	 * \if English
+	 * Get direction of curve at a distance from start point
+	 *
+	 * @param d distance from start point
+	 * @return direction in radian, counter-clockwise from x axis
+	 * \else
+	 * 得到距离起点一定长度处的曲线方向
+	 *
+	 * @param d 距离起点的长度
+	 * @return 方向弧度, 以x轴为起点逆时针方向
+	 * \endif
+	 */
+	float angleAtDistance(float d) {
+		if(m_pointCount < 2)
+			return 0;
+
+		int i = segmentAt(clampDistance(d));
+		return atan2f(m_points[i * 2 + 3] - m_points[i * 2 + 1], m_points[i * 2 + 2] - m_points[i * 2]);
+	}
+
+	/**
+	 * \if English
+	 * Map a distance to curve parameter t, useful when exact curve evaluation is still needed
+	 *
+	 * @param d distance from start point
+	 * @return curve parameter, from 0 to 1
+	 * \else
+	 * 把距离映射为曲线参数t, 适用于仍然需要精确计算曲线的情况
+	 *
+	 * @param d 距离起点的长度
+	 * @return 曲线参数, 从0到1
+	 * \endif
+	 */
+	float tAtDistance(float d) {
+		if(m_pointCount < 2)
+			return 0;
+
+		d = clampDistance(d);
+		int i = segmentAt(d);
+		float segLen = m_lengths[i + 1] - m_lengths[i];
+		float f = segLen > 0 ? (d - m_lengths[i]) / segLen : 0;
+		return (i + f) / (m_pointCount - 1);
+	}
+
+	/**
+	 * \if English
+	 * Get sampled points, even index is x and odd index is y
+	 *
+	 * @return sampled points
+	 * \else
+	 * 得到采样点, 偶数位置是x坐标, 奇数位置是y坐标
+	 *
+	 * @return 采样点
+	 * \endif
+	 */
+	float* getPoints() { return m_points; }
+
+	/**
+	 * \if English
+	 * Get count of sampled points
+	 *
+	 * @return point count
+	 * \else
+	 * 得到采样点数
+	 *
+	 * @return 采样点数
+	 * \endif
+	 */
+	int getPointCount() { return m_pointCount; }
+
+	/**
+	 * \if English
+	 * Draw cached curve, it is cheaper than \c wyDrawBezier or \c wyDrawLagrange because
+	 * curve is not evaluated again
+	 * \else
+	 * 绘制缓存的曲线, 由于不需要重新计算曲线, 比\c wyDrawBezier和\c wyDrawLagrange开销更小
+	 * \endif
+	 */
+	void draw() { wyDrawPath(m_points, m_pointCount * 2); }
+};
+
+#endif // __wyPathCache_h__
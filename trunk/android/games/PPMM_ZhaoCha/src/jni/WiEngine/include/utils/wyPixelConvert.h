@@ -0,0 +1,493 @@
+/*
+ * Copyright (c) 2010 WiYun Inc.
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __wyPixelConvert_h__
+#define __wyPixelConvert_h__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wyGLTexture2D.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+	#include <arm_neon.h>
+	#define WY_PIXEL_CONVERT_NEON 1
+#elif defined(__SSE2__)
+	#include <emmintrin.h>
+	#define WY_PIXEL_CONVERT_SSE2 1
+#endif
+
+/**
+ * @enum wyDitherMode
+ *
+ * 转换到16位贴图格式时的抖动方式
+ */
+typedef enum {
+	/// 不抖动, 直接截断
+	DITHER_NONE,
+
+	/// 4x4 Bayer矩阵有序抖动, 可以用SIMD加速
+	DITHER_ORDERED,
+
+	/// Floyd-Steinberg误差扩散抖动, 质量最好但只能逐像素处理
+	DITHER_ERROR_DIFFUSION
+} wyDitherMode;
+
+/**
+ * @class wyPixelConvert
+ *
+ * \if English
+ * Converts RGBA8888 pixels to the pixel formats supported by \link wyGLTexture2D wyGLTexture2D\endlink.
+ * Results are packed exactly as OpenGL expects them for corresponding format and type. Conversion
+ * and alpha premultiplication use NEON when compiled for ARMv7 with NEON, SSE2 on x86, and scalar
+ * loops otherwise. Optional ordered or error diffusion dithering hides banding of 16 bits formats.
+ * \else
+ * 把RGBA8888像素转换为\link wyGLTexture2D wyGLTexture2D\endlink支持的贴图格式. 结果的排列方式
+ * 和OpenGL对相应格式和类型的要求完全一致. 为支持NEON的ARMv7编译时转换和alpha预乘使用NEON, 在x86上
+ * 使用SSE2, 否则使用标量循环. 可选的有序抖动或误差扩散抖动可以消除16位格式的色带.
+ * \endif
+ */
+class wyPixelConvert {
+private:
+	/// 得到格式中r, g, b通道的位数, alpha不参与抖动所以总是0
+	static void ditherBits(wyTexturePixelFormat format, int bits[4]) {
+		bits[3] = 0;
+		switch(format) {
+			case WY_TEXTURE_PIXEL_FORMAT_RGB565:
+				bits[0] = 5; bits[1] = 6; bits[2] = 5;
+				break;
+			case WY_TEXTURE_PIXEL_FORMAT_RGBA4444:
+				bits[0] = 4; bits[1] = 4; bits[2] = 4;
+				break;
+			case WY_TEXTURE_PIXEL_FORMAT_RGBA5551:
+				bits[0] = 5; bits[1] = 5; bits[2] = 5;
+				break;
+			default:
+				bits[0] = bits[1] = bits[2] = 0;
+				break;
+		}
+	}
+
+	/**
+	 * 生成第y行4个像素的抖动偏移, 按RGBA交错排列, 每4个像素重复. 前16字节是要加上的
+	 * 阈值, 后16字节是要减去的半个量化步长, 使抖动后的平均值不偏移
+	 */
+	static void ditherPattern(wyTexturePixelFormat format, int y, uint8_t pattern[32]) {
+		static const uint8_t bayer[16] = {
+			0, 8, 2, 10,
+			12, 4, 14, 6,
+			3, 11, 1, 9,
+			15, 7, 13, 5
+		};
+		int bits[4];
+		ditherBits(format, bits);
+		for(int x = 0; x < 4; x++) {
+			for(int c = 0; c < 4; c++) {
+				int step = bits[c] ? 256 >> bits[c] : 0;
+				pattern[x * 4 + c] = bayer[(y & 3) * 4 + x] * step / 16;
+				pattern[16 + x * 4 + c] = step / 2;
+			}
+		}
+	}
+
+	static inline uint16_t pack16(wyTexturePixelFormat format, int r, int g, int b, int a) {
+		switch(format) {
+			case WY_TEXTURE_PIXEL_FORMAT_RGB565:
+				return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+			case WY_TEXTURE_PIXEL_FORMAT_RGBA4444:
+				return ((r >> 4) << 12) | ((g >> 4) << 8) | ((b >> 4) << 4) | (a >> 4);
+			default:
+				return ((r >> 3) << 11) | ((g >> 3) << 6) | ((b >> 3) << 1) | (a >> 7);
+		}
+	}
+
+	/// 标量转换, 从第start个像素开始, pattern可以为NULL
+	static void convertScalar(const uint8_t* src, int start, int count, wyTexturePixelFormat format, char* out, const uint8_t* pattern) {
+		if(format == WY_TEXTURE_PIXEL_FORMAT_A8) {
+			uint8_t* dst = (uint8_t*)out;
+			for(int i = start; i < count; i++)
+				dst[i] = src[i * 4 + 3];
+			return;
+		}
+
+		uint16_t* dst = (uint16_t*)out;
+		for(int i = start; i < count; i++) {
+			const uint8_t* p = src + i * 4;
+			int r = p[0], g = p[1], b = p[2], a = p[3];
+			if(pattern) {
+				const uint8_t* d = pattern + (i & 3) * 4;
+				const uint8_t* h = d + 16;
+				r = MAX(0, MIN(255, r + d[0]) - h[0]);
+				g = MAX(0, MIN(255, g + d[1]) - h[1]);
+				b = MAX(0, MIN(255, b + d[2]) - h[2]);
+			}
+			dst[i] = pack16(format, r, g, b, a);
+		}
+	}
+
+#if WY_PIXEL_CONVERT_SSE2
+	static inline __m128i packSSE2(__m128i p, wyTexturePixelFormat format) {
+		switch(format) {
+			case WY_TEXTURE_PIXEL_FORMAT_RGB565:
+				return _mm_or_si128(_mm_or_si128(
+						_mm_slli_epi32(_mm_and_si128(p, _mm_set1_epi32(0xF8)), 8),
+						_mm_and_si128(_mm_srli_epi32(p, 5), _mm_set1_epi32(0x7E0))),
+						_mm_and_si128(_mm_srli_epi32(p, 19), _mm_set1_epi32(0x1F)));
+			case WY_TEXTURE_PIXEL_FORMAT_RGBA4444:
+				return _mm_or_si128(_mm_or_si128(
+						_mm_slli_epi32(_mm_and_si128(p, _mm_set1_epi32(0xF0)), 8),
+						_mm_and_si128(_mm_srli_epi32(p, 4), _mm_set1_epi32(0xF00))),
+						_mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 16), _mm_set1_epi32(0xF0)),
+						_mm_srli_epi32(p, 28)));
+			default:
+				return _mm_or_si128(_mm_or_si128(
+						_mm_slli_epi32(_mm_and_si128(p, _mm_set1_epi32(0xF8)), 8),
+						_mm_and_si128(_mm_srli_epi32(p, 5), _mm_set1_epi32(0x7C0))),
+						_mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 18), _mm_set1_epi32(0x3E)),
+						_mm_srli_epi32(p, 31)));
+		}
+	}
+
+	/// SSE2转换, 每次8个像素, 返回处理的像素数
+	static int convertSIMD(const uint8_t* src, int count, wyTexturePixelFormat format, char* out, const uint8_t* pattern) {
+		int n = count & ~7;
+		__m128i pat = pattern ? _mm_loadu_si128((const __m128i*)pattern) : _mm_setzero_si128();
+		__m128i half = pattern ? _mm_loadu_si128((const __m128i*)(pattern + 16)) : _mm_setzero_si128();
+		const __m128i bias32 = _mm_set1_epi32(0x8000);
+		const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+		for(int i = 0; i < n; i += 8) {
+			__m128i p0 = _mm_subs_epu8(_mm_adds_epu8(_mm_loadu_si128((const __m128i*)(src + i * 4)), pat), half);
+			__m128i p1 = _mm_subs_epu8(_mm_adds_epu8(_mm_loadu_si128((const __m128i*)(src + i * 4 + 16)), pat), half);
+			if(format == WY_TEXTURE_PIXEL_FORMAT_A8) {
+				__m128i a = _mm_packs_epi32(_mm_srli_epi32(p0, 24), _mm_srli_epi32(p1, 24));
+				_mm_storel_epi64((__m128i*)(out + i), _mm_packus_epi16(a, a));
+			} else {
+				// packs_epi32 is signed, so shift 16 bits values into signed range and back
+				__m128i q0 = _mm_sub_epi32(packSSE2(p0, format), bias32);
+				__m128i q1 = _mm_sub_epi32(packSSE2(p1, format), bias32);
+				_mm_storeu_si128((__m128i*)(out + i * 2), _mm_xor_si128(_mm_packs_epi32(q0, q1), bias16));
+			}
+		}
+		return n;
+	}
+
+	/// SSE2预乘, 每次4个像素, 返回处理的像素数
+	static int premultiplySIMD(uint8_t* rgba, int count) {
+		int n = count & ~3;
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i rgbMask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+		const __m128i alphaOne = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+		const __m128i half = _mm_set1_epi16(128);
+		for(int i = 0; i < n; i += 4) {
+			__m128i p = _mm_loadu_si128((const __m128i*)(rgba + i * 4));
+			__m128i halves[2] = { _mm_unpacklo_epi8(p, zero), _mm_unpackhi_epi8(p, zero) };
+			for(int h = 0; h < 2; h++) {
+				__m128i a = _mm_shufflelo_epi16(halves[h], _MM_SHUFFLE(3, 3, 3, 3));
+				a = _mm_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+				a = _mm_or_si128(_mm_and_si128(a, rgbMask), alphaOne);
+
+				// exact rounded x * a / 255
+				__m128i t = _mm_add_epi16(_mm_mullo_epi16(halves[h], a), half);
+				halves[h] = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+			}
+			_mm_storeu_si128((__m128i*)(rgba + i * 4), _mm_packus_epi16(halves[0], halves[1]));
+		}
+		return n;
+	}
+#elif WY_PIXEL_CONVERT_NEON
+	/// NEON转换, 每次16个像素, 返回处理的像素数
+	static int convertSIMD(const uint8_t* src, int count, wyTexturePixelFormat format, char* out, const uint8_t* pattern) {
+		int n = count & ~15;
+		uint8_t chan[6][16];
+		for(int k = 0; k < 16; k++) {
+			for(int c = 0; c < 3; c++) {
+				chan[c][k] = pattern ? pattern[(k & 3) * 4 + c] : 0;
+				chan[c + 3][k] = pattern ? pattern[16 + (k & 3) * 4 + c] : 0;
+			}
+		}
+		uint8x16_t dr = vld1q_u8(chan[0]);
+		uint8x16_t dg = vld1q_u8(chan[1]);
+		uint8x16_t db = vld1q_u8(chan[2]);
+		uint8x16_t hr = vld1q_u8(chan[3]);
+		uint8x16_t hg = vld1q_u8(chan[4]);
+		uint8x16_t hb = vld1q_u8(chan[5]);
+
+		for(int i = 0; i < n; i += 16) {
+			uint8x16x4_t px = vld4q_u8(src + i * 4);
+			if(format == WY_TEXTURE_PIXEL_FORMAT_A8) {
+				vst1q_u8((uint8_t*)out + i, px.val[3]);
+				continue;
+			}
+
+			uint8x16_t r = vqsubq_u8(vqaddq_u8(px.val[0], dr), hr);
+			uint8x16_t g = vqsubq_u8(vqaddq_u8(px.val[1], dg), hg);
+			uint8x16_t b = vqsubq_u8(vqaddq_u8(px.val[2], db), hb);
+			for(int h = 0; h < 2; h++) {
+				uint16x8_t R = vshll_n_u8(h ? vget_high_u8(r) : vget_low_u8(r), 8);
+				uint16x8_t G = vshll_n_u8(h ? vget_high_u8(g) : vget_low_u8(g), 8);
+				uint16x8_t B = vshll_n_u8(h ? vget_high_u8(b) : vget_low_u8(b), 8);
+				uint16x8_t A = vshll_n_u8(h ? vget_high_u8(px.val[3]) : vget_low_u8(px.val[3]), 8);
+				uint16x8_t o;
+				switch(format) {
+					case WY_TEXTURE_PIXEL_FORMAT_RGB565:
+						o = vsriq_n_u16(vsriq_n_u16(R, G, 5), B, 11);
+						break;
+					case WY_TEXTURE_PIXEL_FORMAT_RGBA4444:
+						o = vsriq_n_u16(vsriq_n_u16(vsriq_n_u16(R, G, 4), B, 8), A, 12);
+						break;
+					default:
+						o = vsriq_n_u16(vsriq_n_u16(vsriq_n_u16(R, G, 5), B, 10), A, 15);
+						break;
+				}
+				vst1q_u16((uint16_t*)out + i + h * 8, o);
+			}
+		}
+		return n;
+	}
+
+	/// NEON预乘, 每次8个像素, 返回处理的像素数
+	static int premultiplySIMD(uint8_t* rgba, int count) {
+		int n = count & ~7;
+		for(int i = 0; i < n; i += 8) {
+			uint8x8x4_t px = vld4_u8(rgba + i * 4);
+			for(int c = 0; c < 3; c++) {
+				// exact rounded x * a / 255
+				uint16x8_t t = vmull_u8(px.val[c], px.val[3]);
+				px.val[c] = vraddhn_u16(t, vrshrq_n_u16(t, 8));
+			}
+			vst4_u8(rgba + i * 4, px);
+		}
+		return n;
+	}
+#else
+	static int convertSIMD(const uint8_t* src, int count, wyTexturePixelFormat format, char* out, const uint8_t* pattern) {
+		return 0;
+	}
+
+	static int premultiplySIMD(uint8_t* rgba, int count) {
+		return 0;
+	}
+#endif
+
+	/// 转换一行, 行首必须是x为0的像素
+	static void convertRow(const uint8_t* src, int count, wyTexturePixelFormat format, char* out, const uint8_t* pattern) {
+		int done = convertSIMD(src, count, format, out, pattern);
+		convertScalar(src, done, count, format, out, pattern);
+	}
+
+	/// 把量化后的值扩展回8位, 和GPU的展开方式一致
+	static inline int expand(int q, int bits) {
+		return (q << (8 - bits)) | (q >> (2 * bits - 8));
+	}
+
+	/// Floyd-Steinberg误差扩散, 只处理16位格式
+	static void convertErrorDiffusion(const uint8_t* src, int width, int height, wyTexturePixelFormat format, char* out) {
+		int bits[4];
+		ditherBits(format, bits);
+
+		// error rows with one guard pixel at each side
+		int stride = (width + 2) * 3;
+		int* cur = (int*)calloc(stride * 2, sizeof(int));
+		int* next = cur + stride;
+		uint16_t* dst = (uint16_t*)out;
+		for(int y = 0; y < height; y++) {
+			for(int x = 0; x < width; x++) {
+				const uint8_t* p = src + ((size_t)y * width + x) * 4;
+				int v[3];
+				for(int c = 0; c < 3; c++) {
+					int e = (x + 1) * 3 + c;
+					int value = p[c] + cur[e] / 16;
+					value = value < 0 ? 0 : (value > 255 ? 255 : value);
+					int q = value >> (8 - bits[c]);
+					int err = value - expand(q, bits[c]);
+					cur[e + 3] += err * 7;
+					next[e - 3] += err * 3;
+					next[e] += err * 5;
+					next[e + 3] += err;
+					v[c] = value;
+				}
+				dst[(size_t)y * width + x] = pack16(format, v[0], v[1], v[2], p[3]);
+			}
+
+			int* tmp = cur;
+			cur = next;
+			next = tmp;
+			memset(next, 0, stride * sizeof(int));
+		}
+		free(cur < next ? cur : next);
+	}
+
+public:
+	/**
+	 * \if English
+	 * Get bytes per pixel of a format
+	 *
+	 * @param format pixel format
+	 * @return bytes per pixel
+	 * \else
+	 * 得到贴图格式每个像素的字节数
+	 *
+	 * @param format 贴图格式
+	 * @return 每个像素的字节数
+	 * \endif
+	 */
+	static int bytesPerPixel(wyTexturePixelFormat format) {
+		switch(format) {
+			case WY_TEXTURE_PIXEL_FORMAT_RGBA8888:
+				return 4;
+			case WY_TEXTURE_PIXEL_FORMAT_A8:
+				return 1;
+			default:
+				return 2;
+		}
+	}
+
+	/**
+	 * \if English
+	 * Get OpenGL format and type for a pixel format
+	 *
+	 * @param format pixel format
+	 * @param glFormat returns OpenGL format, such as GL_RGBA
+	 * @param glType returns OpenGL type, such as GL_UNSIGNED_SHORT_5_6_5
+	 * \else
+	 * 得到贴图格式对应的OpenGL格式和类型
+	 *
+	 * @param format 贴图格式
+	 * @param glFormat 返回OpenGL格式, 比如GL_RGBA
+	 * @param glType 返回OpenGL类型, 比如GL_UNSIGNED_SHORT_5_6_5
+	 * \endif
+	 */
+	static void glFormatOf(wyTexturePixelFormat format, GLenum* glFormat, GLenum* glType) {
+		switch(format) {
+			case WY_TEXTURE_PIXEL_FORMAT_RGB565:
+				*glFormat = GL_RGB;
+				*glType = GL_UNSIGNED_SHORT_5_6_5;
+				break;
+			case WY_TEXTURE_PIXEL_FORMAT_RGBA4444:
+				*glFormat = GL_RGBA;
+				*glType = GL_UNSIGNED_SHORT_4_4_4_4;
+				break;
+			case WY_TEXTURE_PIXEL_FORMAT_RGBA5551:
+				*glFormat = GL_RGBA;
+				*glType = GL_UNSIGNED_SHORT_5_5_5_1;
+				break;
+			case WY_TEXTURE_PIXEL_FORMAT_A8:
+				*glFormat = GL_ALPHA;
+				*glType = GL_UNSIGNED_BYTE;
+				break;
+			default:
+				*glFormat = GL_RGBA;
+				*glType = GL_UNSIGNED_BYTE;
+				break;
+		}
+	}
+
+	/**
+	 * \if English
+	 * Convert RGBA8888 pixels to a format without dithering
+	 *
+	 * @param rgba source pixels, in RGBA8888 format
+	 * @param count pixel count
+	 * @param format target format
+	 * @param out output buffer, must hold \c count * \c bytesPerPixel(format) bytes.
+	 * 		It can be same as \c rgba, conversion can be done in place.
+	 * \else
+	 * 把RGBA8888像素转换为一种贴图格式, 不抖动
+	 *
+	 * @param rgba 源像素, RGBA8888格式
+	 * @param count 像素数
+	 * @param format 目标格式
+	 * @param out 输出缓冲区, 大小必须至少为\c count * \c bytesPerPixel(format)字节.
+	 * 		可以和\c rgba相同, 即原地转换.
+	 * \endif
+	 */
+	static void convert(const char* rgba, int count, wyTexturePixelFormat format, char* out) {
+		if(format == WY_TEXTURE_PIXEL_FORMAT_RGBA8888) {
+			if(out != rgba)
+				memmove(out, rgba, (size_t)count * 4);
+			return;
+		}
+		convertRow((const uint8_t*)rgba, count, format, out, NULL);
+	}
+
+	/**
+	 * \if English
+	 * Convert an RGBA8888 image to a format, with optional dithering for 16 bits formats
+	 *
+	 * @param rgba source pixels, in RGBA8888 format
+	 * @param width width of image
+	 * @param height height of image
+	 * @param format target format
+	 * @param out output buffer, can be same as \c rgba
+	 * @param dither dithering mode, ignored for RGBA8888 and A8
+	 * \else
+	 * 把RGBA8888图片转换为一种贴图格式, 16位格式可以选择抖动
+	 *
+	 * @param rgba 源像素, RGBA8888格式
+	 * @param width 图片宽度
+	 * @param height 图片高度
+	 * @param format 目标格式
+	 * @param out 输出缓冲区, 可以和\c rgba相同
+	 * @param dither 抖动方式, 对RGBA8888和A8无效
+	 * \endif
+	 */
+	static void convertImage(const char* rgba, int width, int height, wyTexturePixelFormat format, char* out, wyDitherMode dither = DITHER_NONE) {
+		if(bytesPerPixel(format) != 2 || dither == DITHER_NONE) {
+			convert(rgba, width * height, format, out);
+		} else if(dither == DITHER_ERROR_DIFFUSION) {
+			convertErrorDiffusion((const uint8_t*)rgba, width, height, format, out);
+		} else {
+			uint8_t pattern[32];
+			for(int y = 0; y < height; y++) {
+				ditherPattern(format, y, pattern);
+				size_t offset = (size_t)y * width;
+				convertRow((const uint8_t*)rgba + offset * 4, width, format, out + offset * 2, pattern);
+			}
+		}
+	}
+
+	/**
+	 * \if English
+	 * Premultiply color channels of RGBA8888 pixels by alpha, in place
+	 *
+	 * @param rgba pixels in RGBA8888 format
+	 * @param count pixel count
+	 * \else
+	 * 用alpha预乘RGBA8888像素的颜色通道, 原地修改
+	 *
+	 * @param rgba RGBA8888格式的像素
+	 * @param count 像素数
+	 * \endif
+	 */
+	static void premultiply(char* rgba, int count) {
+		uint8_t* p = (uint8_t*)rgba;
+		int done = premultiplySIMD(p, count);
+		for(int i = done; i < count; i++) {
+			uint8_t* px = p + i * 4;
+			for(int c = 0; c < 3; c++) {
+				int t = px[c] * px[3] + 128;
+				px[c] = (t + (t >> 8)) >> 8;
+			}
+		}
+	}
+};
+
+#endif // __wyPixelConvert_h__
@@ -6,12 +6,14 @@ import com.wiyun.engine.nodes.INodeVirtualMethods;
 import com.wiyun.engine.nodes.Layer;
 import com.wiyun.engine.nodes.Sprite;
 import com.wiyun.engine.opengl.Texture2D;
+import com.wiyun.engine.opengl.TextureManager;
 import com.wiyun.engine.types.WYPoint;
 import com.wiyun.engine.types.WYRect;
 import com.wiyun.engine.utils.ResolutionIndependent;
 import com.yingql.android.games.zhaocha.core.GameStrategy;
 import com.yingql.android.games.zhaocha.entity.GameInfo;
 import com.yingql.android.games.zhaocha.entity.LevelInfo;
+import com.yingql.android.games.zhaocha.entity.PieceInfo;
 import com.yingql.android.games.zhaocha.sprite.Pieces;
 
 public class GameLayer extends Layer implements INodeVirtualMethods
@@ -28,6 +30,7 @@ public class GameLayer extends Layer implements INodeVirtualMethods
 
 	private Pieces pieces;
 	private WYRect clickArea;
+	private LevelInfo currentLevel;
 
 	public GameLayer()
 	{
@@ -42,6 +45,11 @@ public class GameLayer extends Layer implements INodeVirtualMethods
 		this.removeAllChildren(true);
 
 		LevelInfo info = gameInfo.getLevelInfo();
+		if (currentLevel != null && currentLevel != info)
+		{
+			releaseLevelTextures(currentLevel);
+		}
+		currentLevel = info;
 
 		Sprite leftImage = Sprite.make(Texture2D.makeJPG(info.getResPath()));
 		leftImage.setAnchorPercent(0, 0);
@@ -58,6 +66,22 @@ public class GameLayer extends Layer implements INodeVirtualMethods
 		pieces.init(info);
 	}
 
+	/**
+	 * 释放一关的大图和所有茬的贴图，否则连续玩很多关后贴图会一直累积在显存中。
+	 * 只删除OpenGL贴图，不删除句柄，如果之后又用到会自动重新载入
+	 * 
+	 * @param info
+	 */
+	private void releaseLevelTextures(LevelInfo info)
+	{
+		TextureManager manager = TextureManager.getInstance();
+		manager.removeTexture(info.getResPath());
+		for (PieceInfo pieceInfo : info.getPieces())
+		{
+			manager.removeTexture(pieceInfo.getResPath());
+		}
+	}
+
 	@Override
 	public boolean wyTouchesBegan(MotionEvent event)
 	{
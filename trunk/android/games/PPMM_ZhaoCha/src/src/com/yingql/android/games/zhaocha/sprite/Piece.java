@@ -1,13 +1,11 @@
 package com.yingql.android.games.zhaocha.sprite;
 
-import javax.microedition.khronos.opengles.GL10;
+import java.nio.FloatBuffer;
 
 import android.view.MotionEvent;
 
-import com.wiyun.engine.nodes.Director;
 import com.wiyun.engine.nodes.Node;
 import com.wiyun.engine.nodes.Sprite;
-import com.wiyun.engine.opengl.Primitives;
 import com.wiyun.engine.opengl.Texture2D;
 import com.wiyun.engine.types.WYPoint;
 import com.wiyun.engine.types.WYRect;
@@ -22,6 +20,11 @@ public class Piece extends Node
 	private static int ZINDEX = -1;
 	private int index = 1;
 
+	/**
+	 * 一个矩形以GL_LINES绘制时的顶点数, 4条边, 每条边2个顶点
+	 */
+	public static final int RECT_VERTICES = 8;
+
 	public Piece(PieceInfo info)
 	{
 		isFind = info.isFind();
@@ -64,16 +67,31 @@ public class Piece extends Node
 		return false;
 	}
 
-	public void drawRect()
+	/**
+	 * 如果已经被找到, 把左右两个矩形以GL_LINES线段的形式追加到顶点缓冲中
+	 * 
+	 * @param buffer 顶点缓冲, 每个顶点2个float, 每个矩形{@link #RECT_VERTICES}个顶点
+	 * @return 追加的顶点数
+	 */
+	public int appendRect(FloatBuffer buffer)
 	{
-		if (this.isFind)
-		{
-			GL10 gl = Director.getInstance().gl;
-			gl.glColor4f(1.0f, 0.0f, 0.0f, 1.0f);
-			Primitives.drawRect(touchRectLeft);
-			Primitives.drawRect(touchRectRight);
-			gl.glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
-		}
+		if (!this.isFind)
+			return 0;
+		appendRect(buffer, touchRectLeft);
+		appendRect(buffer, touchRectRight);
+		return RECT_VERTICES * 2;
+	}
+
+	private static void appendRect(FloatBuffer buffer, WYRect rect)
+	{
+		float l = rect.origin.x;
+		float b = rect.origin.y;
+		float r = l + rect.size.width;
+		float t = b + rect.size.height;
+		buffer.put(l).put(b).put(r).put(b);
+		buffer.put(r).put(b).put(r).put(t);
+		buffer.put(r).put(t).put(l).put(t);
+		buffer.put(l).put(t).put(l).put(b);
 	}
 
 	public boolean isFind()
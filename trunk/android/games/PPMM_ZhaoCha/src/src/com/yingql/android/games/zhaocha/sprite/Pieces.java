@@ -1,10 +1,16 @@
 package com.yingql.android.games.zhaocha.sprite;
 
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.FloatBuffer;
 import java.util.ArrayList;
 import java.util.List;
 
+import javax.microedition.khronos.opengles.GL10;
+
 import android.view.MotionEvent;
 
+import com.wiyun.engine.nodes.Director;
 import com.wiyun.engine.nodes.Node;
 import com.yingql.android.games.zhaocha.entity.Archive;
 import com.yingql.android.games.zhaocha.entity.LevelInfo;
@@ -15,6 +21,10 @@ public class Pieces extends Node
 {
 	private GameLayer layer;
 	private List<Piece> pieces = new ArrayList<Piece>();
+	/**
+	 * 所有找到的茬的矩形的顶点, 每帧重复使用, 避免每个矩形一次绘制调用
+	 */
+	private FloatBuffer rectVertices;
 
 	public Pieces(GameLayer layer)
 	{
@@ -32,6 +42,10 @@ public class Pieces extends Node
 			piece.autoRelease();
 			pieces.add(piece);
 		}
+
+		// 每个茬左右两个矩形, 每个顶点2个float, 每个float 4个字节
+		int capacity = Math.max(1, pieces.size()) * Piece.RECT_VERTICES * 2 * 2;
+		rectVertices = ByteBuffer.allocateDirect(capacity * 4).order(ByteOrder.nativeOrder()).asFloatBuffer();
 	}
 
 	/**
@@ -39,14 +53,30 @@ public class Pieces extends Node
 	 */
 	public void drawRectIfFind()
 	{
+		if (rectVertices == null)
+			return;
+
+		// 所有矩形放在一个缓冲中, 只需要一次glDrawArrays
 		List<Piece> temp = new ArrayList<Piece>(pieces);
+		rectVertices.clear();
+		int count = 0;
 		for (Piece piece : temp)
 		{
-			if (piece.isFind())
-			{
-				piece.drawRect();
-			}
+			if (rectVertices.remaining() < Piece.RECT_VERTICES * 2 * 2)
+				break;
+			count += piece.appendRect(rectVertices);
 		}
+		if (count == 0)
+			return;
+		rectVertices.position(0);
+
+		GL10 gl = Director.getInstance().gl;
+		gl.glColor4f(1.0f, 0.0f, 0.0f, 1.0f);
+		gl.glEnableClientState(GL10.GL_VERTEX_ARRAY);
+		gl.glVertexPointer(2, GL10.GL_FLOAT, 0, rectVertices);
+		gl.glDrawArrays(GL10.GL_LINES, 0, count);
+		gl.glDisableClientState(GL10.GL_VERTEX_ARRAY);
+		gl.glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
 	}
 
 	/**